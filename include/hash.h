@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace scvk
+{
+	// 64-bit non-cryptographic hash of a block of memory (MurmurHash64A). Used to key on-disk caches and deduplicate content.
+	inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0)
+	{
+		constexpr uint64_t m = 0xc6a4a7935bd1e995ull;
+		constexpr int r = 47;
+
+		uint64_t h = seed ^ (size * m);
+
+		const auto* bytes = static_cast<const unsigned char*>(data);
+		const size_t wordCount = size / 8;
+		for (size_t i = 0; i < wordCount; ++i) {
+			uint64_t k;
+			memcpy(&k, bytes + i * 8, sizeof(k));
+
+			k *= m;
+			k ^= k >> r;
+			k *= m;
+
+			h ^= k;
+			h *= m;
+		}
+
+		const unsigned char* tail = bytes + wordCount * 8;
+		switch (size & 7) {
+		case 7: h ^= uint64_t(tail[6]) << 48; [[fallthrough]];
+		case 6: h ^= uint64_t(tail[5]) << 40; [[fallthrough]];
+		case 5: h ^= uint64_t(tail[4]) << 32; [[fallthrough]];
+		case 4: h ^= uint64_t(tail[3]) << 24; [[fallthrough]];
+		case 3: h ^= uint64_t(tail[2]) << 16; [[fallthrough]];
+		case 2: h ^= uint64_t(tail[1]) << 8; [[fallthrough]];
+		case 1: h ^= uint64_t(tail[0]);
+			h *= m;
+		}
+
+		h ^= h >> r;
+		h *= m;
+		h ^= h >> r;
+		return h;
+	}
+
+	// Mixes value into an existing hash.
+	inline uint64_t hashCombine(uint64_t hash, uint64_t value)
+	{
+		return hashBytes(&value, sizeof(value), hash);
+	}
+
+	// 128-bit hash, for content that is deduplicated on the hash alone. Two passes of hashBytes(), the second seeded
+	// with the first.
+	struct Hash128
+	{
+		uint64_t mLow{ 0 };
+		uint64_t mHigh{ 0 };
+
+		bool operator==(const Hash128&) const = default;
+	};
+
+	inline Hash128 hashBytes128(const void* data, size_t size, uint64_t seed = 0)
+	{
+		const uint64_t low = hashBytes(data, size, seed);
+		return { low, hashBytes(data, size, low ^ 0x9e3779b97f4a7c15ull) };
+	}
+
+	inline Hash128 hashCombine(Hash128 hash, uint64_t value)
+	{
+		return { hashCombine(hash.mLow, value), hashCombine(hash.mHigh, value) };
+	}
+
+	// For unordered containers keyed by Hash128. Either half is already well mixed.
+	struct Hash128Hash
+	{
+		size_t operator()(const Hash128& hash) const { return static_cast<size_t>(hash.mLow); }
+	};
+}
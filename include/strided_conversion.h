@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Bulk conversion of strided vertex attribute streams, e.g. glTF accessors, into interleaved vertices.
+// Every loop has the component type, component count and destination layout fixed at compile time
+// and no calls or branches per element, so the compiler can unroll and vectorize it.
+namespace scvk
+{
+	enum class ComponentKind : uint8_t
+	{
+		Float32,
+		UNorm8,
+		UNorm16,
+		UInt8,
+		UInt16,
+		UInt32,
+	};
+
+	// count elements of componentCount components each, stride bytes apart.
+	struct StridedView
+	{
+		const std::byte*	mData{ nullptr };
+		size_t				mStride{ 0 };
+		size_t				mCount{ 0 };
+		uint32_t			mComponentCount{ 0 };
+		ComponentKind		mKind{ ComponentKind::Float32 };
+	};
+
+	namespace detail
+	{
+		template<typename T>
+		inline T loadUnaligned(const std::byte* p)
+		{
+			T value;
+			memcpy(&value, p, sizeof(T));
+			return value;
+		}
+
+		// Reads SrcN components of type T from every element, scales them and writes them to the first SrcN of dstOffsets.
+		// The remaining N - SrcN destination components are set to fill.
+		template<typename T, size_t SrcN, size_t N>
+		inline void convertElements(const StridedView& src, std::byte* dst, size_t dstStride, const std::array<uint32_t, N>& dstOffsets, float scale, float fill)
+		{
+			static_assert(SrcN <= N);
+			const std::byte* in = src.mData;
+			for (size_t i = 0; i < src.mCount; ++i, in += src.mStride, dst += dstStride) {
+				for (size_t c = 0; c < SrcN; ++c) {
+					const float value = static_cast<float>(loadUnaligned<T>(in + c * sizeof(T))) * scale;
+					memcpy(dst + dstOffsets[c], &value, sizeof(float));
+				}
+				for (size_t c = SrcN; c < N; ++c) {
+					memcpy(dst + dstOffsets[c], &fill, sizeof(float));
+				}
+			}
+		}
+
+		template<typename T, size_t N>
+		inline bool convertComponents(const StridedView& src, std::byte* dst, size_t dstStride, const std::array<uint32_t, N>& dstOffsets, float scale, float fill)
+		{
+			if (src.mComponentCount == N) {
+				convertElements<T, N, N>(src, dst, dstStride, dstOffsets, scale, fill);
+				return true;
+			}
+			if constexpr (N == 4) {
+				// E.g. RGB colors into RGBA.
+				if (src.mComponentCount == 3) {
+					convertElements<T, 3, N>(src, dst, dstStride, dstOffsets, scale, fill);
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+
+	// Converts every element of src to N floats and writes them at dstOffsets inside consecutive dstStride-sized elements of dst.
+	// Normalized integers are mapped to [0, 1]. Sources with 3 components fill the fourth destination component with fill.
+	// Returns false, without writing anything, for combinations that are not supported.
+	template<size_t N>
+	inline bool convertAttribute(const StridedView& src, std::byte* dst, size_t dstStride, const std::array<uint32_t, N>& dstOffsets, float fill = 1.f)
+	{
+		switch (src.mKind) {
+		case ComponentKind::Float32:	return detail::convertComponents<float, N>(src, dst, dstStride, dstOffsets, 1.f, fill);
+		case ComponentKind::UNorm8:		return detail::convertComponents<uint8_t, N>(src, dst, dstStride, dstOffsets, 1.f / 255.f, fill);
+		case ComponentKind::UNorm16:	return detail::convertComponents<uint16_t, N>(src, dst, dstStride, dstOffsets, 1.f / 65535.f, fill);
+		case ComponentKind::UInt8:		return detail::convertComponents<uint8_t, N>(src, dst, dstStride, dstOffsets, 1.f, fill);
+		case ComponentKind::UInt16:		return detail::convertComponents<uint16_t, N>(src, dst, dstStride, dstOffsets, 1.f, fill);
+		case ComponentKind::UInt32:		return detail::convertComponents<uint32_t, N>(src, dst, dstStride, dstOffsets, 1.f, fill);
+		}
+		return false;
+	}
+
+	// Writes value at dstOffsets inside count consecutive dstStride-sized elements of dst. Used for attributes a mesh does not have.
+	template<size_t N>
+	inline void fillAttribute(const std::array<float, N>& value, std::byte* dst, size_t dstStride, size_t count, const std::array<uint32_t, N>& dstOffsets)
+	{
+		for (size_t i = 0; i < count; ++i, dst += dstStride) {
+			for (size_t c = 0; c < N; ++c) {
+				memcpy(dst + dstOffsets[c], &value[c], sizeof(float));
+			}
+		}
+	}
+
+	// Widens scalar unsigned integer indices to 32 bits and adds baseVertex. Returns false for other component kinds.
+	inline bool convertIndices(const StridedView& src, uint32_t baseVertex, uint32_t* dst)
+	{
+		if (src.mComponentCount != 1) {
+			return false;
+		}
+		const std::byte* in = src.mData;
+		switch (src.mKind) {
+		case ComponentKind::UInt8:
+			for (size_t i = 0; i < src.mCount; ++i) {
+				dst[i] = static_cast<uint32_t>(std::to_integer<uint8_t>(in[i * src.mStride])) + baseVertex;
+			}
+			return true;
+		case ComponentKind::UInt16:
+			for (size_t i = 0; i < src.mCount; ++i) {
+				dst[i] = static_cast<uint32_t>(detail::loadUnaligned<uint16_t>(in + i * src.mStride)) + baseVertex;
+			}
+			return true;
+		case ComponentKind::UInt32:
+			for (size_t i = 0; i < src.mCount; ++i) {
+				dst[i] = detail::loadUnaligned<uint32_t>(in + i * src.mStride) + baseVertex;
+			}
+			return true;
+		default:
+			return false;
+		}
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace scvk
+{
+	// A fixed-size pool of worker threads consuming a shared FIFO of jobs.
+	class ThreadPool
+	{
+	public:
+
+		// Creates one worker per hardware thread unless a count is given.
+		explicit ThreadPool(unsigned int threadCount = 0)
+		{
+			if (threadCount == 0) {
+				threadCount = std::max(1u, std::thread::hardware_concurrency());
+			}
+			mWorkers.reserve(threadCount);
+			for (unsigned int i = 0; i < threadCount; ++i) {
+				mWorkers.emplace_back([this]() { workerLoop(); });
+			}
+		}
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard lock(mMutex);
+				mStopping = true;
+			}
+			mCondition.notify_all();
+			for (auto& worker : mWorkers) {
+				worker.join();
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		unsigned int size() const noexcept { return static_cast<unsigned int>(mWorkers.size()); }
+
+		// Queues a job and returns a future holding its result (or the exception it threw).
+		template<typename F>
+		auto submit(F&& function) -> std::future<std::invoke_result_t<F>>
+		{
+			using Result = std::invoke_result_t<F>;
+			auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(function));
+			std::future<Result> result = task->get_future();
+			{
+				std::lock_guard lock(mMutex);
+				mJobs.emplace([task]() { (*task)(); });
+			}
+			mCondition.notify_one();
+			return result;
+		}
+
+		// Calls function(i) for every i in [0, count), spread across the workers, and blocks until all calls returned.
+		template<typename F>
+		void parallelFor(size_t count, F&& function)
+		{
+			if (count == 0) {
+				return;
+			}
+			const size_t chunkCount = std::min<size_t>(count, size());
+			const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+			std::vector<std::future<void>> chunks;
+			chunks.reserve(chunkCount);
+			for (size_t begin = 0; begin < count; begin += chunkSize) {
+				const size_t end = std::min(count, begin + chunkSize);
+				chunks.emplace_back(submit([&function, begin, end]() {
+					for (size_t i = begin; i < end; ++i) {
+						function(i);
+					}
+				}));
+			}
+			// Let every chunk finish before rethrowing, since they all reference function.
+			for (auto& chunk : chunks) {
+				chunk.wait();
+			}
+			for (auto& chunk : chunks) {
+				chunk.get();
+			}
+		}
+
+	private:
+
+		void workerLoop()
+		{
+			while (true) {
+				std::function<void()> job;
+				{
+					std::unique_lock lock(mMutex);
+					mCondition.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+					if (mStopping && mJobs.empty()) {
+						return;
+					}
+					job = std::move(mJobs.front());
+					mJobs.pop();
+				}
+				job();
+			}
+		}
+
+		std::vector<std::thread>			mWorkers;
+		std::queue<std::function<void()>>	mJobs;
+		std::mutex							mMutex;
+		std::condition_variable				mCondition;
+		bool								mStopping{ false };
+	};
+}
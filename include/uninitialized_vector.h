@@ -0,0 +1,33 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+namespace scvk
+{
+	// Allocator that default-initializes instead of value-initializing, so resize() leaves trivial elements uninitialized.
+	// Used for large arrays that are filled right after growing them, where zeroing them first would be a wasted pass.
+	template<typename T>
+	struct DefaultInitAllocator : std::allocator<T>
+	{
+		template<typename U>
+		struct rebind { using other = DefaultInitAllocator<U>; };
+
+		using std::allocator<T>::allocator;
+
+		template<typename U>
+		void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>)
+		{
+			::new (static_cast<void*>(p)) U;
+		}
+
+		template<typename U, typename... Args>
+		void construct(U* p, Args&&... args)
+		{
+			std::allocator_traits<std::allocator<T>>::construct(static_cast<std::allocator<T>&>(*this), p, std::forward<Args>(args)...);
+		}
+	};
+
+	template<typename T>
+	using UninitializedVector = std::vector<T, DefaultInitAllocator<T>>;
+}
@@ -54,6 +54,21 @@ namespace vkinit {
         return info;
     }
 
+    // Trilinear filtering over the full mip chain.
+    inline VkSamplerCreateInfo samplerCreateInfo(VkFilter filter = VK_FILTER_LINEAR, VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT)
+    {
+        VkSamplerCreateInfo info = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+        info.magFilter = filter;
+        info.minFilter = filter;
+        info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        info.addressModeU = addressMode;
+        info.addressModeV = addressMode;
+        info.addressModeW = addressMode;
+        info.minLod = 0.f;
+        info.maxLod = VK_LOD_CLAMP_NONE;
+        return info;
+    }
+
     inline VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfo(VkShaderStageFlagBits stage,
         VkShaderModule shaderModule, const char* entry)
     {
@@ -0,0 +1,117 @@
+#version 460
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "culling.inc"
+#include "draw_data.inc"
+
+// Each invocation tests one draw's bounding sphere against the view frustum, and appends the commands of
+// visible draws to a compacted list that vkCmdDrawIndexedIndirectCount consumes.
+layout(local_size_x = 64) in;
+
+// Matches CullPass in mesh.h.
+const uint CULL_PASS_FRUSTUM = 0;	// Frustum culling only.
+const uint CULL_PASS_EARLY = 1;		// Draws visible last frame that are inside the frustum.
+const uint CULL_PASS_LATE = 2;		// Draws not visible last frame that pass the depth pyramid test. Updates visibility.
+layout(constant_id = 0) const uint CULL_PASS = CULL_PASS_FRUSTUM;
+
+layout(set = 0, binding = 0, std430) uniform FrameData {
+	mat4 view;
+	mat4 proj;
+	mat4 viewProj;
+} frameData;
+
+// The depth pyramid built from this frame's early pass, sampled with a max reduction sampler. Late pass only.
+layout(set = 1, binding = 0) uniform sampler2D depthPyramid;
+
+// The visible draw count, zeroed before the dispatch, then the commands of the visible draws in no particular order.
+layout(buffer_reference, std430) buffer VisibleDrawBuffer {
+	uint count;
+	uint occludedCount;		// Late pass: draws in the frustum that the depth pyramid hides.
+	uint maskedCount;		// Alpha masked draws, whose commands follow the room left for every opaque draw.
+	uint padding;
+	DrawCommand commands[];
+};
+
+// Whether each draw was visible at the end of the last frame's late pass.
+layout(buffer_reference, std430) buffer VisibilityBuffer {
+	uint visible[];
+};
+
+// Matches CullPushConstants in mesh.h.
+layout(push_constant) uniform constants
+{
+	uvec2 drawDataBuffer;
+	uvec2 drawCommandBuffer;	// Every draw's command, with its level of detail.
+	uvec2 visibleDrawBuffer;
+	uint drawCount;
+	uvec2 visibilityBuffer;
+	vec2 pyramidSize;			// Texels in level 0 of the depth pyramid.
+	float znear;
+	uint opaqueDrawCount;		// Draws from this index on are alpha masked.
+} PushConstants;
+
+// Whether the depth pyramid proves a world space sphere hidden behind what the early pass drew.
+bool sphereOccluded(vec3 center, float radius)
+{
+	// View space with z along the view direction. Spheres crossing the near plane cannot be bounded on screen.
+	vec3 c = (frameData.view * vec4(center, 1.0)).xyz;
+	c.z = -c.z;
+	if (c.z < radius + PushConstants.znear) {
+		return false;
+	}
+
+	// The pyramid level at which the sphere's bounds are at most one texel wide. Wherever they fall, they then touch
+	// at most the 2x2 texels around their center, which is exactly what one bilinear max fetch there reads. Rounding
+	// the level down would let the bounds reach texels the fetch misses, and cull draws that are still visible.
+	vec4 bounds = projectSphere(c, radius, frameData.proj[0][0], frameData.proj[1][1]);
+	vec2 extent = (bounds.zw - bounds.xy) * PushConstants.pyramidSize;
+	float level = max(ceil(log2(max(extent.x, extent.y))), 0.0);
+	float pyramidDepth = textureLod(depthPyramid, (bounds.xy + bounds.zw) * 0.5, level).x;
+
+	// Depth of the sphere's nearest point, through the same projection as the depth buffer.
+	vec4 nearest = frameData.proj * vec4(0.0, 0.0, -(c.z - radius), 1.0);
+	return nearest.z / nearest.w > pyramidDepth;
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= PushConstants.drawCount) {
+		return;
+	}
+
+	vec4 sphere = DrawDataBuffer(PushConstants.drawDataBuffer).draws[index].boundingSphere;
+	bool visible = sphereInFrustum(sphere.xyz, sphere.w, frameData.viewProj);
+
+	VisibleDrawBuffer list = VisibleDrawBuffer(PushConstants.visibleDrawBuffer);
+	if (CULL_PASS == CULL_PASS_EARLY) {
+		visible = visible && VisibilityBuffer(PushConstants.visibilityBuffer).visible[index] != 0;
+	}
+	else if (CULL_PASS == CULL_PASS_LATE) {
+		VisibilityBuffer visibility = VisibilityBuffer(PushConstants.visibilityBuffer);
+		bool drawnEarly = visibility.visible[index] != 0;
+		if (visible && sphereOccluded(sphere.xyz, sphere.w)) {
+			visible = false;
+			if (!drawnEarly) {
+				atomicAdd(list.occludedCount, 1);
+			}
+		}
+		visibility.visible[index] = visible ? 1u : 0u;
+
+		// Draws visible last frame were already drawn by the early pass.
+		visible = visible && !drawnEarly;
+	}
+
+	// Opaque and alpha masked draws are drawn with different pipelines, so they are compacted into separate ranges.
+	if (visible) {
+		DrawCommand command = DrawCommandBuffer(PushConstants.drawCommandBuffer).commands[index];
+		if (index < PushConstants.opaqueDrawCount) {
+			list.commands[atomicAdd(list.count, 1)] = command;
+		}
+		else {
+			list.commands[PushConstants.opaqueDrawCount + atomicAdd(list.maskedCount, 1)] = command;
+		}
+	}
+}
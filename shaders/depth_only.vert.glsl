@@ -0,0 +1,33 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex_formats.inc"
+#include "draw_data.inc"
+
+// The depth pre-pass of opaque draws: positions only, and no fragment shader.
+
+layout(set = 0, binding = 0, std430) uniform FrameData {
+	mat4 view;
+	mat4 proj;
+	mat4 viewProj;
+} frameData;
+
+// Matches GPUDrawPushConstants in mesh.h, as in mesh.vert.
+layout(push_constant) uniform constants
+{
+	uvec2 vertexBuffer;
+	uvec2 drawDataBuffer;
+} PushConstants;
+
+// Computed exactly as in mesh.vert, so the shading pass finds equal depths.
+invariant gl_Position;
+
+void main()
+{
+	mat4 renderMatrix = DrawDataBuffer(PushConstants.drawDataBuffer).draws[gl_InstanceIndex].render_matrix;
+	vec3 position = loadPosition(PushConstants.vertexBuffer, gl_VertexIndex);
+	gl_Position = frameData.proj * frameData.view * renderMatrix * vec4(position, 1.0f);
+}
@@ -0,0 +1,35 @@
+#version 460
+
+// Writes one level of the depth pyramid from the level above it, or from the depth buffer for level 0.
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(set = 0, binding = 0, r32f) uniform writeonly image2D outDepth;
+
+layout(set = 0, binding = 1) uniform sampler2D inDepth;
+
+layout(push_constant) uniform constants
+{
+	vec2 outSize;
+} PushConstants;
+
+void main()
+{
+	uvec2 pos = gl_GlobalInvocationID.xy;
+	if (any(greaterThanEqual(pos, uvec2(PushConstants.outSize)))) {
+		return;
+	}
+
+	// The farthest of every input texel the output texel overlaps. Level 0 shrinks the depth buffer by less than two,
+	// e.g. 1920 to 1024 texels, so its footprints straddle up to 3x3 texels rather than the 2x2 of a bilinear fetch.
+	uvec2 inSize = uvec2(textureSize(inDepth, 0));
+	uvec2 outSize = uvec2(PushConstants.outSize);
+	uvec2 first = pos * inSize / outSize;
+	uvec2 last = min(((pos + 1) * inSize + outSize - 1) / outSize, inSize) - 1;
+	float depth = 0.0;
+	for (uint y = first.y; y <= last.y; ++y) {
+		for (uint x = first.x; x <= last.x; ++x) {
+			depth = max(depth, texelFetch(inDepth, ivec2(x, y), 0).x);
+		}
+	}
+	imageStore(outDepth, ivec2(pos), vec4(depth));
+}
@@ -1,18 +1,29 @@
 #version 460
+#extension GL_EXT_nonuniform_qualifier : require
 
 //shader input
 layout (location = 0) in vec3 inColor;
 layout(location = 1)  in  vec2 inUV;
+layout(location = 2) flat in uint inTextureIndex;	// The same for every fragment of a draw.
+layout(location = 3) flat in float inAlphaCutoff;	// 0 for opaque draws.
+
+// Set for the pipelines of alpha masked draws only, so opaque draws keep early depth writes.
+layout(constant_id = 0) const bool ALPHA_TEST = false;
 
 //output write
 layout (location = 0) out vec4 outFragColor;
 
-layout(set = 1, binding = 0) uniform sampler2D displayTexture;
+// Every texture of the scene. Only the entries of the scene's textures are written.
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 void main() 
 {
 	//return red
 	//outFragColor = vec4(inColor,1.0f);
-	outFragColor = texture(displayTexture, inUV);
+	vec4 color = texture(textures[inTextureIndex], inUV);
+	if (ALPHA_TEST && color.a < inAlphaCutoff) {
+		discard;
+	}
+	outFragColor = color;
 
 }
\ No newline at end of file
@@ -1,19 +1,20 @@
 #version 450
 #extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
 #extension GL_EXT_scalar_block_layout : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex_formats.inc"
+#include "draw_data.inc"
 
 
 layout(location = 0) out vec3 outColor;
 layout(location = 1) out vec2 outUV;
+layout(location = 2) flat out uint outTextureIndex;
+layout(location = 3) flat out float outAlphaCutoff;
 
-struct Vertex {
-
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	vec4 color;
-};
+// Computed exactly as in depth_only.vert, so the shading pass after a depth pre-pass finds equal depths.
+invariant gl_Position;
 
 layout(set = 0, binding = 0, std430) uniform FrameData {
 	mat4 view;
@@ -21,26 +22,26 @@ layout(set = 0, binding = 0, std430) uniform FrameData {
 	mat4 viewProj;
 } frameData;
 
-// Buffer_reference tells the shader that the data will be accessed direcly using the buffer address.
-layout(buffer_reference, std430) readonly buffer VertexBuffer {
-	Vertex vertices[];
-};
-
 //push constants block
 layout(push_constant) uniform constants
 {
-	mat4 render_matrix;
-	VertexBuffer vertexBuffer; // Note that this is a uint64_t handle.
+	uvec2 vertexBuffer;		// Device address of the vertices, in VERTEX_FORMAT.
+	uvec2 drawDataBuffer;	// Device address of the DrawData of every draw, indexed by the draw's firstInstance.
 } PushConstants;
 
 void main()
 {
+	// Every draw has a single instance, so the instance index is the draw's firstInstance.
+	DrawData draw = DrawDataBuffer(PushConstants.drawDataBuffer).draws[gl_InstanceIndex];
+
 	//load vertex data from device adress
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	Vertex v = loadVertex(PushConstants.vertexBuffer, gl_VertexIndex);
 
 	//output data
-	gl_Position = frameData.proj * frameData.view * PushConstants.render_matrix * vec4(v.position, 1.0f);
+	gl_Position = frameData.proj * frameData.view * draw.render_matrix * vec4(v.position, 1.0f);
 	outColor = v.color.xyz;
 	outUV.x = v.uv_x;
 	outUV.y = v.uv_y;
-}
\ No newline at end of file
+	outTextureIndex = draw.textureIndex;
+	outAlphaCutoff = draw.alphaCutoff;
+}
@@ -0,0 +1,47 @@
+#version 460
+#extension GL_EXT_mesh_shader : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex_formats.inc"
+#include "meshlets.inc"
+
+// One workgroup per visible meshlet. The limits match MESHLET_MAX_VERTICES and MESHLET_MAX_TRIANGLES in mesh.h.
+layout(local_size_x = 32) in;
+layout(triangles, max_vertices = 64, max_primitives = 124) out;
+
+// Same outputs as mesh.vert, so the pipeline shares mesh.frag.
+layout(location = 0) out vec3 outColor[];
+layout(location = 1) out vec2 outUV[];
+layout(location = 2) flat out uint outTextureIndex[];
+layout(location = 3) flat out float outAlphaCutoff[];
+
+// The depth pre-pass and the shading pass after it must compute the same depths for the equal depth test.
+out gl_MeshPerVertexEXT {
+	invariant vec4 gl_Position;
+} gl_MeshVerticesEXT[];
+
+taskPayloadSharedEXT TaskPayload payload;
+
+void main()
+{
+	Meshlet meshlet = MeshletBuffer(PushConstants.meshletBuffer).meshlets[payload.meshletIndices[gl_WorkGroupID.x]];
+	SetMeshOutputsEXT(meshlet.vertexCount, meshlet.triangleCount);
+
+	mat4 mvp = frameData.proj * frameData.view * PushConstants.render_matrix;
+	for (uint i = gl_LocalInvocationIndex; i < meshlet.vertexCount; i += gl_WorkGroupSize.x) {
+		uint vertexIndex = MeshletIndexBuffer(PushConstants.meshletVertexBuffer).indices[meshlet.vertexOffset + i];
+		Vertex v = loadVertex(PushConstants.vertexBuffer, vertexIndex);
+		gl_MeshVerticesEXT[i].gl_Position = mvp * vec4(v.position, 1.0);
+		outColor[i] = v.color.xyz;
+		outUV[i] = vec2(v.uv_x, v.uv_y);
+		outTextureIndex[i] = PushConstants.textureIndex;
+		outAlphaCutoff[i] = PushConstants.alphaCutoff;
+	}
+	for (uint i = gl_LocalInvocationIndex; i < meshlet.triangleCount; i += gl_WorkGroupSize.x) {
+		uint triangle = MeshletIndexBuffer(PushConstants.meshletTriangleBuffer).indices[meshlet.triangleOffset + i];
+		gl_PrimitiveTriangleIndicesEXT[i] = uvec3(triangle & 0xff, (triangle >> 8) & 0xff, (triangle >> 16) & 0xff);
+	}
+}
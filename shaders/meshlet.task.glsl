@@ -0,0 +1,48 @@
+#version 460
+#extension GL_EXT_mesh_shader : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "meshlets.inc"
+#include "culling.inc"
+
+// Each invocation tests one meshlet of the primitive against the view frustum and its normal cone.
+layout(local_size_x = MESHLETS_PER_TASK) in;
+
+taskPayloadSharedEXT TaskPayload payload;
+shared uint visibleCount;
+
+bool isVisible(Meshlet meshlet)
+{
+	// Facing away: the viewer is inside the cone from which every triangle is seen from behind.
+	if (dot(normalize(meshlet.coneApex - PushConstants.viewerPosition), meshlet.coneAxis) >= meshlet.coneCutoff) {
+		return false;
+	}
+
+	// Outside the frustum: the bounding sphere, in world space, is entirely behind one of its planes.
+	mat4 m = PushConstants.render_matrix;
+	vec3 center = (m * vec4(meshlet.center, 1.0)).xyz;
+	float radius = meshlet.radius * max(length(m[0].xyz), max(length(m[1].xyz), length(m[2].xyz)));
+	return sphereInFrustum(center, radius, frameData.viewProj);
+}
+
+void main()
+{
+	if (gl_LocalInvocationIndex == 0) {
+		visibleCount = 0;
+	}
+	barrier();
+
+	uint index = gl_GlobalInvocationID.x;
+	if (index < PushConstants.meshletCount) {
+		uint meshletIndex = PushConstants.firstMeshlet + index;
+		if (isVisible(MeshletBuffer(PushConstants.meshletBuffer).meshlets[meshletIndex])) {
+			payload.meshletIndices[atomicAdd(visibleCount, 1)] = meshletIndex;
+		}
+	}
+	barrier();
+
+	EmitMeshTasksEXT(visibleCount, 1, 1);
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <numeric>
 
 #include <volk.h>
 
@@ -6,6 +7,7 @@
 #include <timer.h>
 #include "mesh.h"
 #include "mesh_loader.h"
+#include "meshlet_builder.h"
 #include "pipelines.h"
 
 #include <GLFW/glfw3.h>
@@ -44,27 +46,57 @@ void VulkanApp::init()
     initFrameResources();
     initGlobalResources();
     initGlobalDescriptors();
+    initDepthPyramid();
     initMeshPipeline();
+    initDepthReducePipeline();
+    initCullPipeline();
+    if (bUseMeshShaders) {
+        initMeshletPipeline();
+    }
 
 
     initTracy();
 
-    loadGltfFromFile(this, "../../assets/sponza/sponza.gltf", mMesh);
-    mMesh.mBuffers = uploadMeshData(mMesh.mIndices, mMesh.mVertices);
+    // The mesh and all of its textures are recorded into as few upload batches as possible and waited on once.
+    const bool bObj = mScenePath.extension() == ".obj" || mScenePath.extension() == ".OBJ";
+    if (!(bObj ? loadObjFromFile(this, mScenePath, mMesh) : loadGltfFromFile(this, mScenePath, mMesh))) {
+        throw std::runtime_error(fmt::format("Failed to load scene '{}'", mScenePath.string()));
+    }
+    replicateInstances(mMesh, mSceneCopies);
+    mMesh.mBuffers = createMeshBuffers(mMesh.indexData(), mMesh.gpuVertexData());
+
+    if (bUseMeshShaders) {
+        scvk::Timer meshletTimer;
+        meshletTimer.start();
+        scvk::buildMeshlets(mMesh, mThreadPool);
+        const size_t meshletCount = std::max<size_t>(mMesh.mMeshlets.size(), 1);
+        fmt::println("Built {} meshlets in {:.2f} ms: {:.1f} vertices and {:.1f} triangles per meshlet", mMesh.mMeshlets.size(), meshletTimer.total<std::milli>(),
+            float(mMesh.mMeshletVertices.size()) / meshletCount, float(mMesh.mMeshletTriangles.size()) / meshletCount);
+        createMeshletBuffers(mMesh);
+    }
+    createDrawBuffers();
 
     //delete the mesh data on engine shutdown
     mDeletionQueue.push_function([&]() {
         vmaDestroyBuffer(mVmaAllocator, mMesh.mBuffers.mVertexBuffer.mBuffer, mMesh.mBuffers.mVertexBuffer.mAllocation);
         vmaDestroyBuffer(mVmaAllocator, mMesh.mBuffers.mIndexBuffer.mBuffer, mMesh.mBuffers.mIndexBuffer.mAllocation);
+        vmaDestroyBuffer(mVmaAllocator, mMesh.mBuffers.mMeshletBuffer.mBuffer, mMesh.mBuffers.mMeshletBuffer.mAllocation);
+        vmaDestroyBuffer(mVmaAllocator, mDrawDataBuffer.mBuffer, mDrawDataBuffer.mAllocation);
+        for (FrameResources& frame : mFrames) {
+            vmaDestroyBuffer(mVmaAllocator, frame.mDrawCommandBuffer.mBuffer, frame.mDrawCommandBuffer.mAllocation);
+            vmaDestroyBuffer(mVmaAllocator, frame.mVisibleDrawBuffer.mBuffer, frame.mVisibleDrawBuffer.mAllocation);
+            vmaDestroyBuffer(mVmaAllocator, frame.mLateDrawBuffer.mBuffer, frame.mLateDrawBuffer.mAllocation);
+            vmaDestroyBuffer(mVmaAllocator, frame.mCullStatsBuffer.mBuffer, frame.mCullStatsBuffer.mAllocation);
+        }
+        vmaDestroyBuffer(mVmaAllocator, mDrawVisibilityBuffer.mBuffer, mDrawVisibilityBuffer.mAllocation);
         });
 
+    // Submits the batch holding the mesh and glTF textures together with this texture, and waits for all of them.
     mTexture = uploadTexture("../../assets/statue.jpg");
-    mDeletionQueue.push_function([&]() {
-        vkDestroyImageView(mDevice, mTexture.mImage.mView, nullptr);
-        vmaDestroyImage(mVmaAllocator, mTexture.mImage.mImage, mTexture.mImage.mAllocation);
-        vkDestroySampler(mDevice, mTexture.mSampler, nullptr);
-        //scvk::destroyTexture(mDevice, mVmaAllocator, mTexture);
-        });
+
+    if (bBenchmarkRecording) {
+        benchmarkRecording();
+    }
 }
 
 void VulkanApp::initGlfw()
@@ -113,10 +145,20 @@ void VulkanApp::initContext(bool validation)
     VK_CHECK(volkInitialize());
     volkLoadInstance(mInstance);
 
+    // features from Vulkan 1.0.
+    VkPhysicalDeviceFeatures features{};
+    features.multiDrawIndirect = true;      // The scene is drawn with a few indirect calls.
+    features.drawIndirectFirstInstance = true;
+
     // features from Vulkan 1.2.
     VkPhysicalDeviceVulkan12Features features12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
     features12.bufferDeviceAddress = true;
     features12.descriptorIndexing = true;
+    features12.runtimeDescriptorArray = true;                       // Bindless texture array.
+    features12.descriptorBindingPartiallyBound = true;
+    features12.descriptorBindingSampledImageUpdateAfterBind = true;
+    features12.drawIndirectCount = true;                            // Draws that survive GPU culling.
+    features12.samplerFilterMinmax = true;                          // Depth pyramid reduction and occlusion tests.
     features12.scalarBlockLayout = true;
 
     // features from Vulkan 1.3.
@@ -137,6 +179,7 @@ void VulkanApp::initContext(bool validation)
     const auto physDevice_ret = physDeviceSelector
         .set_minimum_version(1, 3)
         .set_surface(mSurface)
+        .set_required_features(features)
         .set_required_features_12(features12)
         .set_required_features_13(features13)
         .add_required_extension(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME)
@@ -150,9 +193,42 @@ void VulkanApp::initContext(bool validation)
     }
     vkb::PhysicalDevice physicalDevice = physDevice_ret.value();
     mPhysicalDevice = physicalDevice.physical_device;
+    mTimestampPeriod = physicalDevice.properties.limits.timestampPeriod;
+    mMaxDrawIndirectCount = physicalDevice.properties.limits.maxDrawIndirectCount;
+
+    // BC textures are optional: without them, textures are uploaded uncompressed and BC encoded KTX2 images are skipped.
+    const VkPhysicalDeviceFeatures bcFeatures{ .textureCompressionBC = VK_TRUE };
+    bSupportsBlockCompression = physicalDevice.enable_features_if_present(bcFeatures);
+    if (!bSupportsBlockCompression && bCompressTextures) {
+        fmt::println("BC texture compression is not supported, uploading textures as RGBA8");
+        bCompressTextures = false;
+    }
+
+    // Mesh shading is optional: without VK_EXT_mesh_shader the scene is drawn with the vertex pipeline.
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+    if (bUseMeshShaders && physicalDevice.is_extension_present(VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 supportedFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &meshShaderFeatures };
+        vkGetPhysicalDeviceFeatures2(mPhysicalDevice, &supportedFeatures);
+    }
+    if (bUseMeshShaders && !(meshShaderFeatures.taskShader && meshShaderFeatures.meshShader)) {
+        fmt::println("VK_EXT_mesh_shader is not supported, drawing with the vertex pipeline");
+        bUseMeshShaders = false;
+    }
+
+    if (bUseMeshShaders) {
+        physicalDevice.enable_extension_if_present(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+        meshShaderFeatures = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+            .taskShader = VK_TRUE,
+            .meshShader = VK_TRUE
+        };
+    }
 
     // create the final vulkan device
     vkb::DeviceBuilder deviceBuilder{ physicalDevice };
+    if (bUseMeshShaders) {
+        deviceBuilder.add_pNext(&meshShaderFeatures);
+    }
     const auto dev_ret = deviceBuilder.build();
     if (!dev_ret) {
         fmt::print("Failed to create Vulkan logical device: {}\n", dev_ret.error().message());
@@ -170,6 +246,27 @@ void VulkanApp::initContext(bool validation)
     mGraphicsQueue = queue_ret.value();
     mGraphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
+    // Prefer a transfer-only queue family for uploads, then any separate family with transfer support.
+    // Without one, uploads share the graphics queue and no ownership transfers are needed.
+    mTransferQueue = mGraphicsQueue;
+    mTransferQueueFamily = mGraphicsQueueFamily;
+    if (bUseTransferQueue) {
+        if (const auto dedicated = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer)) {
+            mTransferQueue = dedicated.value();
+            mTransferQueueFamily = vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+        }
+        else if (const auto separate = vkbDevice.get_queue(vkb::QueueType::transfer)) {
+            mTransferQueue = separate.value();
+            mTransferQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::transfer).value();
+        }
+    }
+    if (mTransferQueueFamily != mGraphicsQueueFamily) {
+        fmt::println("Uploading through transfer queue family {} (graphics family {})", mTransferQueueFamily, mGraphicsQueueFamily);
+    }
+    else {
+        fmt::println("Uploading through the graphics queue");
+    }
+
     // Add destroy functions to deletion queue.
     mDeletionQueue.push_function([&]() {    vkDestroyInstance(mInstance, nullptr);});
     mDeletionQueue.push_function([&]() {    vkDestroySurfaceKHR(mInstance,mSurface,nullptr);});
@@ -237,6 +334,23 @@ void VulkanApp::initFrameResources()
         VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::commandBufferAllocateInfo(mFrames[i].mCommandPool, 1);
         VK_CHECK(vkAllocateCommandBuffers(mDevice, &cmdAllocInfo, &mFrames[i].mMainCommandBuffer));
 
+        /// Allocate the secondary command buffers the static scene is recorded into.
+        VkCommandBufferAllocateInfo sceneAllocInfo = vkinit::commandBufferAllocateInfo(mFrames[i].mCommandPool, static_cast<uint32_t>(mFrames[i].mSceneCommandBuffers.size()));
+        sceneAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        VK_CHECK(vkAllocateCommandBuffers(mDevice, &sceneAllocInfo, mFrames[i].mSceneCommandBuffers.data()));
+
+        /// Create a pool per recording worker, reset as a whole before each use, with the secondary command buffers it records into.
+        const VkCommandPoolCreateInfo workerPoolInfo = vkinit::commandPoolCreateInfo(mGraphicsQueueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        mFrames[i].mWorkerCommandPools.resize(mRecordingPool.size());
+        mFrames[i].mWorkerCommandBuffers.resize(2 * mRecordingPool.size());
+        for (uint32_t worker = 0; worker < mRecordingPool.size(); ++worker) {
+            VK_CHECK(vkCreateCommandPool(mDevice, &workerPoolInfo, nullptr, &mFrames[i].mWorkerCommandPools[worker]));
+            VkCommandBufferAllocateInfo workerAllocInfo = vkinit::commandBufferAllocateInfo(mFrames[i].mWorkerCommandPools[worker], 1);
+            workerAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            VK_CHECK(vkAllocateCommandBuffers(mDevice, &workerAllocInfo, &mFrames[i].mWorkerCommandBuffers[worker]));
+            VK_CHECK(vkAllocateCommandBuffers(mDevice, &workerAllocInfo, &mFrames[i].mWorkerCommandBuffers[mRecordingPool.size() + worker]));
+        }
+
         /// Create sync primitives needed for frame submission.
         VkSemaphoreCreateInfo semCreateInfo = vkinit::semaphoreCreateInfo(0);
         VK_CHECK(vkCreateSemaphore(mDevice, &semCreateInfo, nullptr, &mFrames[i].mImageAvailableSemaphore));
@@ -244,6 +358,14 @@ void VulkanApp::initFrameResources()
         VkFenceCreateInfo fncCreateInfo = vkinit::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
         VK_CHECK(vkCreateFence(mDevice, &fncCreateInfo, nullptr, &mFrames[i].mRenderFence));
 
+        /// Create a query pool for timestamps written at the start and end of the frame's commands.
+        const VkQueryPoolCreateInfo queryPoolInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 2
+        };
+        VK_CHECK(vkCreateQueryPool(mDevice, &queryPoolInfo, nullptr, &mFrames[i].mTimestampQueryPool));
+
         /// Create UBOs for camera matrices.
         VkBufferCreateInfo uboInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
         uboInfo.size = sizeof(FrameData);
@@ -260,19 +382,20 @@ void VulkanApp::initFrameResources()
 
 void VulkanApp::initGlobalResources()
 {
-    // Create a command pool for immediate submits.
-    const VkCommandPoolCreateInfo commandPoolInfo = vkinit::commandPoolCreateInfo(mGraphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-    VK_CHECK(vkCreateCommandPool(mDevice, &commandPoolInfo, nullptr, &mImmCommandPool));
-
-    // Allocate a command buffer for immediate submits.
-    const VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::commandBufferAllocateInfo(mImmCommandPool, 1);
-    VK_CHECK(vkAllocateCommandBuffers(mDevice, &cmdAllocInfo, &mImmCommandBuffer));
-    mDeletionQueue.push_function([=]() {vkDestroyCommandPool(mDevice, mImmCommandPool, nullptr);});
-
-    // Create a fence for immediate submits.
-    const VkFenceCreateInfo fncCreateInfo = vkinit::fenceCreateInfo();
-    VK_CHECK(vkCreateFence(mDevice, &fncCreateInfo, nullptr, &mImmFence));
-    mDeletionQueue.push_function([=]() { vkDestroyFence(mDevice, mImmFence, nullptr); });
+    // All resource uploads are batched through the upload context.
+    mUploader.init(mDevice, mVmaAllocator, mTransferQueue, mTransferQueueFamily, mGraphicsQueue, mGraphicsQueueFamily);
+    mDeletionQueue.push_function([&]() { mUploader.destroy(); });
+
+    // Texture images and samplers are shared between textures, so they are owned by these caches rather than by the textures.
+    mSamplerCache.init(mDevice);
+    mDeletionQueue.push_function([&]() {
+        for (const auto& [hash, cached] : mTextureImages) {
+            vkDestroyImageView(mDevice, cached.mImage.mView, nullptr);
+            vmaDestroyImage(mVmaAllocator, cached.mImage.mImage, cached.mImage.mAllocation);
+        }
+        mTextureImages.clear();
+        mSamplerCache.destroy();
+        });
 }
 
 void VulkanApp::initGlobalDescriptors()
@@ -322,19 +445,49 @@ void VulkanApp::initGlobalDescriptors()
 
 
 
-    // create a descriptor pool that will hold a large number of sets sets with 1 image each
-    std::vector<DescriptorAllocator::PoolSizeRatio> sizes =
-    { 
-        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}
-    };
-    mGlobalDescriptorAllocator.initPool(mDevice, 4000, sizes);
-    mDeletionQueue.push_function([&]() {mGlobalDescriptorAllocator.destroyPool(mDevice);});
+    // All textures live in one array that draws index into, so a single set serves every primitive.
+    // Its size is bounded by what the device allows in an update-after-bind set.
+    VkPhysicalDeviceVulkan12Properties properties12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES };
+    VkPhysicalDeviceProperties2 properties{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &properties12 };
+    vkGetPhysicalDeviceProperties2(mPhysicalDevice, &properties);
+    mMaxBindlessTextures = std::min({ MAX_BINDLESS_TEXTURES,
+        properties12.maxDescriptorSetUpdateAfterBindSampledImages, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        properties12.maxDescriptorSetUpdateAfterBindSamplers, properties12.maxPerStageDescriptorUpdateAfterBindSamplers });
 
-    // Build the descriptor layout.
+    // Partially bound, as entries past the scene's textures are never written. Update-after-bind, so streamed
+    // textures can be written into a set that recorded command buffers have already bound.
+    const VkDescriptorBindingFlags textureBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlags = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindingFlags = &textureBindingFlags
+    };
     builder.clear();
-    builder.addBinding(0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    mMeshDescriptorSetLayout = builder.build(mDevice, VK_SHADER_STAGE_FRAGMENT_BIT);
-    mDeletionQueue.push_function([&]() {vkDestroyDescriptorSetLayout(mDevice, mMeshDescriptorSetLayout, nullptr);});
+    builder.addBinding(0, mMaxBindlessTextures, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    mTextureDescriptorSetLayout = builder.build(mDevice, VK_SHADER_STAGE_FRAGMENT_BIT, &bindingFlags, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+    mDeletionQueue.push_function([&]() {vkDestroyDescriptorSetLayout(mDevice, mTextureDescriptorSetLayout, nullptr);});
+
+    const VkDescriptorPoolSize textureSize = { .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = mMaxBindlessTextures * FRAME_OVERLAP };
+    const VkDescriptorPoolCreateInfo textureInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+        .maxSets = FRAME_OVERLAP,
+        .poolSizeCount = 1,
+        .pPoolSizes = &textureSize
+    };
+    VK_CHECK(vkCreateDescriptorPool(mDevice, &textureInfo, nullptr, &mTextureDescriptorPool));
+    mDeletionQueue.push_function([&]() {vkDestroyDescriptorPool(mDevice, mTextureDescriptorPool, nullptr);});
+
+    for (FrameResources& frame : mFrames)
+    {
+        const VkDescriptorSetAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = mTextureDescriptorPool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &mTextureDescriptorSetLayout
+        };
+        VK_CHECK(vkAllocateDescriptorSets(mDevice, &allocInfo, &frame.mTextureDescriptorSet));
+    }
 
 }
 
@@ -342,12 +495,17 @@ void VulkanApp::initMeshPipeline()
 {
     VkShaderModule triangleVertexShader;
     if (!loadShaderModule("../../shaders/mesh.vert.spv", mDevice, &triangleVertexShader)) {
-        fmt::print("Error when building the fragment shader module");
+        throw std::runtime_error("Failed to load the vertex shader module");
     }
 
     VkShaderModule triangleFragShader;
     if (!loadShaderModule("../../shaders/mesh.frag.spv", mDevice, &triangleFragShader)) {
-        fmt::print("Error when building the vertex shader module");
+        throw std::runtime_error("Failed to load the fragment shader module");
+    }
+
+    VkShaderModule depthOnlyVertexShader;
+    if (!loadShaderModule("../../shaders/depth_only.vert.spv", mDevice, &depthOnlyVertexShader)) {
+        throw std::runtime_error("Failed to load the depth only vertex shader module");
     }
     std::vector<VkPipelineShaderStageCreateInfo> shaders;
     shaders.resize(2);
@@ -356,13 +514,31 @@ void VulkanApp::initMeshPipeline()
     shaders[0].module = triangleVertexShader;
     shaders[0].pName = "main";
 
+    // The vertex shader decodes the vertex layout selected by its VERTEX_FORMAT constant.
+    const VkSpecializationMapEntry vertexFormatEntry = { .constantID = 0, .offset = 0, .size = sizeof(VertexFormat) };
+    const VkSpecializationInfo vertexSpecialization = {
+        .mapEntryCount = 1,
+        .pMapEntries = &vertexFormatEntry,
+        .dataSize = sizeof(VertexFormat),
+        .pData = &mVertexFormat
+    };
+    shaders[0].pSpecializationInfo = &vertexSpecialization;
+
     shaders[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaders[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     shaders[1].module = triangleFragShader;
     shaders[1].pName = "main";
 
+    // The fragment shader only discards below the alpha cutoff when ALPHA_TEST is set, for the alpha masked pipelines.
+    const VkSpecializationMapEntry alphaTestEntry = { .constantID = 0, .offset = 0, .size = sizeof(VkBool32) };
+    const std::array<VkBool32, 2> alphaTest = { VK_FALSE, VK_TRUE };
+    const std::array<VkSpecializationInfo, 2> fragmentSpecializations = {
+        VkSpecializationInfo{ .mapEntryCount = 1, .pMapEntries = &alphaTestEntry, .dataSize = sizeof(VkBool32), .pData = &alphaTest[0] },
+        VkSpecializationInfo{ .mapEntryCount = 1, .pMapEntries = &alphaTestEntry, .dataSize = sizeof(VkBool32), .pData = &alphaTest[1] }
+    };
+
     // The pipeline layout defines an interface for shader resources used by the pipeline.
-    const std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { mFrameDataDescriptorSetLayout, mMeshDescriptorSetLayout };
+    const std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { mFrameDataDescriptorSetLayout, mTextureDescriptorSetLayout };
     const VkPushConstantRange bufferRange = { .stageFlags = VK_SHADER_STAGE_VERTEX_BIT, .offset = 0, .size = sizeof(GPUDrawPushConstants) };
     const VkPipelineLayoutCreateInfo pipeline_layout_info = { 
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -445,11 +621,30 @@ void VulkanApp::initMeshPipeline()
     rInfo.depthAttachmentFormat     = mDepthImage.mFormat;
     pipelineInfo.pNext = &rInfo;
 
-    if (VkResult err = vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineInfo,
-        nullptr, &mMeshPipeline)
-        )
+    // A pipeline per pass for opaque and for alpha masked draws. The depth pre-pass of opaque draws only needs positions
+    // and no fragment shader; alpha masked draws run the fragment shader in both passes, so they discard the same fragments.
+    const VkColorComponentFlags colorWriteMask = colorBlendAttachment.colorWriteMask;
+    for (uint32_t pass = 0; pass < mMeshPipelines.size(); ++pass)
     {
-        fmt::println("failed to create pipeline, {}", string_VkResult(err));
+        for (uint32_t masked = 0; masked < 2; ++masked)
+        {
+            const bool bDepthOnly = static_cast<MeshPass>(pass) == MeshPass::DepthPrepass;
+            const bool bEqualDepth = static_cast<MeshPass>(pass) == MeshPass::EqualDepth;
+            shaders[0].module = bDepthOnly && !masked ? depthOnlyVertexShader : triangleVertexShader;
+            shaders[1].pSpecializationInfo = &fragmentSpecializations[masked];
+            pipelineInfo.stageCount = bDepthOnly && !masked ? 1 : uint32_t(shaders.size());
+            // The shading pass after a pre-pass only shades the fragments that ended up in front, and writes no depth.
+            depthStencil.depthWriteEnable = bEqualDepth ? VK_FALSE : VK_TRUE;
+            depthStencil.depthCompareOp = bEqualDepth ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS_OR_EQUAL;
+            colorBlendAttachment.colorWriteMask = bDepthOnly ? 0 : colorWriteMask;
+
+            if (VkResult err = vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineInfo,
+                nullptr, &mMeshPipelines[pass][masked])
+                )
+            {
+                fmt::println("failed to create pipeline, {}", string_VkResult(err));
+            }
+        }
     }
 
     //PipelineBuilder pipelineBuilder;
@@ -472,43 +667,415 @@ void VulkanApp::initMeshPipeline()
     //clean structures
     vkDestroyShaderModule(mDevice, triangleFragShader, nullptr);
     vkDestroyShaderModule(mDevice, triangleVertexShader, nullptr);
+    vkDestroyShaderModule(mDevice, depthOnlyVertexShader, nullptr);
 
     mDeletionQueue.push_function([&]() {
         vkDestroyPipelineLayout(mDevice, mMeshPipelineLayout, nullptr);
-        vkDestroyPipeline(mDevice, mMeshPipeline, nullptr);
+        for (const auto& passPipelines : mMeshPipelines) {
+            for (const VkPipeline pipeline : passPipelines) {
+                vkDestroyPipeline(mDevice, pipeline, nullptr);
+            }
+        }
         });
 }
 
+// One compute pipeline per CullPass. Each tests every draw against the frustum and, in the late pass, the depth
+// pyramid, and compacts the indirect commands of the visible draws for the draw count call.
+void VulkanApp::initCullPipeline()
+{
+    VkShaderModule cullShader;
+    if (!loadShaderModule("../../shaders/cull.comp.spv", mDevice, &cullShader)) {
+        throw std::runtime_error("Failed to load the cull shader module");
+    }
 
+    // Reads the frustum from the frame data and, in the late pass, the depth pyramid; everything else is reached through device addresses.
+    const std::array<VkDescriptorSetLayout, 2> descriptorSetLayouts = { mFrameDataDescriptorSetLayout, mDepthPyramidDescriptorSetLayout };
+    const VkPushConstantRange pushConstantRange = { .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(CullPushConstants) };
+    const VkPipelineLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size()),
+        .pSetLayouts = descriptorSetLayouts.data(),
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+    VK_CHECK(vkCreatePipelineLayout(mDevice, &layoutInfo, nullptr, &mCullPipelineLayout));
 
-void VulkanApp::run()
-{
+    // One pipeline per pass, selected by the CULL_PASS constant.
+    for (uint32_t pass = 0; pass < mCullPipelines.size(); ++pass)
+    {
+        const VkSpecializationMapEntry passEntry = { .constantID = 0, .offset = 0, .size = sizeof(uint32_t) };
+        const VkSpecializationInfo passSpecialization = {
+            .mapEntryCount = 1,
+            .pMapEntries = &passEntry,
+            .dataSize = sizeof(uint32_t),
+            .pData = &pass
+        };
+        VkComputePipelineCreateInfo pipelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, cullShader, "main"),
+            .layout = mCullPipelineLayout
+        };
+        pipelineInfo.stage.pSpecializationInfo = &passSpecialization;
+        if (VkResult err = vkCreateComputePipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &mCullPipelines[pass])) {
+            fmt::println("failed to create cull pipeline, {}", string_VkResult(err));
+        }
+    }
+    vkDestroyShaderModule(mDevice, cullShader, nullptr);
+
+    mDeletionQueue.push_function([&]() {
+        vkDestroyPipelineLayout(mDevice, mCullPipelineLayout, nullptr);
+        for (VkPipeline pipeline : mCullPipelines) {
+            vkDestroyPipeline(mDevice, pipeline, nullptr);
+        }
+        });
+}
 
-    //Allocate a descriptor set for each primitive.
-    for (int i = 0; i < mMesh.mPrimitives.size(); ++i)
+// Creates the depth pyramid for the swapchain's depth buffer, with a view and a reduction descriptor set per level.
+// Level 0 is the largest power of two no bigger than the depth buffer, so every further level exactly halves the one above.
+void VulkanApp::initDepthPyramid()
+{
+    const auto previousPow2 = [](uint32_t v) { uint32_t r = 1; while (r * 2 <= v) { r *= 2; } return r; };
+    const uint32_t width = previousPow2(mDepthImage.mExtents.width);
+    const uint32_t height = previousPow2(mDepthImage.mExtents.height);
+
+    DepthPyramid& pyramid = mDepthPyramid;
+    pyramid.mLevelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+    pyramid.mImage.mFormat = VK_FORMAT_R32_SFLOAT;
+    pyramid.mImage.mExtents = { width, height, 1 };
+
+    const VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = pyramid.mImage.mFormat,
+        .extent = pyramid.mImage.mExtents,
+        .mipLevels = pyramid.mLevelCount,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    const VmaAllocationCreateInfo allocInfo = { .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT };
+    VK_CHECK(vmaCreateImage(mVmaAllocator, &imageInfo, &allocInfo, &pyramid.mImage.mImage, &pyramid.mImage.mAllocation, nullptr));
+
+    VkImageViewCreateInfo viewInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = pyramid.mImage.mImage,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = pyramid.mImage.mFormat,
+        .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.mLevelCount, 0, 1 }
+    };
+    VK_CHECK(vkCreateImageView(mDevice, &viewInfo, nullptr, &pyramid.mImage.mView));
+    pyramid.mLevelViews.resize(pyramid.mLevelCount);
+    for (uint32_t level = 0; level < pyramid.mLevelCount; ++level)
     {
-        mMeshDescriptorSets.emplace_back(mGlobalDescriptorAllocator.allocate(mDevice, mMeshDescriptorSetLayout));
-        const auto tex = mMesh.mPrimitives[i].textureID != UINT32_MAX ? mMesh.mPrimitives[i].textureID : 0;
-        const VkDescriptorImageInfo textureDescriptor = {
-            .sampler = mTexture.mSampler,
-            .imageView = mMesh.mTextures[tex].mImage.mView,
-            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.levelCount = 1;
+        VK_CHECK(vkCreateImageView(mDevice, &viewInfo, nullptr, &pyramid.mLevelViews[level]));
+    }
+
+    // The occlusion test's bilinear fetches return the farthest of the four texels rather than their average. Clamped,
+    // so texels past the edge of the pyramid never count.
+    VkSamplerReductionModeCreateInfo reductionInfo = { .sType = VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO, .reductionMode = VK_SAMPLER_REDUCTION_MODE_MAX };
+    VkSamplerCreateInfo samplerInfo = vkinit::samplerCreateInfo(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+    samplerInfo.pNext = &reductionInfo;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    VK_CHECK(vkCreateSampler(mDevice, &samplerInfo, nullptr, &mDepthReductionSampler));
+
+    DescriptorLayoutBuilder builder;
+    builder.addBinding(0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    builder.addBinding(1, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    mDepthReduceDescriptorSetLayout = builder.build(mDevice, VK_SHADER_STAGE_COMPUTE_BIT);
+    builder.clear();
+    builder.addBinding(0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    mDepthPyramidDescriptorSetLayout = builder.build(mDevice, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    const std::array<VkDescriptorPoolSize, 2> poolSizes = { {
+        {.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = pyramid.mLevelCount },
+        {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = pyramid.mLevelCount + 1 }
+    } };
+    const VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = pyramid.mLevelCount + 1,
+        .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+        .pPoolSizes = poolSizes.data()
+    };
+    VK_CHECK(vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &mDepthPyramidDescriptorPool));
+
+    // The pyramid stays in GENERAL, written as storage and sampled. The depth buffer is sampled in SHADER_READ_ONLY_OPTIMAL.
+    const auto allocateSet = [&](VkDescriptorSetLayout layout) {
+        const VkDescriptorSetAllocateInfo setInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = mDepthPyramidDescriptorPool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &layout
         };
-        const VkWriteDescriptorSet imageWrite = {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = mMeshDescriptorSets[i],
-            .dstBinding = 0,
-            .dstArrayElement = 0,
-            .descriptorCount = 1, // Remember that a single descriptor can refer to an array of resources.
-            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .pImageInfo = &textureDescriptor
+        VkDescriptorSet set;
+        VK_CHECK(vkAllocateDescriptorSets(mDevice, &setInfo, &set));
+        return set;
+    };
+    pyramid.mReduceSets.resize(pyramid.mLevelCount);
+    for (uint32_t level = 0; level < pyramid.mLevelCount; ++level)
+    {
+        pyramid.mReduceSets[level] = allocateSet(mDepthReduceDescriptorSetLayout);
+        const VkDescriptorImageInfo outputInfo = { .imageView = pyramid.mLevelViews[level], .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+        const VkDescriptorImageInfo inputInfo = level == 0
+            ? VkDescriptorImageInfo{ .sampler = mDepthReductionSampler, .imageView = mDepthImage.mView, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }
+            : VkDescriptorImageInfo{ .sampler = mDepthReductionSampler, .imageView = pyramid.mLevelViews[level - 1], .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+        const std::array<VkWriteDescriptorSet, 2> writes = { {
+            {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = pyramid.mReduceSets[level], .dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .pImageInfo = &outputInfo },
+            {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = pyramid.mReduceSets[level], .dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &inputInfo }
+        } };
+        vkUpdateDescriptorSets(mDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+    pyramid.mCullSet = allocateSet(mDepthPyramidDescriptorSetLayout);
+    const VkDescriptorImageInfo pyramidInfo = { .sampler = mDepthReductionSampler, .imageView = pyramid.mImage.mView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+    const VkWriteDescriptorSet pyramidWrite = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = pyramid.mCullSet,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &pyramidInfo
+    };
+    vkUpdateDescriptorSets(mDevice, 1, &pyramidWrite, 0, nullptr);
+
+    // Every level is rewritten before it is read, so the transition discards nothing.
+    mUploader.record([image = pyramid.mImage.mImage, levelCount = pyramid.mLevelCount](VkCommandBuffer cmd) {
+        const VkImageMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .image = image,
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 }
         };
-        vkUpdateDescriptorSets(mDevice, 1, &imageWrite, 0, nullptr);
+        const VkDependencyInfo dependency = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier };
+        vkCmdPipelineBarrier2(cmd, &dependency);
+        });
+
+    mDeletionQueue.push_function([&]() {
+        vkDestroyDescriptorPool(mDevice, mDepthPyramidDescriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(mDevice, mDepthPyramidDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(mDevice, mDepthReduceDescriptorSetLayout, nullptr);
+        vkDestroySampler(mDevice, mDepthReductionSampler, nullptr);
+        for (VkImageView view : mDepthPyramid.mLevelViews) {
+            vkDestroyImageView(mDevice, view, nullptr);
+        }
+        vkDestroyImageView(mDevice, mDepthPyramid.mImage.mView, nullptr);
+        vmaDestroyImage(mVmaAllocator, mDepthPyramid.mImage.mImage, mDepthPyramid.mImage.mAllocation);
+        });
+}
+
+void VulkanApp::initDepthReducePipeline()
+{
+    VkShaderModule reduceShader;
+    if (!loadShaderModule("../../shaders/depth_reduce.comp.spv", mDevice, &reduceShader)) {
+        throw std::runtime_error("Failed to load the depth reduce shader module");
+    }
+
+    const VkPushConstantRange pushConstantRange = { .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(DepthReducePushConstants) };
+    const VkPipelineLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &mDepthReduceDescriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+    VK_CHECK(vkCreatePipelineLayout(mDevice, &layoutInfo, nullptr, &mDepthReducePipelineLayout));
+
+    const VkComputePipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, reduceShader, "main"),
+        .layout = mDepthReducePipelineLayout
+    };
+    if (VkResult err = vkCreateComputePipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &mDepthReducePipeline)) {
+        fmt::println("failed to create depth reduce pipeline, {}", string_VkResult(err));
+    }
+    vkDestroyShaderModule(mDevice, reduceShader, nullptr);
+
+    mDeletionQueue.push_function([&]() {
+        vkDestroyPipelineLayout(mDevice, mDepthReducePipelineLayout, nullptr);
+        vkDestroyPipeline(mDevice, mDepthReducePipeline, nullptr);
+        });
+}
+
+// Task shaders cull the meshlets of a primitive by frustum and normal cone, and mesh shaders output the survivors.
+// Same descriptor sets, fragment shader and fixed-function state as the mesh pipeline.
+void VulkanApp::initMeshletPipeline()
+{
+    // The shaders are built by the Shaders target. A missing one leaves nothing to create the pipelines from.
+    VkShaderModule taskShader;
+    if (!loadShaderModule("../../shaders/meshlet.task.spv", mDevice, &taskShader)) {
+        throw std::runtime_error("Failed to load the task shader module");
+    }
+    VkShaderModule meshShader;
+    if (!loadShaderModule("../../shaders/meshlet.mesh.spv", mDevice, &meshShader)) {
+        throw std::runtime_error("Failed to load the mesh shader module");
+    }
+    VkShaderModule fragmentShader;
+    if (!loadShaderModule("../../shaders/mesh.frag.spv", mDevice, &fragmentShader)) {
+        throw std::runtime_error("Failed to load the fragment shader module");
+    }
+
+    // The mesh shader decodes vertices like the vertex shader, through the VERTEX_FORMAT constant.
+    const VkSpecializationMapEntry vertexFormatEntry = { .constantID = 0, .offset = 0, .size = sizeof(VertexFormat) };
+    const VkSpecializationInfo vertexSpecialization = {
+        .mapEntryCount = 1,
+        .pMapEntries = &vertexFormatEntry,
+        .dataSize = sizeof(VertexFormat),
+        .pData = &mVertexFormat
+    };
+    std::array<VkPipelineShaderStageCreateInfo, 3> shaders = {
+        vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_TASK_BIT_EXT, taskShader, "main"),
+        vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_MESH_BIT_EXT, meshShader, "main"),
+        vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader, "main")
+    };
+    shaders[1].pSpecializationInfo = &vertexSpecialization;
+
+    const std::array<VkDescriptorSetLayout, 2> descriptorSetLayouts = { mFrameDataDescriptorSetLayout, mTextureDescriptorSetLayout };
+    const VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT,
+        .offset = 0,
+        .size = sizeof(MeshletDrawPushConstants)
+    };
+    const VkPipelineLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size()),
+        .pSetLayouts = descriptorSetLayouts.data(),
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+    VK_CHECK(vkCreatePipelineLayout(mDevice, &layoutInfo, nullptr, &mMeshletPipelineLayout));
+
+    // Mesh pipelines have no vertex input or input assembly state.
+    const VkPipelineViewportStateCreateInfo viewportState = { .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO, .viewportCount = 1, .scissorCount = 1 };
+    const VkPipelineRasterizationStateCreateInfo rasterizer = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE,
+        .lineWidth = 1.f
+    };
+    const VkPipelineMultisampleStateCreateInfo multisampling = { .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO, .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT };
+    VkPipelineDepthStencilStateCreateInfo depthStencil = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+        .maxDepthBounds = 1.f
+    };
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+        .blendEnable = VK_FALSE,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+    };
+    const VkPipelineColorBlendStateCreateInfo colorBlending = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .attachmentCount = 1,
+        .pAttachments = &colorBlendAttachment
+    };
+    const std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    const VkPipelineDynamicStateCreateInfo dynamicState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = static_cast<uint32_t>(dynamicStates.size()),
+        .pDynamicStates = dynamicStates.data()
+    };
+    const VkPipelineRenderingCreateInfo renderingInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &mSwapchainImageFormat,
+        .depthAttachmentFormat = mDepthImage.mFormat
+    };
+    VkGraphicsPipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &renderingInfo,
+        .stageCount = static_cast<uint32_t>(shaders.size()),
+        .pStages = shaders.data(),
+        .pViewportState = &viewportState,
+        .pRasterizationState = &rasterizer,
+        .pMultisampleState = &multisampling,
+        .pDepthStencilState = &depthStencil,
+        .pColorBlendState = &colorBlending,
+        .pDynamicState = &dynamicState,
+        .layout = mMeshletPipelineLayout
+    };
+
+    // The same passes and draw classes as the mesh pipelines. The depth pre-pass of opaque draws drops the fragment
+    // shader; alpha masked draws run it in both passes, so they discard the same fragments.
+    const VkSpecializationMapEntry alphaTestEntry = { .constantID = 0, .offset = 0, .size = sizeof(VkBool32) };
+    const std::array<VkBool32, 2> alphaTest = { VK_FALSE, VK_TRUE };
+    const std::array<VkSpecializationInfo, 2> fragmentSpecializations = {
+        VkSpecializationInfo{ .mapEntryCount = 1, .pMapEntries = &alphaTestEntry, .dataSize = sizeof(VkBool32), .pData = &alphaTest[0] },
+        VkSpecializationInfo{ .mapEntryCount = 1, .pMapEntries = &alphaTestEntry, .dataSize = sizeof(VkBool32), .pData = &alphaTest[1] }
+    };
+    const VkColorComponentFlags colorWriteMask = colorBlendAttachment.colorWriteMask;
+    for (uint32_t pass = 0; pass < mMeshletPipelines.size(); ++pass)
+    {
+        for (uint32_t masked = 0; masked < 2; ++masked)
+        {
+            const bool bDepthOnly = static_cast<MeshPass>(pass) == MeshPass::DepthPrepass;
+            const bool bEqualDepth = static_cast<MeshPass>(pass) == MeshPass::EqualDepth;
+            shaders[2].pSpecializationInfo = &fragmentSpecializations[masked];
+            pipelineInfo.stageCount = bDepthOnly && !masked ? 2 : static_cast<uint32_t>(shaders.size());
+            depthStencil.depthWriteEnable = bEqualDepth ? VK_FALSE : VK_TRUE;
+            depthStencil.depthCompareOp = bEqualDepth ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS_OR_EQUAL;
+            colorBlendAttachment.colorWriteMask = bDepthOnly ? 0 : colorWriteMask;
+            if (VkResult err = vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &mMeshletPipelines[pass][masked])) {
+                fmt::println("failed to create meshlet pipeline, {}", string_VkResult(err));
+            }
+        }
+    }
+
+    vkDestroyShaderModule(mDevice, fragmentShader, nullptr);
+    vkDestroyShaderModule(mDevice, meshShader, nullptr);
+    vkDestroyShaderModule(mDevice, taskShader, nullptr);
+
+    mDeletionQueue.push_function([&]() {
+        vkDestroyPipelineLayout(mDevice, mMeshletPipelineLayout, nullptr);
+        for (const auto& passPipelines : mMeshletPipelines) {
+            for (const VkPipeline pipeline : passPipelines) {
+                vkDestroyPipeline(mDevice, pipeline, nullptr);
+            }
+        }
+        });
+}
+
+
+
+void VulkanApp::run()
+{
+
+    // Write every texture into each frame's texture array. Primitives select theirs with a push constant.
+    if (mMesh.mTextures.size() > mMaxBindlessTextures) {
+        throw std::runtime_error(fmt::format("The scene has {} textures, the device supports {}", mMesh.mTextures.size(), mMaxBindlessTextures));
+    }
+    for (FrameResources& frame : mFrames)
+    {
+        for (uint32_t i = 0; i < mMesh.mTextures.size(); ++i)
+        {
+            writeTextureDescriptor(frame.mTextureDescriptorSet, i, mMesh.mTextures[i]);
+        }
+    }
+
+    // With streaming, the statistics are only meaningful once every texture has arrived.
+    bool bTexturesStreaming = mTextureStreamer.isStreaming();
+    if (!bTexturesStreaming) {
+        printTextureStats();
     }
 
     static auto lastFrameTime = std::chrono::high_resolution_clock::now();
     static auto elapsed = 0.f;
     static auto elapsedFrames = 0u;
+    static auto elapsedGpuMs = 0.f;
+    static auto elapsedGpuFrames = 0u;
+    static auto lastFrameTriangles = uint64_t(0);
+    static auto lastFrameBinds = scvk::DrawBindCounts{};
+    static auto elapsedDrawCpuMs = 0.f;
+    static auto lastEarlyDraws = VisibleDrawHeader{};
+    static auto lastLateDraws = VisibleDrawHeader{};
     // Main loop
     while (!glfwWindowShouldClose(mWindow)) {
 
@@ -520,10 +1087,25 @@ void VulkanApp::run()
         ++elapsedFrames;
         if (elapsed >= 1.0f) {
             auto fps = elapsedFrames/ elapsed;
+            auto gpuMs = elapsedGpuFrames > 0 ? elapsedGpuMs / elapsedGpuFrames : 0.f;
+            auto drawCpuMs = elapsedDrawCpuMs / elapsedFrames;
             // Reset counters
             elapsedFrames = 0;
             elapsed = 0.0f;
-            glfwSetWindowTitle(mWindow, std::to_string(fps).c_str());
+            elapsedGpuFrames = 0;
+            elapsedGpuMs = 0.f;
+            elapsedDrawCpuMs = 0.f;
+            // Draws that failed the frustum test are the ones neither drawn nor occluded.
+            const uint32_t earlyDraws = lastEarlyDraws.mCount + lastEarlyDraws.mMaskedCount;
+            const uint32_t lateDraws = lastLateDraws.mCount + lastLateDraws.mMaskedCount;
+            const std::string occlusionStats = bOcclusionCulling
+                ? fmt::format(" | visible {} early + {} late, occluded {}, outside frustum {}", earlyDraws, lateDraws, lastLateDraws.mOccludedCount,
+                    mDraws.size() - earlyDraws - lateDraws - lastLateDraws.mOccludedCount)
+                : std::string();
+            const std::string bindStats = fmt::format(" | binds: {} pipeline, {} descriptor sets, {} material, {} transform",
+                lastFrameBinds.mPipelineBinds, lastFrameBinds.mDescriptorSetBinds, lastFrameBinds.mMaterialChanges, lastFrameBinds.mTransformChanges);
+            glfwSetWindowTitle(mWindow, fmt::format("{:.1f} fps | GPU {:.3f} ms{} | {:.2f} M triangles | {} draws, CPU {:.3f} ms{}{}",
+                fps, gpuMs, bDepthPrepass ? " (depth pre-pass)" : "", lastFrameTriangles * 1e-6, mDraws.size(), drawCpuMs, bindStats, occlusionStats).c_str());
         }
         
         lastFrameTime = currentFrameTime;
@@ -551,11 +1133,53 @@ void VulkanApp::run()
             forward = glm::rotate(glm::mat4(1.f), glm::radians(1.f), { 0.f,1.f,0.f }) * glm::vec4(forward, 0.f);
         if (glfwGetKey(mWindow, GLFW_KEY_E) == GLFW_PRESS)
             forward = glm::rotate(glm::mat4(1.f), glm::radians(-1.f), { 0.f,1.f,0.f }) * glm::vec4(forward, 0.f);
+
+        // P toggles the depth pre-pass once per press, to compare the GPU time of both modes on the same view.
+        const bool bPrepassKey = glfwGetKey(mWindow, GLFW_KEY_P) == GLFW_PRESS;
+        if (bPrepassKey && !bPrepassKeyDown) {
+            bDepthPrepass = !bDepthPrepass;
+            invalidateSceneCommands();
+            fmt::println("Depth pre-pass {}", bDepthPrepass ? "on" : "off");
+        }
+        bPrepassKeyDown = bPrepassKey;
     
         // Wait for the other frame to finish by waiting on it's fence.
         VK_CHECK(vkWaitForFences(mDevice, 1, &getCurrentFrame().mRenderFence, VK_TRUE, UINT64_MAX));
         VK_CHECK(vkResetFences(mDevice, 1, &getCurrentFrame().mRenderFence));
 
+        // Swap streamed textures in for their placeholders. Only this frame's texture array is idle, so the
+        // other frame's array is rewritten once its own fence has been waited on.
+        for (const uint32_t textureIndex : mTextureStreamer.update(this, mMesh.mTextures, mStreamingBudgetBytes)) {
+            for (FrameResources& frame : mFrames) {
+                frame.mStaleTextures.push_back(textureIndex);
+            }
+        }
+        if (!getCurrentFrame().mStaleTextures.empty()) {
+            FrameResources& frame = getCurrentFrame();
+            for (const uint32_t textureIndex : frame.mStaleTextures) {
+                writeTextureDescriptor(frame.mTextureDescriptorSet, textureIndex, mMesh.mTextures[textureIndex]);
+            }
+            frame.mStaleTextures.clear();
+        }
+        if (bTexturesStreaming && !mTextureStreamer.isStreaming()) {
+            bTexturesStreaming = false;
+            printTextureStats();
+        }
+
+        // The frame's previous submission has finished, so its timestamps and culling counts can be read without waiting.
+        if (mFrameNumber >= FRAME_OVERLAP) {
+            uint64_t timestamps[2];
+            if (vkGetQueryPoolResults(mDevice, getCurrentFrame().mTimestampQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+                elapsedGpuMs += float(timestamps[1] - timestamps[0]) * mTimestampPeriod * 1e-6f;
+                ++elapsedGpuFrames;
+            }
+            if (bOcclusionCulling) {
+                const auto* headers = static_cast<const VisibleDrawHeader*>(getCurrentFrame().mCullStatsBuffer.mAllocInfo.pMappedData);
+                lastEarlyDraws = headers[0];
+                lastLateDraws = headers[1];
+            }
+        }
+
         /// Acquire an image to render to from the swap chain.
         uint32_t swapchainImageIndex;
         vkAcquireNextImageKHR(mDevice, mSwapchain, UINT64_MAX, getCurrentFrame().mImageAvailableSemaphore, nullptr, &swapchainImageIndex);
@@ -563,7 +1187,7 @@ void VulkanApp::run()
         // Update the uniform buffer for the next frame
         //auto view = glm::translate(glm::mat4(1.f), { 0.f, 0.f, -2.f });
         auto view       = glm::lookAt(camPos, camPos + forward/*glm::vec3(0.f)*/, { 0.f,1.f,0.f });
-        auto proj       = glm::perspective(glm::radians(70.f), float(mSwapchainExtent.width) / mSwapchainExtent.height, 0.01f, 1000.f);
+        auto proj       = glm::perspective(glm::radians(70.f), float(mSwapchainExtent.width) / mSwapchainExtent.height, NEAR_PLANE, FAR_PLANE);
         proj[1][1]      *= -1;
         const auto viewProj =  proj * view;
         FrameData frameData = { .view = view, .proj = proj, .viewProj = viewProj};
@@ -577,6 +1201,8 @@ void VulkanApp::run()
         VkCommandBufferBeginInfo cmdBeginInfo = vkinit::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
         VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
         {
+            vkCmdResetQueryPool(cmd, getCurrentFrame().mTimestampQueryPool, 0, 2);
+            vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, getCurrentFrame().mTimestampQueryPool, 0);
 
             //TODO: Fix masks.
             // Transition swapchain color and depth images layouts for output.
@@ -613,75 +1239,268 @@ void VulkanApp::run()
             vkCmdPipelineBarrier2(cmd, &depInfo);
             
 
-            // Define the attachments to render to.
-            const VkRenderingAttachmentInfo colorAttachment = {
-                .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
-                .imageView = mSwapchainImageViews[swapchainImageIndex],
-                .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-                .storeOp = VK_ATTACHMENT_STORE_OP_STORE
-            };
-            const VkRenderingAttachmentInfo depthAttachment = {
-                .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
-                .imageView = mDepthImage.mView,
-                .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-                .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                .clearValue = {.depthStencil = {.depth = 1.f}}
-            };
-            const VkRenderingInfo renderInfo = {
-                .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
-                .renderArea = VkRect2D{ VkOffset2D { 0, 0 }, mSwapchainExtent },
-                .layerCount = 1,
-                .colorAttachmentCount = 1,
-                .pColorAttachments = &colorAttachment,
-                .pDepthAttachment = &depthAttachment
+            // Triangles submitted this frame, before any GPU culling, the state set to draw them, and the CPU time spent submitting them.
+            uint64_t frameTriangles = 0;
+            scvk::DrawBindCounts frameBinds;
+            scvk::Timer drawTimer;
+            drawTimer.start();
+
+            // Pixels covered by one unit at unit distance, to project level of detail errors on screen.
+            const float projectionScale = std::abs(proj[1][1]) * 0.5f * static_cast<float>(mSwapchainExtent.height);
+
+            const bool bIndirectScene = !bUseMeshShaders && bUseIndirectDraws;
+
+            // GPU culling reads the draw commands by draw index and compacts the visible ones in whatever order its
+            // invocations finish, so only draws the CPU lays out itself are sorted.
+            const bool bSortScene = bSortDraws && !(bIndirectScene && bGpuCulling);
+            if (bSortScene) {
+                sortDraws(camPos, FAR_PLANE);
+            }
+            if (bIndirectScene) {
+                // The commands change with the level of detail and the draw order; without either they were written at load time.
+                frameTriangles = mMesh.mPrimitiveLods.empty() && !bSortScene ? mFullDetailTriangles : writeDrawCommands(getCurrentFrame(), camPos, projectionScale);
+            }
+
+            // Appends the commands of the draws that pass a cull pass to list, and makes them available to indirect draws.
+            const auto cullDraws = [&](CullPass pass, VkDeviceAddress listAddress) {
+                const FrameResources& frame = getCurrentFrame();
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mCullPipelines[static_cast<uint32_t>(pass)]);
+                const std::array<VkDescriptorSet, 2> cullSets = { frame.mFrameDataDescriptorSet, mDepthPyramid.mCullSet };
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mCullPipelineLayout, 0, static_cast<uint32_t>(cullSets.size()), cullSets.data(), 0, nullptr);
+                const CullPushConstants cullConstants = {
+                    .mDrawDataAddress = mDrawDataAddress,
+                    .mDrawCommandAddress = frame.mDrawCommandAddress,
+                    .mVisibleDrawAddress = listAddress,
+                    .mDrawCount = static_cast<uint32_t>(mDraws.size()),
+                    .mVisibilityAddress = mDrawVisibilityAddress,
+                    .mPyramidSize = glm::vec2(mDepthPyramid.mImage.mExtents.width, mDepthPyramid.mImage.mExtents.height),
+                    .mZNear = NEAR_PLANE,
+                    .mOpaqueDrawCount = mOpaqueDrawCount
+                };
+                vkCmdPushConstants(cmd, mCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &cullConstants);
+                vkCmdDispatch(cmd, (cullConstants.mDrawCount + 63) / 64, 1, 1);
+
+                const VkMemoryBarrier2 cullBarrier = {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+                    .dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT
+                };
+                const VkDependencyInfo cullDependency = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1, .pMemoryBarriers = &cullBarrier };
+                vkCmdPipelineBarrier2(cmd, &cullDependency);
             };
-            // Begin render pass instance.
-            vkCmdBeginRendering(cmd, &renderInfo);
-
-            // Update viewport state.
-            const VkViewport viewport = {
-                .x = 0.f, .y = 0.f,
-                .width = static_cast<float>(mSwapchainExtent.width), .height = static_cast<float>(mSwapchainExtent.height),
-                .minDepth = 0.f, .maxDepth = 1.f };
-            vkCmdSetViewport(cmd, 0, 1, &viewport);
-            // Update scissor state.
-            const VkRect2D scissor = {
-                .offset = {.x = 0, .y = 0},
-                .extent = {.width = mSwapchainExtent.width, .height = mSwapchainExtent.height}, };
-            vkCmdSetScissor(cmd, 0, 1, &scissor);
-
-            // Bind mesh pipeline
-            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mMeshPipeline);
-
-            // Bind descriptors
-            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mMeshPipelineLayout, 0, 1, &getCurrentFrame().mFrameDataDescriptorSet, 0, nullptr); 
-            //vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mMeshPipelineLayout, 1, 1, &mMeshDescriptorSets[0], 0, nullptr);
-
-            // Bind mesh index buffer.
-            vkCmdBindIndexBuffer(cmd, mMesh.mBuffers.mIndexBuffer.mBuffer, 0, VK_INDEX_TYPE_UINT32);
-            
-            for (int i =0; i <mMesh.mPrimitives.size(); ++i)
-            {
-                auto& prim = mMesh.mPrimitives[i];
 
-                // Push push constants.
-                const glm::mat4 model = glm::mat4(1.f);
-                GPUDrawPushConstants push_constants = {
-                    .mWorldMatrix = glm::scale(model, glm::vec3(0.1f)),
-                    .mVertexBufferAddress = mMesh.mBuffers.mVertexBufferAddress
+            // With occlusion culling, the draws visible last frame are culled by the frustum and drawn first, their depth
+            // is reduced into the depth pyramid, and the remaining draws are tested against it and drawn in a second pass.
+            const bool bOcclusionPasses = bIndirectScene && bGpuCulling && bOcclusionCulling;
+            if (bIndirectScene && bGpuCulling) {
+                // Zero the draw counts. The previous frame's late pass must also be done with the visibility buffer.
+                const FrameResources& frame = getCurrentFrame();
+                vkCmdFillBuffer(cmd, frame.mVisibleDrawBuffer.mBuffer, 0, VISIBLE_DRAWS_OFFSET, 0);
+                vkCmdFillBuffer(cmd, frame.mLateDrawBuffer.mBuffer, 0, VISIBLE_DRAWS_OFFSET, 0);
+                const VkMemoryBarrier2 clearBarrier = {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
                 };
-                vkCmdPushConstants(cmd, mMeshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &push_constants);
-                // Bind the descriptor set for the primitive's resources.
-                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mMeshPipelineLayout, 1, 1, &mMeshDescriptorSets[i], 0, nullptr);
-               
-                // Draw primitive.
-                vkCmdDrawIndexed(cmd, prim.indexCount, 1, prim.firstIndex, 0, 0);
+                const VkDependencyInfo clearDependency = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1, .pMemoryBarriers = &clearBarrier };
+                vkCmdPipelineBarrier2(cmd, &clearDependency);
+
+                cullDraws(bOcclusionPasses ? CullPass::Early : CullPass::Frustum, frame.mVisibleDrawAddress);
+            }
+
+            // The vertex pipeline's draws come from the frame's pre-recorded secondary command buffers when the scene allows it.
+            // Direct draws in a sorted order change with the camera, unlike indirect ones rewritten in place.
+            const bool bReuseScene = bReuseSceneCommands && !bUseMeshShaders && (bUseIndirectDraws || (mMesh.mPrimitiveLods.empty() && !bSortDraws));
+            if (bReuseScene && getCurrentFrame().mRecordedSceneVersion != mSceneVersion) {
+                recordSceneCommands(getCurrentFrame());
+            }
+
+            // Draws recorded one call each are split across the recording threads, each recording its own secondary command buffer.
+            const uint32_t recordingWorkers = mRecordingThreads == 0 ? mRecordingPool.size() : std::min(mRecordingThreads, mRecordingPool.size());
+            const bool bParallelRecording = !bReuseScene && (bUseMeshShaders || !bUseIndirectDraws) && recordingWorkers > 1;
+            const bool bSecondaryScene = bReuseScene || bParallelRecording;
+
+            // Begins rendering to the swapchain image and the depth buffer, cleared or with what a previous pass drew.
+            const auto beginRendering = [&](VkAttachmentLoadOp loadOp) {
+                const VkRenderingAttachmentInfo colorAttachment = {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                    .imageView = mSwapchainImageViews[swapchainImageIndex],
+                    .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    .loadOp = loadOp,
+                    .storeOp = VK_ATTACHMENT_STORE_OP_STORE
+                };
+                // Depth is kept after the first pass when the depth pyramid is built from it.
+                const VkRenderingAttachmentInfo depthAttachment = {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+                    .imageView = mDepthImage.mView,
+                    .imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                    .loadOp = loadOp,
+                    .storeOp = bOcclusionPasses && loadOp == VK_ATTACHMENT_LOAD_OP_CLEAR ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                    .clearValue = {.depthStencil = {.depth = 1.f}}
+                };
+                const VkRenderingInfo renderInfo = {
+                    .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+                    .flags = bSecondaryScene ? VkRenderingFlags(VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT) : 0u,
+                    .renderArea = VkRect2D{ VkOffset2D { 0, 0 }, mSwapchainExtent },
+                    .layerCount = 1,
+                    .colorAttachmentCount = 1,
+                    .pColorAttachments = &colorAttachment,
+                    .pDepthAttachment = &depthAttachment
+                };
+                // Begin render pass instance. Secondary command buffers set their own dynamic state.
+                vkCmdBeginRendering(cmd, &renderInfo);
+                if (!bSecondaryScene) {
+                    setViewportAndScissor(cmd);
+                }
+            };
+
+            beginRendering(VK_ATTACHMENT_LOAD_OP_CLEAR);
+
+            if (bParallelRecording) {
+                // Blocks until every worker has recorded its range, then executes their buffers in draw order, every
+                // worker's pre-pass before any shading.
+                frameTriangles += recordDrawsInParallel(getCurrentFrame(), mRecordingPool, recordingWorkers, static_cast<uint32_t>(mDraws.size()), camPos, projectionScale, frameBinds);
+                vkCmdExecuteCommands(cmd, recordingWorkers, getCurrentFrame().mWorkerCommandBuffers.data());
+                if (bDepthPrepass) {
+                    vkCmdExecuteCommands(cmd, recordingWorkers, getCurrentFrame().mWorkerCommandBuffers.data() + mRecordingPool.size());
+                }
+            }
+            else if (bUseMeshShaders) {
+                bindSceneState(cmd, getCurrentFrame(), frameBinds);
+                const uint32_t drawCount = static_cast<uint32_t>(mDraws.size());
+                if (bDepthPrepass) {
+                    frameTriangles += recordDrawRange(cmd, 0, drawCount, camPos, projectionScale, MeshPass::DepthPrepass, frameBinds);
+                }
+                frameTriangles += recordDrawRange(cmd, 0, drawCount, camPos, projectionScale, bDepthPrepass ? MeshPass::EqualDepth : MeshPass::Forward, frameBinds);
+            }
+            else if (bReuseScene) {
+                vkCmdExecuteCommands(cmd, 1, &getCurrentFrame().mSceneCommandBuffers[0]);
+                frameBinds += getCurrentFrame().mSceneBindCounts;
+                if (!bUseIndirectDraws) {
+                    frameTriangles = mFullDetailTriangles;
+                }
+            }
+            else {
+                // The draw count comes from the cull pass, so the CPU never learns which draws are visible.
+                const scvk::Buffer* drawList = bUseIndirectDraws && bGpuCulling ? &getCurrentFrame().mVisibleDrawBuffer : nullptr;
+                frameTriangles += recordMeshDraws(cmd, getCurrentFrame(), drawList, camPos, projectionScale, frameBinds);
             }
             // End render pass.
             vkCmdEndRendering(cmd);
 
+            if (bOcclusionPasses) {
+                const FrameResources& frame = getCurrentFrame();
+
+                // Sample the early pass's depth. The previous frame's late cull pass must be done reading the pyramid.
+                const VkImageMemoryBarrier2 depthReadBarrier = {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    .srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    .dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                    .oldLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                    .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    .image = mDepthImage.mImage,
+                    .subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1}
+                };
+                const VkMemoryBarrier2 pyramidWriteBarrier = {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+                };
+                const VkDependencyInfo depthReadDependency = {
+                    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                    .memoryBarrierCount = 1,
+                    .pMemoryBarriers = &pyramidWriteBarrier,
+                    .imageMemoryBarrierCount = 1,
+                    .pImageMemoryBarriers = &depthReadBarrier
+                };
+                vkCmdPipelineBarrier2(cmd, &depthReadDependency);
+
+                // Each level is reduced from the one above, so every level waits for the previous one.
+                vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mDepthReducePipeline);
+                for (uint32_t level = 0; level < mDepthPyramid.mLevelCount; ++level)
+                {
+                    const uint32_t levelWidth = std::max(mDepthPyramid.mImage.mExtents.width >> level, 1u);
+                    const uint32_t levelHeight = std::max(mDepthPyramid.mImage.mExtents.height >> level, 1u);
+                    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, mDepthReducePipelineLayout, 0, 1, &mDepthPyramid.mReduceSets[level], 0, nullptr);
+                    const DepthReducePushConstants reduceConstants = { .mOutputSize = glm::vec2(levelWidth, levelHeight) };
+                    vkCmdPushConstants(cmd, mDepthReducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthReducePushConstants), &reduceConstants);
+                    vkCmdDispatch(cmd, (levelWidth + 15) / 16, (levelHeight + 15) / 16, 1);
+
+                    const VkImageMemoryBarrier2 levelBarrier = {
+                        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                        .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                        .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                        .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                        .dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                        .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+                        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+                        .image = mDepthPyramid.mImage.mImage,
+                        .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1}
+                    };
+                    const VkDependencyInfo levelDependency = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &levelBarrier };
+                    vkCmdPipelineBarrier2(cmd, &levelDependency);
+                }
+
+                // Hand the depth buffer back to the late pass once the reduction has read it.
+                const VkImageMemoryBarrier2 depthWriteBarrier = {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    .dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    .oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    .newLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                    .image = mDepthImage.mImage,
+                    .subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1}
+                };
+                const VkDependencyInfo depthWriteDependency = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &depthWriteBarrier };
+                vkCmdPipelineBarrier2(cmd, &depthWriteDependency);
+
+                cullDraws(CullPass::Late, frame.mLateDrawAddress);
+
+                beginRendering(VK_ATTACHMENT_LOAD_OP_LOAD);
+                if (bReuseScene) {
+                    vkCmdExecuteCommands(cmd, 1, &frame.mSceneCommandBuffers[1]);
+                }
+                else {
+                    recordMeshDraws(cmd, frame, &frame.mLateDrawBuffer, camPos, projectionScale, frameBinds);
+                }
+                vkCmdEndRendering(cmd);
+
+                // Copy both draw lists' counts back, to be read once the frame's fence has been waited on.
+                const VkMemoryBarrier2 statsReadBarrier = {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                    .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT
+                };
+                const VkDependencyInfo statsReadDependency = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1, .pMemoryBarriers = &statsReadBarrier };
+                vkCmdPipelineBarrier2(cmd, &statsReadDependency);
+                const VkBufferCopy earlyCopy = { .srcOffset = 0, .dstOffset = 0, .size = sizeof(VisibleDrawHeader) };
+                const VkBufferCopy lateCopy = { .srcOffset = 0, .dstOffset = sizeof(VisibleDrawHeader), .size = sizeof(VisibleDrawHeader) };
+                vkCmdCopyBuffer(cmd, frame.mVisibleDrawBuffer.mBuffer, frame.mCullStatsBuffer.mBuffer, 1, &earlyCopy);
+                vkCmdCopyBuffer(cmd, frame.mLateDrawBuffer.mBuffer, frame.mCullStatsBuffer.mBuffer, 1, &lateCopy);
+                const VkMemoryBarrier2 statsHostBarrier = {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                    .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+                    .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT
+                };
+                const VkDependencyInfo statsHostDependency = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO, .memoryBarrierCount = 1, .pMemoryBarriers = &statsHostBarrier };
+                vkCmdPipelineBarrier2(cmd, &statsHostDependency);
+            }
+            lastFrameTriangles = frameTriangles;
+            lastFrameBinds = frameBinds;
+            elapsedDrawCpuMs += drawTimer.total<std::milli>();
+
             // Transition swapchain color image into one suitable for presentation.
             // Note that the depth image doesn't need another transition as it is not presented.
             const VkImageMemoryBarrier2 colorPresentBarrier = {
@@ -701,7 +1520,8 @@ void VulkanApp::run()
                 .pImageMemoryBarriers = &colorPresentBarrier
             };
             vkCmdPipelineBarrier2(cmd, &presentDepInfo);
-            
+
+            vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, getCurrentFrame().mTimestampQueryPool, 1);
         }
         VK_CHECK(vkEndCommandBuffer(cmd));
        
@@ -759,11 +1579,340 @@ void VulkanApp::run()
         vkDestroySemaphore(mDevice, mFrames[i].mRenderFinishedSemaphore, nullptr);
 
         vkDestroyCommandPool(mDevice, mFrames[i].mCommandPool, nullptr);
+        for (const VkCommandPool workerPool : mFrames[i].mWorkerCommandPools) {
+            vkDestroyCommandPool(mDevice, workerPool, nullptr);
+        }
+        vkDestroyQueryPool(mDevice, mFrames[i].mTimestampQueryPool, nullptr);
 
         vmaDestroyBuffer(mVmaAllocator, mFrames[i].mFrameDataBuffer.mBuffer, mFrames[i].mFrameDataBuffer.mAllocation);
     }
 }
 
+PrimitiveLod VulkanApp::selectLod(uint32_t primitive, const glm::mat4& worldMatrix, const glm::vec3& viewer, float projectionScale) const
+{
+    const Primitive& prim = mMesh.mPrimitives[primitive];
+    const uint32_t level = selectLodLevel(primitive, worldMatrix, viewer, projectionScale);
+    if (level == 0) {
+        return { .indexCount = prim.indexCount, .firstIndex = prim.firstIndex, .error = 0.f };
+    }
+    return mMesh.mLods[mMesh.mPrimitiveLods[primitive].firstLod + level - 1];
+}
+
+uint32_t VulkanApp::selectLodLevel(uint32_t primitive, const glm::mat4& worldMatrix, const glm::vec3& viewer, float projectionScale) const
+{
+    if (mMesh.mPrimitiveLods.empty()) {
+        return 0;
+    }
+
+    // Errors are in the mesh's space, so they scale with the instance. The nearest point of the bounding sphere
+    // gives the largest projected error, and the near plane bounds it for viewers inside the sphere.
+    const PrimitiveLods& lods = mMesh.mPrimitiveLods[primitive];
+    const float scale = std::max({ glm::length(glm::vec3(worldMatrix[0])), glm::length(glm::vec3(worldMatrix[1])), glm::length(glm::vec3(worldMatrix[2])) });
+    const glm::vec3 center = glm::vec3(worldMatrix * glm::vec4(lods.center, 1.f));
+    const float distance = std::max(glm::length(center - viewer) - lods.radius * scale, NEAR_PLANE);
+    const float pixelsPerUnit = scale * projectionScale / distance;
+    uint32_t selected = 0;
+    for (uint32_t level = 0; level < lods.lodCount; ++level) {
+        if (mMesh.mLods[lods.firstLod + level].error * pixelsPerUnit > mLodPixelError) {
+            break;
+        }
+        selected = level + 1;
+    }
+    return selected;
+}
+
+void VulkanApp::setViewportAndScissor(VkCommandBuffer cmd) const
+{
+    // Update viewport state.
+    const VkViewport viewport = {
+        .x = 0.f, .y = 0.f,
+        .width = static_cast<float>(mSwapchainExtent.width), .height = static_cast<float>(mSwapchainExtent.height),
+        .minDepth = 0.f, .maxDepth = 1.f };
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    // Update scissor state.
+    const VkRect2D scissor = {
+        .offset = {.x = 0, .y = 0},
+        .extent = {.width = mSwapchainExtent.width, .height = mSwapchainExtent.height}, };
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+}
+
+void VulkanApp::beginSceneSecondary(VkCommandBuffer cmd, VkCommandBufferUsageFlags flags) const
+{
+    const VkCommandBufferInheritanceRenderingInfo renderingInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &mSwapchainImageFormat,
+        .depthAttachmentFormat = mDepthImage.mFormat,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+    };
+    const VkCommandBufferInheritanceInfo inheritanceInfo = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO, .pNext = &renderingInfo };
+    const VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | flags,
+        .pInheritanceInfo = &inheritanceInfo
+    };
+    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+    setViewportAndScissor(cmd);
+}
+
+void VulkanApp::bindSceneState(VkCommandBuffer cmd, const FrameResources& frame, scvk::DrawBindCounts& binds) const
+{
+    // The texture array serves every draw, so nothing is bound per primitive.
+    const std::array<VkDescriptorSet, 2> descriptorSets = { frame.mFrameDataDescriptorSet, frame.mTextureDescriptorSet };
+    binds.mDescriptorSetBinds += static_cast<uint32_t>(descriptorSets.size());
+    if (bUseMeshShaders) {
+        // The meshlet pipelines are bound per pass and draw class by the draws.
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mMeshletPipelineLayout, 0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+        return;
+    }
+
+    // The mesh pipelines are bound per pass and draw class by the draws.
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mMeshPipelineLayout, 0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+
+    // Bind mesh index buffer.
+    vkCmdBindIndexBuffer(cmd, mMesh.mBuffers.mIndexBuffer.mBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+    // Draw data is looked up by each draw's firstInstance, so the push constants hold for the whole scene.
+    const GPUDrawPushConstants push_constants = {
+        .mVertexBufferAddress = mMesh.mBuffers.mVertexBufferAddress,
+        .mDrawDataAddress = mDrawDataAddress
+    };
+    vkCmdPushConstants(cmd, mMeshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &push_constants);
+}
+
+void VulkanApp::bindMeshPipeline(VkCommandBuffer cmd, MeshPass pass, bool bMasked, scvk::DrawBindCounts& binds) const
+{
+    const auto& pipelines = bUseMeshShaders ? mMeshletPipelines : mMeshPipelines;
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[static_cast<uint32_t>(pass)][bMasked ? 1 : 0]);
+    ++binds.mPipelineBinds;
+}
+
+uint64_t VulkanApp::recordDrawRange(VkCommandBuffer cmd, uint32_t first, uint32_t count, const glm::vec3& viewer, float projectionScale, MeshPass pass, scvk::DrawBindCounts& binds) const
+{
+    uint64_t triangles = 0;
+    uint32_t lastTexture = UINT32_MAX;
+    if (bUseMeshShaders) {
+        // One task shader workgroup per MESHLETS_PER_TASK meshlets of each primitive's selected level of detail; culling
+        // happens on the GPU. The buffer addresses hold for every draw, the instance's matrices and the texture and alpha
+        // cutoff until they change. Opaque draws come first in mDrawOrder, as on the vertex pipeline.
+        constexpr VkShaderStageFlags stages = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+        constexpr uint32_t transformSize = offsetof(MeshletDrawPushConstants, mTextureIndex);
+        constexpr uint32_t materialSize = offsetof(MeshletDrawPushConstants, mPadding) - transformSize;
+        constexpr uint32_t addressOffset = offsetof(MeshletDrawPushConstants, mVertexBufferAddress);
+        constexpr uint32_t meshletOffset = offsetof(MeshletDrawPushConstants, mFirstMeshlet);
+        MeshletDrawPushConstants pushConstants = {
+            .mVertexBufferAddress = mMesh.mBuffers.mVertexBufferAddress,
+            .mMeshletAddress = mMesh.mBuffers.mMeshletAddress,
+            .mMeshletVertexAddress = mMesh.mBuffers.mMeshletVertexAddress,
+            .mMeshletTriangleAddress = mMesh.mBuffers.mMeshletTriangleAddress
+        };
+        const auto* pushBytes = reinterpret_cast<const std::byte*>(&pushConstants);
+        vkCmdPushConstants(cmd, mMeshletPipelineLayout, stages, addressOffset, meshletOffset - addressOffset, pushBytes + addressOffset);
+
+        uint32_t lastInstance = UINT32_MAX;
+        float lastAlphaCutoff = -1.f;
+        bool bLastMasked = false;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            const uint32_t index = mDrawOrder[i % mDrawOrder.size()];
+            const SceneDraw& draw = mDraws[index];
+            const glm::mat4& worldMatrix = mMesh.mInstances[draw.mInstance].worldMatrix;
+            const uint32_t level = selectLodLevel(draw.mPrimitive, worldMatrix, viewer, projectionScale);
+            const uint32_t lod = level > 0 ? mMesh.mPrimitiveLods[draw.mPrimitive].firstLod + level - 1 : 0;
+            const MeshletRange& meshlets = level > 0 ? mMesh.mLodMeshlets[lod] : mMesh.mPrimitiveMeshlets[draw.mPrimitive];
+            if (meshlets.meshletCount == 0) {
+                continue;
+            }
+            const bool bMasked = index >= mOpaqueDrawCount;
+            if (lastInstance == UINT32_MAX || bMasked != bLastMasked) {
+                bLastMasked = bMasked;
+                bindMeshPipeline(cmd, pass, bMasked, binds);
+            }
+            if (draw.mInstance != lastInstance) {
+                lastInstance = draw.mInstance;
+                pushConstants.mWorldMatrix = worldMatrix * mMesh.mPositionDequantization;
+                pushConstants.mViewerPosition = glm::vec3(glm::inverse(pushConstants.mWorldMatrix) * glm::vec4(viewer, 1.f));
+                vkCmdPushConstants(cmd, mMeshletPipelineLayout, stages, 0, transformSize, pushBytes);
+                ++binds.mTransformChanges;
+            }
+            const Primitive& primitive = mMesh.mPrimitives[draw.mPrimitive];
+            if (primitive.textureIndex() != lastTexture || primitive.alphaCutoff != lastAlphaCutoff) {
+                lastTexture = primitive.textureIndex();
+                lastAlphaCutoff = primitive.alphaCutoff;
+                pushConstants.mTextureIndex = lastTexture;
+                pushConstants.mAlphaCutoff = lastAlphaCutoff;
+                vkCmdPushConstants(cmd, mMeshletPipelineLayout, stages, transformSize, materialSize, pushBytes + transformSize);
+                ++binds.mMaterialChanges;
+            }
+            pushConstants.mFirstMeshlet = meshlets.firstMeshlet;
+            pushConstants.mMeshletCount = meshlets.meshletCount;
+            vkCmdPushConstants(cmd, mMeshletPipelineLayout, stages, meshletOffset, sizeof(MeshletDrawPushConstants) - meshletOffset, pushBytes + meshletOffset);
+            vkCmdDrawMeshTasksEXT(cmd, (meshlets.meshletCount + MESHLETS_PER_TASK - 1) / MESHLETS_PER_TASK, 1, 1);
+            triangles += (level > 0 ? mMesh.mLods[lod].indexCount : primitive.indexCount) / 3;
+        }
+        return triangles;
+    }
+
+    // Each draw finds its texture in its draw data, so a change of texture costs no call, only cache locality. Opaque
+    // draws come first in mDrawOrder, so the pipeline changes once, or once per wrap of a synthetic scene.
+    bool bLastMasked = false;
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        const uint32_t index = mDrawOrder[i % mDrawOrder.size()];
+        const bool bMasked = index >= mOpaqueDrawCount;
+        if (i == first || bMasked != bLastMasked) {
+            bLastMasked = bMasked;
+            bindMeshPipeline(cmd, pass, bMasked, binds);
+        }
+        const uint32_t texture = mMesh.mPrimitives[mDraws[index].mPrimitive].textureIndex();
+        if (texture != lastTexture) {
+            lastTexture = texture;
+            ++binds.mMaterialChanges;
+        }
+        const PrimitiveLod lod = selectLod(mDraws[index].mPrimitive, mMesh.mInstances[mDraws[index].mInstance].worldMatrix, viewer, projectionScale);
+        vkCmdDrawIndexed(cmd, lod.indexCount, 1, lod.firstIndex, 0, index);
+        triangles += lod.indexCount / 3;
+    }
+    return triangles;
+}
+
+uint64_t VulkanApp::recordDrawsInParallel(FrameResources& frame, scvk::ThreadPool& pool, uint32_t workerCount, uint32_t drawCount, const glm::vec3& viewer, float projectionScale, scvk::DrawBindCounts& binds)
+{
+    const uint32_t rangeSize = (drawCount + workerCount - 1) / workerCount;
+    const uint32_t passCount = bDepthPrepass ? 2 : 1;
+    const std::array<MeshPass, 2> passes = { passCount == 2 ? MeshPass::DepthPrepass : MeshPass::Forward, MeshPass::EqualDepth };
+    std::vector<scvk::DrawBindCounts> workerBinds(workerCount);
+    std::vector<std::future<uint64_t>> workers;
+    workers.reserve(workerCount);
+    for (uint32_t worker = 0; worker < workerCount; ++worker)
+    {
+        workers.emplace_back(pool.submit([&, worker]() {
+            // The frame's fence has been waited on, so the pool's previous commands are done with.
+            VK_CHECK(vkResetCommandPool(mDevice, frame.mWorkerCommandPools[worker], 0));
+            const uint32_t first = std::min(worker * rangeSize, drawCount);
+            uint64_t triangles = 0;
+            for (uint32_t pass = 0; pass < passCount; ++pass)
+            {
+                const VkCommandBuffer cmd = frame.mWorkerCommandBuffers[pass * mRecordingPool.size() + worker];
+                beginSceneSecondary(cmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+                bindSceneState(cmd, frame, workerBinds[worker]);
+                triangles += recordDrawRange(cmd, first, std::min(rangeSize, drawCount - first), viewer, projectionScale, passes[pass], workerBinds[worker]);
+                VK_CHECK(vkEndCommandBuffer(cmd));
+            }
+            return triangles;
+            }));
+    }
+
+    // Let every worker finish before rethrowing, since they all reference frame and the arguments.
+    for (auto& worker : workers) {
+        worker.wait();
+    }
+    uint64_t triangles = 0;
+    for (auto& worker : workers) {
+        triangles += worker.get();
+    }
+    for (const scvk::DrawBindCounts& counts : workerBinds) {
+        binds += counts;
+    }
+    return triangles;
+}
+
+// Records a synthetic scene of the scene's draws repeated up to BENCHMARK_DRAW_COUNT draws with 1, 2, 4, ... up to the
+// workers of mRecordingPool, and prints how the CPU time to record it scales. Nothing is submitted.
+void VulkanApp::benchmarkRecording()
+{
+    constexpr uint32_t BENCHMARK_DRAW_COUNT = 50000;
+    constexpr int RUNS = 5;
+    if (mDraws.empty()) {
+        return;
+    }
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t threads = 1; threads < mRecordingPool.size(); threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(mRecordingPool.size());
+
+    // The default camera's projection, from the origin.
+    const float projectionScale = 0.5f * static_cast<float>(mSwapchainExtent.height) / std::tan(glm::radians(35.f));
+
+    fmt::println("Draw recording scaling ({} {} draws cycling over the scene's {}, best of {}):",
+        BENCHMARK_DRAW_COUNT, bUseMeshShaders ? "meshlet" : "vertex pipeline", mDraws.size(), RUNS);
+    float singleThreadedMs = 0.f;
+    for (const uint32_t threads : threadCounts) {
+        scvk::ThreadPool pool(threads);
+        float ms = std::numeric_limits<float>::max();
+        for (int run = 0; run < RUNS; ++run) {
+            scvk::Timer timer;
+            timer.start();
+            scvk::DrawBindCounts binds;
+            recordDrawsInParallel(mFrames[0], pool, threads, BENCHMARK_DRAW_COUNT, glm::vec3(0.f), projectionScale, binds);
+            ms = std::min(ms, timer.total<std::milli>());
+        }
+        if (threads == 1) {
+            singleThreadedMs = ms;
+        }
+        fmt::println("  {:>3} threads: {:>9.2f} ms  ({:.2f}x)", threads, ms, singleThreadedMs / ms);
+    }
+}
+
+uint64_t VulkanApp::recordMeshDraws(VkCommandBuffer cmd, const FrameResources& frame, const scvk::Buffer* drawList, const glm::vec3& viewer, float projectionScale, scvk::DrawBindCounts& binds)
+{
+    bindSceneState(cmd, frame, binds);
+
+    const uint32_t drawCount = static_cast<uint32_t>(mDraws.size());
+    constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    const auto recordPass = [&](MeshPass pass) -> uint64_t {
+        if (!drawList && !bUseIndirectDraws) {
+            return recordDrawRange(cmd, 0, drawCount, viewer, projectionScale, pass, binds);
+        }
+        // Opaque commands come first, then the alpha masked ones, each drawn with its own pipeline.
+        for (const bool bMasked : { false, true })
+        {
+            const uint32_t classFirst = bMasked ? mOpaqueDrawCount : 0;
+            const uint32_t classCount = bMasked ? drawCount - mOpaqueDrawCount : mOpaqueDrawCount;
+            if (classCount == 0) {
+                continue;
+            }
+            bindMeshPipeline(cmd, pass, bMasked, binds);
+            if (drawList) {
+                // The cull pass compacts each class into its own range, with its own count.
+                const VkDeviceSize countOffset = bMasked ? offsetof(VisibleDrawHeader, mMaskedCount) : offsetof(VisibleDrawHeader, mCount);
+                vkCmdDrawIndexedIndirectCount(cmd, drawList->mBuffer, VISIBLE_DRAWS_OFFSET + VkDeviceSize(classFirst) * stride, drawList->mBuffer, countOffset, classCount, stride);
+                continue;
+            }
+            for (uint32_t first = classFirst; first < classFirst + classCount; first += mMaxDrawIndirectCount) {
+                const uint32_t count = std::min(mMaxDrawIndirectCount, classFirst + classCount - first);
+                vkCmdDrawIndexedIndirect(cmd, frame.mDrawCommandBuffer.mBuffer, VkDeviceSize(first) * stride, count, stride);
+            }
+        }
+        return 0;
+    };
+
+    if (!bDepthPrepass) {
+        return recordPass(MeshPass::Forward);
+    }
+    // Depth first, then the shading pass in the same rendering, each fragment shaded at most once.
+    const uint64_t triangles = recordPass(MeshPass::DepthPrepass);
+    return triangles + recordPass(MeshPass::EqualDepth);
+}
+
+// Nothing in the recorded commands depends on the camera: draws with levels of detail go through the frame's indirect
+// commands, which are rewritten in place, and streamed textures are written into update-after-bind descriptors.
+void VulkanApp::recordSceneCommands(FrameResources& frame)
+{
+    const std::array<const scvk::Buffer*, 2> drawLists = { bUseIndirectDraws && bGpuCulling ? &frame.mVisibleDrawBuffer : nullptr, &frame.mLateDrawBuffer };
+    const uint32_t passCount = bOcclusionCulling ? 2 : 1;
+    frame.mSceneBindCounts = {};
+    for (uint32_t pass = 0; pass < passCount; ++pass)
+    {
+        const VkCommandBuffer cmd = frame.mSceneCommandBuffers[pass];
+        beginSceneSecondary(cmd, 0);
+        recordMeshDraws(cmd, frame, drawLists[pass], glm::vec3(0.f), 0.f, frame.mSceneBindCounts);
+        VK_CHECK(vkEndCommandBuffer(cmd));
+    }
+    frame.mRecordedSceneVersion = mSceneVersion;
+}
+
 void VulkanApp::destroySwapchain()
 {
     vkDestroySwapchainKHR(mDevice, mSwapchain, nullptr);
@@ -789,31 +1938,8 @@ void VulkanApp::cleanup()
 // Submit operations to the queue, and wait for them to complete.
 void VulkanApp::immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function)
 {
-    // Reset fence so it can be re-signalled.
-    VK_CHECK(vkResetFences(mDevice, 1, &mImmFence));
-    // Reset command buffer.
-    VK_CHECK(vkResetCommandBuffer(mImmCommandBuffer, 0));
-    // Begin recording.
-    VkCommandBufferBeginInfo cmdBeginInfo = vkinit::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-    VK_CHECK(vkBeginCommandBuffer(mImmCommandBuffer, &cmdBeginInfo));
-    // Call function
-    function(mImmCommandBuffer);
-    // End recording
-    VK_CHECK(vkEndCommandBuffer(mImmCommandBuffer));
-    // Submit to queue, passing a fence
-    const  VkCommandBufferSubmitInfo cmdinfo = { 
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
-        .commandBuffer = mImmCommandBuffer,
-        .deviceMask = 0
-    };
-    const VkSubmitInfo2 submit = {
-        .sType                  = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
-        .commandBufferInfoCount = 1,
-        .pCommandBufferInfos    = &cmdinfo
-    };
-    VK_CHECK(vkQueueSubmit2(mGraphicsQueue, 1, &submit, mImmFence));
-    // Wait on the fence.
-    VK_CHECK(vkWaitForFences(mDevice, 1, &mImmFence, true, 9999999999));
+    mUploader.record(std::move(function));
+    mUploader.wait(mUploader.submit());
 }
 
 void VulkanApp::createSwapchain(uint32_t width, uint32_t height)
@@ -850,7 +1976,7 @@ void VulkanApp::createSwapchain(uint32_t width, uint32_t height)
     info.arrayLayers    = 1;
     info.samples        = VK_SAMPLE_COUNT_1_BIT;
     info.tiling         = VK_IMAGE_TILING_OPTIMAL;
-    info.usage          = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    info.usage          = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;    // Sampled to build the depth pyramid.
     info.sharingMode    = VK_SHARING_MODE_EXCLUSIVE;
     info.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
 
@@ -880,18 +2006,22 @@ void VulkanApp::createSwapchain(uint32_t width, uint32_t height)
 }
 
 
-// TODO: ()
-/// Note that this pattern is not very efficient, as we are waiting for the GPU command to fully execute before continuing with our CPU side logic.
-/// This is something people generally put on a background thread, whose sole job is to execute uploads like this one, and deleting/reusing the staging buffers.
-/// TODO: Profile.
-
 // Uploads the vertices and indices of a mesh to the GPU
 // and returns the associated GPU buffers needed for rendering.
+GPUMeshBuffers VulkanApp::uploadMeshData(std::span<const uint32_t> indices, std::span<const std::byte> vertices)
+{
+    GPUMeshBuffers buffers = createMeshBuffers(indices, vertices);
+    mUploader.wait(mUploader.submit());
+    return buffers;
+}
 
-GPUMeshBuffers VulkanApp::uploadMeshData(std::span<uint32_t> indices, std::span<Vertex> vertices)
+// Creates the vertex and index buffers of a mesh and records their upload into the current upload batch.
+// The vertices may be in any VertexFormat; the shader reads them through the buffer address.
+// The buffers must not be used before the batch's token has completed.
+GPUMeshBuffers VulkanApp::createMeshBuffers(std::span<const uint32_t> indices, std::span<const std::byte> vertices)
 {
     GPUMeshBuffers newSurface;
-    newSurface.mVertexBuffer.mSizeBytes = vertices.size() * sizeof(Vertex);
+    newSurface.mVertexBuffer.mSizeBytes = vertices.size();
     newSurface.mIndexBuffer.mSizeBytes = indices.size() * sizeof(uint32_t);
 
     //create vertex buffer & get it's address.
@@ -909,84 +2039,306 @@ GPUMeshBuffers VulkanApp::uploadMeshData(std::span<uint32_t> indices, std::span<
     deviceBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
     deviceBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     VK_CHECK(vmaCreateBuffer(mVmaAllocator, &deviceBufferCreateInfo, &deviceBufferAllocInfo, &newSurface.mIndexBuffer.mBuffer, &newSurface.mIndexBuffer.mAllocation, &newSurface.mIndexBuffer.mAllocInfo));
-   
-    // Create staging buffer to hold both vertices and indices.
-    scvk::Buffer staging_buffer;
-
-    VkBufferCreateInfo stagingBufferCreateInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-    stagingBufferCreateInfo.size = newSurface.mVertexBuffer.mSizeBytes + newSurface.mIndexBuffer.mSizeBytes;
-    stagingBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-    stagingBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    const VmaAllocationCreateInfo stagingBufferAllocInfo = {
-        .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-        .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+
+    mUploader.uploadBuffer(newSurface.mVertexBuffer, vertices.data(), newSurface.mVertexBuffer.mSizeBytes);
+    mUploader.uploadBuffer(newSurface.mIndexBuffer, indices.data(), newSurface.mIndexBuffer.mSizeBytes);
+
+    return newSurface;
+}
+
+// Creates one buffer holding the meshlets of mesh, their vertex indices and their triangles, and records its upload
+// into the current upload batch. The task and mesh shaders read each part through its own address.
+void VulkanApp::createMeshletBuffers(LoadedMesh& mesh)
+{
+    const VkDeviceSize meshletBytes = mesh.mMeshlets.size() * sizeof(Meshlet);
+    const VkDeviceSize vertexBytes = mesh.mMeshletVertices.size() * sizeof(uint32_t);
+    const VkDeviceSize triangleBytes = mesh.mMeshletTriangles.size() * sizeof(uint32_t);
+
+    scvk::Buffer& buffer = mesh.mBuffers.mMeshletBuffer;
+    buffer.mSizeBytes = meshletBytes + vertexBytes + triangleBytes;
+    const VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = std::max<VkDeviceSize>(buffer.mSizeBytes, 1),
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
     };
-    VK_CHECK(vmaCreateBuffer(mVmaAllocator, &stagingBufferCreateInfo, &stagingBufferAllocInfo, &staging_buffer.mBuffer, &staging_buffer.mAllocation, &staging_buffer.mAllocInfo));
+    const VmaAllocationCreateInfo allocInfo{ .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, };
+    VK_CHECK(vmaCreateBuffer(mVmaAllocator, &bufferInfo, &allocInfo, &buffer.mBuffer, &buffer.mAllocation, &buffer.mAllocInfo));
 
+    mesh.mBuffers.mMeshletAddress = scvk::GetBufferDeviceAddress(mDevice, buffer);
+    mesh.mBuffers.mMeshletVertexAddress = mesh.mBuffers.mMeshletAddress + meshletBytes;
+    mesh.mBuffers.mMeshletTriangleAddress = mesh.mBuffers.mMeshletVertexAddress + vertexBytes;
 
-    // Copy data into staging buffer.
-    void* data;
-    vmaMapMemory(mVmaAllocator, staging_buffer.mAllocation, (void**)&data);
-    memcpy(data, vertices.data(), newSurface.mVertexBuffer.mSizeBytes);
-    memcpy((char*)data + newSurface.mVertexBuffer.mSizeBytes, indices.data(), newSurface.mIndexBuffer.mSizeBytes);
-    vmaUnmapMemory(mVmaAllocator, staging_buffer.mAllocation);
+    mUploader.uploadBuffer(buffer, mesh.mMeshlets.data(), meshletBytes, 0);
+    mUploader.uploadBuffer(buffer, mesh.mMeshletVertices.data(), vertexBytes, meshletBytes);
+    mUploader.uploadBuffer(buffer, mesh.mMeshletTriangles.data(), triangleBytes, meshletBytes + vertexBytes);
+}
 
-    immediateSubmit([&](VkCommandBuffer cmd) {
-        VkBufferCopy vertexCopy{ 0 };
-        vertexCopy.dstOffset    = 0;
-        vertexCopy.srcOffset    = 0;
-        vertexCopy.size         = newSurface.mVertexBuffer.mSizeBytes;
+void VulkanApp::createDrawBuffers()
+{
+    // Bounds are computed once per primitive and moved into world space per draw, as the scene is static.
+    std::vector<glm::vec4> primitiveBounds(mMesh.mPrimitives.size());
+    for (size_t i = 0; i < mMesh.mPrimitives.size(); ++i)
+    {
+        primitiveBounds[i] = computeBoundingSphere(mMesh, mMesh.mPrimitives[i]);
+    }
 
-        vkCmdCopyBuffer(cmd, staging_buffer.mBuffer, newSurface.mVertexBuffer.mBuffer, 1, &vertexCopy);
+    // Opaque draws first, then the alpha masked ones, so each class is a contiguous range of draws for its pipelines.
+    std::vector<GPUDrawData> drawData;
+    for (const bool bMasked : { false, true })
+    {
+        for (uint32_t instance = 0; instance < mMesh.mInstances.size(); ++instance)
+        {
+            const glm::mat4& worldMatrix = mMesh.mInstances[instance].worldMatrix;
+            const float scale = std::max({ glm::length(glm::vec3(worldMatrix[0])), glm::length(glm::vec3(worldMatrix[1])), glm::length(glm::vec3(worldMatrix[2])) });
+            const MeshRange& range = mMesh.mMeshes[mMesh.mInstances[instance].meshIndex];
+            for (uint32_t i = range.firstPrimitive; i < range.firstPrimitive + range.primitiveCount; ++i)
+            {
+                if ((mMesh.mPrimitives[i].alphaCutoff > 0.f) != bMasked) {
+                    continue;
+                }
+                const glm::vec4 boundingSphere = glm::vec4(glm::vec3(worldMatrix * glm::vec4(glm::vec3(primitiveBounds[i]), 1.f)), primitiveBounds[i].w * scale);
+                mDraws.push_back({ .mInstance = instance, .mPrimitive = i, .mBoundingSphere = boundingSphere });
+                drawData.push_back({
+                    .mWorldMatrix = worldMatrix * mMesh.mPositionDequantization,
+                    .mBoundingSphere = boundingSphere,
+                    .mTextureIndex = mMesh.mPrimitives[i].textureIndex(),
+                    .mAlphaCutoff = mMesh.mPrimitives[i].alphaCutoff });
+            }
+        }
+        if (!bMasked) {
+            mOpaqueDrawCount = static_cast<uint32_t>(mDraws.size());
+        }
+    }
+    mDrawOrder.resize(mDraws.size());
+    std::iota(mDrawOrder.begin(), mDrawOrder.end(), 0u);
+    if (bGpuCulling && mDraws.size() > mMaxDrawIndirectCount) {
+        fmt::println("The scene's {} draws exceed maxDrawIndirectCount, GPU culling is disabled", mDraws.size());
+        bGpuCulling = false;
+    }
+    bOcclusionCulling = bOcclusionCulling && bGpuCulling && bUseIndirectDraws && !bUseMeshShaders;
+
+    mDrawDataBuffer.mSizeBytes = drawData.size() * sizeof(GPUDrawData);
+    const VkBufferCreateInfo dataInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = std::max<VkDeviceSize>(mDrawDataBuffer.mSizeBytes, 1),
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+    const VmaAllocationCreateInfo dataAllocInfo{ .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, };
+    VK_CHECK(vmaCreateBuffer(mVmaAllocator, &dataInfo, &dataAllocInfo, &mDrawDataBuffer.mBuffer, &mDrawDataBuffer.mAllocation, &mDrawDataBuffer.mAllocInfo));
+    mDrawDataAddress = scvk::GetBufferDeviceAddress(mDevice, mDrawDataBuffer);
+    mUploader.uploadBuffer(mDrawDataBuffer, drawData.data(), mDrawDataBuffer.mSizeBytes);
+
+    // Shared by the frames, as each frame's early pass reads what the previous frame's late pass wrote. Starts with
+    // nothing visible, so the first frame draws everything in its late pass.
+    const std::vector<uint32_t> visibility(mDraws.size(), 0);
+    mDrawVisibilityBuffer.mSizeBytes = visibility.size() * sizeof(uint32_t);
+    const VkBufferCreateInfo visibilityInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = std::max<VkDeviceSize>(mDrawVisibilityBuffer.mSizeBytes, 1),
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+    VK_CHECK(vmaCreateBuffer(mVmaAllocator, &visibilityInfo, &dataAllocInfo, &mDrawVisibilityBuffer.mBuffer, &mDrawVisibilityBuffer.mAllocation, &mDrawVisibilityBuffer.mAllocInfo));
+    mDrawVisibilityAddress = scvk::GetBufferDeviceAddress(mDevice, mDrawVisibilityBuffer);
+    mUploader.uploadBuffer(mDrawVisibilityBuffer, visibility.data(), mDrawVisibilityBuffer.mSizeBytes);
 
-        VkBufferCopy indexCopy{ 0 };
-        indexCopy.dstOffset = 0;
-        indexCopy.srcOffset = newSurface.mVertexBuffer.mSizeBytes;
-        indexCopy.size      = newSurface.mIndexBuffer.mSizeBytes;
+    // The commands are rewritten by the CPU while the other frame may read its own, so each frame has a copy.
+    for (FrameResources& frame : mFrames)
+    {
+        frame.mDrawCommandBuffer.mSizeBytes = mDraws.size() * sizeof(VkDrawIndexedIndirectCommand);
+        const VkBufferCreateInfo commandInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = std::max<VkDeviceSize>(frame.mDrawCommandBuffer.mSizeBytes, 1),
+            .usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+        };
+        const VmaAllocationCreateInfo commandAllocInfo = {
+            .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+            .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+        };
+        VK_CHECK(vmaCreateBuffer(mVmaAllocator, &commandInfo, &commandAllocInfo, &frame.mDrawCommandBuffer.mBuffer, &frame.mDrawCommandBuffer.mAllocation, &frame.mDrawCommandBuffer.mAllocInfo));
+        frame.mDrawCommandAddress = scvk::GetBufferDeviceAddress(mDevice, frame.mDrawCommandBuffer);
+
+        // Written by the cull passes and read as indirect commands on the GPU only. Their headers are copied back for statistics.
+        const VkBufferCreateInfo visibleInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = VISIBLE_DRAWS_OFFSET + mDraws.size() * sizeof(VkDrawIndexedIndirectCommand),
+            .usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+        };
+        const VmaAllocationCreateInfo visibleAllocInfo{ .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, };
+        for (scvk::Buffer* buffer : { &frame.mVisibleDrawBuffer, &frame.mLateDrawBuffer }) {
+            buffer->mSizeBytes = visibleInfo.size;
+            VK_CHECK(vmaCreateBuffer(mVmaAllocator, &visibleInfo, &visibleAllocInfo, &buffer->mBuffer, &buffer->mAllocation, &buffer->mAllocInfo));
+        }
+        frame.mVisibleDrawAddress = scvk::GetBufferDeviceAddress(mDevice, frame.mVisibleDrawBuffer);
+        frame.mLateDrawAddress = scvk::GetBufferDeviceAddress(mDevice, frame.mLateDrawBuffer);
 
-        vkCmdCopyBuffer(cmd, staging_buffer.mBuffer, newSurface.mIndexBuffer.mBuffer, 1, &indexCopy);
-    });
+        frame.mCullStatsBuffer = scvk::createHostVisibleStagingBuffer(mVmaAllocator, 2 * sizeof(VisibleDrawHeader), VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+        memset(frame.mCullStatsBuffer.mAllocInfo.pMappedData, 0, 2 * sizeof(VisibleDrawHeader));
 
-    // No longer need the staging buffer.
-    vmaDestroyBuffer(mVmaAllocator, staging_buffer.mBuffer, staging_buffer.mAllocation);
+        // Final for scenes without levels of detail, whose draws are all full detail. Others rewrite them every frame.
+        mFullDetailTriangles = writeDrawCommands(frame, glm::vec3(0.f), 0.f);
+    }
+    fmt::println("Scene: {} draws of {} primitives in {} instances", mDraws.size(), mMesh.mPrimitives.size(), mMesh.mInstances.size());
+    invalidateSceneCommands();
+}
 
-    return newSurface;
+uint64_t VulkanApp::writeDrawCommands(FrameResources& frame, const glm::vec3& viewer, float projectionScale)
+{
+    // Written in order into host-coherent memory the GPU reads directly, so only whole commands are stored.
+    auto* commands = static_cast<VkDrawIndexedIndirectCommand*>(frame.mDrawCommandBuffer.mAllocInfo.pMappedData);
+    uint64_t triangles = 0;
+    for (uint32_t position = 0; position < mDrawOrder.size(); ++position)
+    {
+        const uint32_t i = mDrawOrder[position];
+        const PrimitiveLod lod = selectLod(mDraws[i].mPrimitive, mMesh.mInstances[mDraws[i].mInstance].worldMatrix, viewer, projectionScale);
+        commands[position] = {
+            .indexCount = lod.indexCount,
+            .instanceCount = 1,
+            .firstIndex = lod.firstIndex,
+            .vertexOffset = 0,
+            .firstInstance = i
+        };
+        triangles += lod.indexCount / 3;
+    }
+    return triangles;
+}
 
+void VulkanApp::sortDraws(const glm::vec3& viewer, float farPlane)
+{
+    // The pipeline field keeps alpha masked draws after the opaque ones, which are drawn with other pipelines.
+    mDrawSortKeys.resize(mDraws.size());
+    for (uint32_t i = 0; i < mDraws.size(); ++i)
+    {
+        const uint32_t pipeline = i < mOpaqueDrawCount ? 0 : 1;
+        // Opaque draws go front to back by the nearest point of their bounds, so they hide more of what follows.
+        const SceneDraw& draw = mDraws[i];
+        const float distance = std::max(glm::length(glm::vec3(draw.mBoundingSphere) - viewer) - draw.mBoundingSphere.w, 0.f);
+        mDrawSortKeys[i] = scvk::makeDrawSortKey(pipeline, mMesh.mPrimitives[draw.mPrimitive].textureIndex(), distance / farPlane);
+    }
+    const std::span<const uint32_t> order = mDrawSorter.sort(mDrawSortKeys);
+    mDrawOrder.assign(order.begin(), order.end());
+}
+
+void VulkanApp::printTextureStats()
+{
+    fmt::println("Texture memory: {:.2f} MB (mipmaps {})", mTextureMemoryBytes / (1024.0 * 1024.0), bGenerateMipmaps ? "on" : "off");
+    fmt::println("Texture deduplication: {} textures share {} images, saving {} images and views and {:.2f} MB",
+        mTextureRequestCount, mTextureImages.size(), mTextureRequestCount - mTextureImages.size(), mDeduplicatedTextureBytes / (1024.0 * 1024.0));
+    fmt::println("Sampler cache: {} samplers for {} requests, saving {} samplers",
+        mSamplerCache.size(), mSamplerCache.requestCount(), mSamplerCache.requestCount() - mSamplerCache.size());
+}
+
+void VulkanApp::writeTextureDescriptor(VkDescriptorSet set, uint32_t textureIndex, const scvk::Texture& texture)
+{
+    const VkDescriptorImageInfo textureDescriptor = {
+        .sampler = texture.mSampler,
+        .imageView = texture.mImage.mView,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    };
+    const VkWriteDescriptorSet imageWrite = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = set,
+        .dstBinding = 0,
+        .dstArrayElement = textureIndex,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &textureDescriptor
+    };
+    vkUpdateDescriptorSets(mDevice, 1, &imageWrite, 0, nullptr);
 }
 
+// Loads an image file, e.g. a JPG, PNG or KTX2, as a base color texture and waits for its upload.
 scvk::Texture VulkanApp::uploadTexture(const char* path)
 {
-    int width, height;
-    unsigned char* imageData = stbi_load(path, &width, &height, nullptr, 4);
-    return uploadTexture(imageData, width, height);
+    const scvk::TextureData data = scvk::loadTextureData({ .mPath = path, .mName = path }, scvk::TextureRole::BaseColor, { .bBlockCompressedFormats = bSupportsBlockCompression });
+    scvk::Texture texture = createTexture(data);
+    mUploader.wait(mUploader.submit());
+    return texture;
 }
 
 scvk::Texture VulkanApp::uploadTexture(unsigned char* imageData, int width, int height)
 {
+    scvk::Texture texture = createTexture(imageData, width, height);
+    mUploader.wait(mUploader.submit());
+    return texture;
+}
+
+// Creates an RGBA8 sRGB texture and records the upload of its pixels into the current upload batch.
+// The texture must not be sampled before the batch's token has completed.
+scvk::Texture VulkanApp::createTexture(unsigned char* imageData, int width, int height)
+{
+    const size_t size = size_t(width) * height * 4;
+
+    scvk::TextureData data;
+    data.mFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    data.mWidth = static_cast<uint32_t>(width);
+    data.mHeight = static_cast<uint32_t>(height);
+    data.mLevels = { { data.mWidth, data.mHeight, 0, size } };
+    data.mBytes = std::span<const uint8_t>(imageData, size);
+    return createTexture(data);
+}
+
+// Creates a texture from loaded texel data, uncompressed or block-compressed, and records its upload into the current upload batch.
+// The texture must not be sampled before the batch's token has completed.
+scvk::Texture VulkanApp::createTexture(const scvk::TextureData& data, const VkSamplerCreateInfo& samplerInfo)
+{
+    ++mTextureRequestCount;
+
+    scvk::Texture texture;
+    texture.mSampler = mSamplerCache.getSampler(samplerInfo);
+
+    // Identical texel data is only uploaded once; every texture using it shares the image. The hash is 128 bits wide,
+    // so a match is trusted without keeping the texels to compare.
+    const scvk::Hash128 contentHash = data.mContentHash != scvk::Hash128{} ? data.mContentHash : scvk::hashTextureData(data);
+    if (const auto cached = mTextureImages.find(contentHash); cached != mTextureImages.end()) {
+        mDeduplicatedTextureBytes += cached->second.mSizeBytes;
+        texture.mImage = cached->second.mImage;
+        texture.mMipLevels = cached->second.mMipLevels;
+        return texture;
+    }
 
     scvk::Image image;
-    image.mFormat = VK_FORMAT_R8G8B8A8_SRGB;
-    image.mExtents = { static_cast<uint32_t>(width),  static_cast<uint32_t>(height), 1 };
+    image.mFormat = data.mFormat;
+    image.mExtents = { data.mWidth, data.mHeight, 1 };
+
+    // Data with a single uncompressed level gets the full mip chain, down to 1x1, if the format can be downsampled with linear blits.
+    // Anything else, e.g. block-compressed data, already carries its mips and is copied as is.
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(mPhysicalDevice, image.mFormat, &formatProperties);
+    constexpr VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+        throw std::runtime_error(fmt::format("Texture format {} cannot be sampled on this device", string_VkFormat(data.mFormat)));
+    }
+    const bool canBlit = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+    const bool bBlitMips = data.mLevels.size() == 1 && !scvk::isBlockCompressed(data.mFormat) && bGenerateMipmaps && canBlit;
+    const uint32_t mipLevels = bBlitMips
+        ? static_cast<uint32_t>(std::floor(std::log2(std::max(data.mWidth, data.mHeight)))) + 1
+        : static_cast<uint32_t>(data.mLevels.size());
 
     VkImageCreateInfo imageInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
     imageInfo.extent = image.mExtents;
     imageInfo.format = image.mFormat;
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = 1;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | (bBlitMips ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0);
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VmaAllocationCreateInfo imageCreateInfo = {};
     imageCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
     imageCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-    VK_CHECK(vmaCreateImage(mVmaAllocator, &imageInfo, &imageCreateInfo, &image.mImage, &image.mAllocation, nullptr));
+    VmaAllocationInfo allocationInfo;
+    VK_CHECK(vmaCreateImage(mVmaAllocator, &imageInfo, &imageCreateInfo, &image.mImage, &image.mAllocation, &allocationInfo));
+    mTextureMemoryBytes += allocationInfo.size;
 
     VkImageViewCreateInfo viewInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
     viewInfo.image = image.mImage;
@@ -1000,103 +2352,22 @@ scvk::Texture VulkanApp::uploadTexture(unsigned char* imageData, int width, int
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
     viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.levelCount = mipLevels;
 
     VK_CHECK(vkCreateImageView(mDevice, &viewInfo, nullptr, &image.mView));
 
-    // Create staging buffer and copy image data to it.
-    scvk::Buffer staging = scvk::createHostVisibleStagingBuffer(mVmaAllocator, image.mExtents.width * image.mExtents.height * 4);
-
-    void* data;
-    vmaMapMemory(mVmaAllocator, staging.mAllocation, (void**)&data);
-    memcpy(data, imageData, image.mExtents.width * image.mExtents.height * 4);
-    vmaUnmapMemory(mVmaAllocator, staging.mAllocation);
-
-    // Transfer data from staging buffer to image.
-
-    immediateSubmit([&](VkCommandBuffer cmd) {
-        const VkImageSubresourceRange range{ VK_IMAGE_ASPECT_COLOR_BIT,
-        0,1,
-        0,1 };
-
-    VkImageMemoryBarrier2 preCopyMemoryBarrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
-    preCopyMemoryBarrier.image = image.mImage;
-    preCopyMemoryBarrier.srcAccessMask = 0;
-    preCopyMemoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
-    preCopyMemoryBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
-    preCopyMemoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
-    preCopyMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    preCopyMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    preCopyMemoryBarrier.subresourceRange = range;
-
-    VkDependencyInfo dep = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
-    dep.imageMemoryBarrierCount = 1;
-    dep.pImageMemoryBarriers = &preCopyMemoryBarrier;
-
-    vkCmdPipelineBarrier2(cmd, &dep);
-
-    // Copy data from staging buffer to image.
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageOffset = { 0, 0, 0 };
-    region.imageExtent = { image.mExtents.width, image.mExtents.height, 1 };
-
-
-    vkCmdCopyBufferToImage(cmd, staging.mBuffer, image.mImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    VkImageMemoryBarrier2 postCopyMemoryBarrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
-    postCopyMemoryBarrier.image = image.mImage;
-    postCopyMemoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
-    postCopyMemoryBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
-    postCopyMemoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR;
-    postCopyMemoryBarrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR;
-    postCopyMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    postCopyMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    postCopyMemoryBarrier.subresourceRange = range;
-
-    VkDependencyInfo depPost = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
-    depPost.imageMemoryBarrierCount = 1;
-    depPost.pImageMemoryBarriers = &postCopyMemoryBarrier;
-
-    vkCmdPipelineBarrier2(cmd, &depPost);
-
-        });
-
-    vmaDestroyBuffer(mVmaAllocator, staging.mBuffer, staging.mAllocation);
-
-
-    // Create a sampler for the texture
-    VkSampler sampler;
-    VkSamplerCreateInfo samplerInfo = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
-    samplerInfo.magFilter = VK_FILTER_LINEAR;
-    samplerInfo.minFilter = VK_FILTER_LINEAR;
-
-    //VkSamplerMipmapMode     mipmapMode;
-    //VkSamplerAddressMode    addressModeU;
-    //VkSamplerAddressMode    addressModeV;
-    //VkSamplerAddressMode    addressModeW;
-    //float                   mipLodBias;
-    //VkBool32                anisotropyEnable;
-    //float                   maxAnisotropy;
-    //VkBool32                compareEnable;
-    //VkCompareOp             compareOp;
-    //float                   minLod;
-    //float                   maxLod;
-    //VkBorderColor           borderColor;
-    //VkBool32                unnormalizedCoordinates;
+    // Record the copy from staging memory to the image, plus the blits generating the rest of the mip chain if there are any.
+    if (bBlitMips) {
+        mUploader.uploadImage(image, data.mBytes.data(), data.mLevels[0].mSize, mipLevels);
+    }
+    else {
+        mUploader.uploadImageLevels(image, data);
+    }
 
-    VK_CHECK(vkCreateSampler(mDevice, &samplerInfo, nullptr, &sampler));
+    mTextureImages.emplace(contentHash, CachedTextureImage{ .mImage = image, .mMipLevels = mipLevels, .mSizeBytes = allocationInfo.size });
 
-    scvk::Texture texture;
     texture.mImage = image;
-    texture.mSampler = sampler;
-    texture.mMipLevels = 1;
+    texture.mMipLevels = mipLevels;
 
     return texture;
-}
\ No newline at end of file
+}
@@ -5,10 +5,16 @@
 
 #include "buffer.h"
 #include "descriptors.h"
+#include "draw_sort.h"
 #include "image.h"
 #include "mesh.h"
+#include "sampler_cache.h"
 #include "texture.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
 #include "timer.h"
+#include "upload.h"
+#include "vk_initializers.h"
 
 //struct SwapchainResources
 //{
@@ -20,6 +26,9 @@
 //};
 
 constexpr unsigned int FRAME_OVERLAP = 2;
+constexpr uint32_t MAX_BINDLESS_TEXTURES = 16384;	// Size of the texture array, unless the device allows fewer.
+constexpr float NEAR_PLANE = 0.01f;		// Of the camera's projection.
+constexpr float FAR_PLANE = 1000.f;
 struct FrameResources {
 
 	// Synchronisation primitives for frame submission.
@@ -30,9 +39,57 @@ struct FrameResources {
 	VkCommandPool	mCommandPool;
 	VkCommandBuffer mMainCommandBuffer;
 
+	// The vertex pipeline's scene draws, recorded once into secondary command buffers that mMainCommandBuffer executes
+	// every frame: the first pass, then the late occlusion culling pass. Re-recorded once mRecordedSceneVersion falls
+	// behind VulkanApp::mSceneVersion.
+	std::array<VkCommandBuffer, 2>	mSceneCommandBuffers;
+	uint64_t						mRecordedSceneVersion{ 0 };
+	scvk::DrawBindCounts			mSceneBindCounts;	// Recorded into mSceneCommandBuffers, so issued again every frame they are executed.
+
+	// A command pool per worker of VulkanApp::mRecordingPool, for draws recorded one call each in parallel, and two secondary
+	// command buffers each: all workers' buffers for the depth pre-pass, or the only pass, then all workers' buffers for
+	// the shading pass after it. Each pool is only touched by the worker recording into it, so none of them needs locking.
+	std::vector<VkCommandPool>		mWorkerCommandPools;
+	std::vector<VkCommandBuffer>	mWorkerCommandBuffers;
+
+	// Timestamps at the start and end of the frame's commands, used to measure GPU frame time.
+	VkQueryPool		mTimestampQueryPool;
+
 	// Per-frame shader resources.
 	VkDescriptorSet			mFrameDataDescriptorSet;
 	scvk::Buffer			mFrameDataBuffer;
+
+	// Every texture of the scene, indexed by texture ID. Kept per frame, so entries can be rewritten while the other frame is in flight.
+	VkDescriptorSet			mTextureDescriptorSet;
+	std::vector<uint32_t>	mStaleTextures;		// Textures replaced since this frame's set was last written.
+
+	// A VkDrawIndexedIndirectCommand per scene draw, host visible. Written at load time, and again before each frame
+	// when levels of detail are selected.
+	scvk::Buffer			mDrawCommandBuffer;
+	VkDeviceAddress			mDrawCommandAddress;
+
+	// The draws that pass GPU frustum culling: a VisibleDrawHeader, then their commands from VISIBLE_DRAWS_OFFSET. Device local.
+	// With occlusion culling, the draws of the early pass.
+	scvk::Buffer			mVisibleDrawBuffer;
+	VkDeviceAddress			mVisibleDrawAddress;
+
+	// As mVisibleDrawBuffer, for the draws of the late occlusion culling pass.
+	scvk::Buffer			mLateDrawBuffer;
+	VkDeviceAddress			mLateDrawAddress;
+
+	// The VisibleDrawHeader of the early and late draw lists, copied back at the end of the frame. Host visible.
+	scvk::Buffer			mCullStatsBuffer;
+};
+
+// A chain of R32 images halving down to 1x1, each texel holding the farthest depth of the texels it covers in the level
+// above, and level 0 the farthest of the depth buffer's. Rebuilt every frame after the early occlusion culling pass.
+struct DepthPyramid
+{
+	scvk::Image						mImage;			// mView covers every level.
+	uint32_t						mLevelCount;
+	std::vector<VkImageView>		mLevelViews;
+	std::vector<VkDescriptorSet>	mReduceSets;	// Per level: the level above, or the depth buffer, and the level written.
+	VkDescriptorSet					mCullSet;		// The whole pyramid, for the late cull pass.
 };
 
 struct FrameData
@@ -47,6 +104,31 @@ public:
 
 
 	bool bUseValidationLayers{ true };
+	std::filesystem::path mScenePath{ "../../assets/sponza/sponza.gltf" };	// A glTF, or an OBJ when the extension is .obj.
+	bool bBenchmarkTextureDecode{ false };	// Print texture decode times for increasing thread counts during init().
+	bool bBenchmarkGeometry{ false };		// Compare per-element and bulk glTF geometry conversion on the scene and a large synthetic glTF during init().
+	bool bGenerateMipmaps{ true };			// Give uploaded textures a full mip chain.
+	bool bCompressTextures{ true };			// Compress glTF textures to BC formats, cached on disk next to the asset. Cleared when the device lacks BC support.
+	bool bSupportsBlockCompression{ true };	// Whether the device samples BC formats. Set by initContext().
+	bool bUseSceneCache{ true };			// Load processed glTF geometry from a binary cache next to the asset when it is up to date.
+	bool bStreamTextures{ true };			// Start rendering with placeholder textures and stream the real ones in.
+	VkDeviceSize mStreamingBudgetBytes{ 32ull * 1024 * 1024 };	// Texel data uploaded per frame while streaming.
+	bool bUseTransferQueue{ true };			// Upload through a separate transfer queue family when the device has one.
+	VertexFormat mVertexFormat{ VertexFormat::Float };	// Layout the scene's vertices are uploaded and fetched in.
+	bool bOptimizeMeshes{ false };			// Reorder triangles and vertices for the vertex cache, overdraw and vertex fetch at load time.
+	bool bGenerateLods{ true };				// Build simplified index buffers per primitive at load time and draw them, or their meshlets, by screen-space error.
+	float mLodPixelError{ 1.f };			// Coarsest level of detail whose error projects to at most this many pixels is drawn.
+	bool bUseMeshShaders{ true };			// Draw culled meshlets with task and mesh shaders. Cleared when the device lacks VK_EXT_mesh_shader.
+	bool bUseIndirectDraws{ true };			// Submit the vertex pipeline's draws with multi-draw indirect rather than one call each.
+	bool bGpuCulling{ true };				// Frustum cull indirect draws in a compute pass and draw the survivors with an indirect count.
+	bool bOcclusionCulling{ true };			// With GPU culling, also cull draws hidden in a depth pyramid, in two passes per frame.
+	bool bReuseSceneCommands{ true };		// Execute the vertex pipeline's draws from secondary command buffers recorded once per scene.
+	uint32_t mSceneCopies{ 1 };				// Draw the scene this many times along X and Z, to stress draw submission.
+	uint32_t mRecordingThreads{ 0 };		// Threads recording draws drawn one call each. 0 uses every worker of mRecordingPool.
+	bool bBenchmarkRecording{ false };		// Print draw recording times for increasing thread counts on a synthetic scene during init().
+	bool bSortDraws{ true };				// Order draws by pipeline, texture and depth each frame, where the CPU decides their order.
+	bool bDepthPrepass{ false };			// Draw the scene's depth first, then shade with an equal depth test. Toggled with P.
+	bool bPrepassKeyDown{ false };			// Whether P was held last frame, so holding it toggles bDepthPrepass once.
 
 	VkSurfaceKHR		mSurface;
 	struct GLFWwindow*	mWindow{ nullptr }; // Forward declaration.
@@ -65,6 +147,13 @@ public:
 
 	scvk::Image					mDepthImage;
 
+	// Built from mDepthImage for occlusion culling, read through a max reduction sampler.
+	DepthPyramid				mDepthPyramid;
+	VkSampler					mDepthReductionSampler{ VK_NULL_HANDLE };
+	VkDescriptorPool			mDepthPyramidDescriptorPool{ VK_NULL_HANDLE };
+	VkDescriptorSetLayout		mDepthReduceDescriptorSetLayout;
+	VkDescriptorSetLayout		mDepthPyramidDescriptorSetLayout;
+
 
 	VkDescriptorPool		mGlobalDescriptorPool;
 	VkDescriptorSetLayout	mFrameDataDescriptorSetLayout;
@@ -77,16 +166,81 @@ public:
 
 	void immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function);
 
+	// Batches buffer and image uploads. The create* functions below only record into the current batch;
+	// call mUploader.submit() and wait on the returned token before using the resources.
+	scvk::UploadContext mUploader;
 
-	GPUMeshBuffers uploadMeshData(std::span<uint32_t> indices, std::span<Vertex> vertices);
+	GPUMeshBuffers uploadMeshData(std::span<const uint32_t> indices, std::span<const std::byte> vertices);
+	GPUMeshBuffers createMeshBuffers(std::span<const uint32_t> indices, std::span<const std::byte> vertices);
+	void createMeshletBuffers(LoadedMesh& mesh);
 	LoadedMesh mMesh;
 
+	// Every primitive of every instance, flattened at load time: the opaque ones in instance order, then the alpha masked
+	// ones. A draw's index is its firstInstance and its entry in mDrawDataBuffer.
+	struct SceneDraw
+	{
+		uint32_t	mInstance;
+		uint32_t	mPrimitive;
+		glm::vec4	mBoundingSphere;	// In world space, as GPUDrawData::mBoundingSphere.
+	};
+	std::vector<SceneDraw>	mDraws;
+	uint32_t				mOpaqueDrawCount{ 0 };
+	// The order draws are recorded in, and the order of the frames' mDrawCommandBuffer when GPU culling does not read
+	// it by draw index. The draws in load order unless sorted. Opaque draws always come first.
+	std::vector<uint32_t>	mDrawOrder;
+	std::vector<uint64_t>	mDrawSortKeys;
+	scvk::DrawSorter		mDrawSorter;
+	scvk::Buffer			mDrawDataBuffer;		// GPUDrawData per draw, device local.
+	VkDeviceAddress			mDrawDataAddress;
+	scvk::Buffer			mDrawVisibilityBuffer;	// A uint32_t per draw, whether the late cull pass found it visible. Device local.
+	VkDeviceAddress			mDrawVisibilityAddress;
+	uint32_t				mMaxDrawIndirectCount;	// Draws per vkCmdDrawIndexedIndirect call.
+	uint64_t				mFullDetailTriangles{ 0 };
+	void createDrawBuffers();
+
+	// Makes every frame re-record its scene command buffers before their next use. Call whenever something they
+	// record changes: the draws, the mesh buffers or the draw options.
+	void invalidateSceneCommands() { ++mSceneVersion; }
+	uint64_t				mSceneVersion{ 0 };
+	// Writes this frame's draw commands in mDrawOrder with the level of detail selected for each draw. Returns the triangle count.
+	uint64_t writeDrawCommands(FrameResources& frame, const glm::vec3& viewer, float projectionScale);
+	// Orders mDrawOrder by each draw's sort key: its pipeline, then its texture, then the distance from viewer to its
+	// bounding sphere relative to farPlane, nearest first.
+	void sortDraws(const glm::vec3& viewer, float farPlane);
+
+	// Worker threads for asset loading and texture streaming. Sized to the number of hardware threads.
+	scvk::ThreadPool mThreadPool;
+	// Worker threads for recording draws, kept apart from mThreadPool so a frame never waits behind queued texture
+	// loads. Also sized to the number of hardware threads.
+	scvk::ThreadPool mRecordingPool;
+
 	scvk::Texture uploadTexture(const char* path);
 	scvk::Texture uploadTexture(unsigned char* data, int width, int height);
+	scvk::Texture createTexture(unsigned char* data, int width, int height);
+	scvk::Texture createTexture(const scvk::TextureData& data, const VkSamplerCreateInfo& samplerInfo = vkinit::samplerCreateInfo());
 	scvk::Texture mTexture;
+	VkDeviceSize  mTextureMemoryBytes{ 0 };	// Device memory allocated for texture images.
+
+	// Texture images by content hash, so identical texel data is uploaded once however many textures use it.
+	// Owns every texture image; textures only reference them.
+	struct CachedTextureImage
+	{
+		scvk::Image		mImage;
+		uint32_t		mMipLevels;
+		VkDeviceSize	mSizeBytes;
+	};
+	std::unordered_map<scvk::Hash128, CachedTextureImage, scvk::Hash128Hash> mTextureImages;
+	uint32_t			mTextureRequestCount{ 0 };
+	VkDeviceSize		mDeduplicatedTextureBytes{ 0 };	// Device memory not allocated thanks to deduplication.
+	scvk::SamplerCache	mSamplerCache;
+	TextureStreamer		mTextureStreamer;
+	void printTextureStats();
 
-	VkDescriptorSetLayout			mMeshDescriptorSetLayout;
-	std::vector<VkDescriptorSet>	mMeshDescriptorSets;
+	// A partially bound, update-after-bind array of mMaxBindlessTextures combined image samplers, bound once per frame.
+	VkDescriptorSetLayout	mTextureDescriptorSetLayout;
+	VkDescriptorPool		mTextureDescriptorPool;
+	uint32_t				mMaxBindlessTextures{ 0 };
+	void writeTextureDescriptor(VkDescriptorSet set, uint32_t textureIndex, const scvk::Texture& texture);
 
 
 
@@ -99,10 +253,42 @@ private:
 	void initGlobalResources();
 	void initGlobalDescriptors();
 	void initMeshPipeline();
+	void initMeshletPipeline();
+	void initCullPipeline();
+	void initDepthPyramid();
+	void initDepthReducePipeline();
 	
 
 	void initTracy();
 	
+	// The indices to draw a primitive of an instance with: its coarsest level of detail whose error, projected from
+	// the viewer's position with projectionScale pixels per unit at unit distance, is at most mLodPixelError.
+	PrimitiveLod selectLod(uint32_t primitive, const glm::mat4& worldMatrix, const glm::vec3& viewer, float projectionScale) const;
+	// As selectLod(), as a level: 0 for full detail, or n for mMesh.mLods[firstLod + n - 1] of the primitive's PrimitiveLods.
+	uint32_t selectLodLevel(uint32_t primitive, const glm::mat4& worldMatrix, const glm::vec3& viewer, float projectionScale) const;
+
+	void setViewportAndScissor(VkCommandBuffer cmd) const;
+	// Begins a secondary command buffer to be executed inside the scene's rendering, with its viewport and scissor set.
+	void beginSceneSecondary(VkCommandBuffer cmd, VkCommandBufferUsageFlags flags) const;
+	// Binds the descriptors, and the vertex pipeline's index buffer and push constants when drawing without meshlets.
+	void bindSceneState(VkCommandBuffer cmd, const FrameResources& frame, scvk::DrawBindCounts& binds) const;
+	// Binds the meshlet or mesh pipeline for pass and draw class.
+	void bindMeshPipeline(VkCommandBuffer cmd, MeshPass pass, bool bMasked, scvk::DrawBindCounts& binds) const;
+	// Records draws [first, first + count) of mDrawOrder one call each, with the meshlet or the vertex pipeline's
+	// pipelines for pass and levels of detail selected for viewer. Pipelines and push constants are only set where they
+	// change from the draw before. Positions wrap around mDrawOrder, so synthetic scenes can reuse its draws. Returns the triangles.
+	uint64_t recordDrawRange(VkCommandBuffer cmd, uint32_t first, uint32_t count, const glm::vec3& viewer, float projectionScale, MeshPass pass, scvk::DrawBindCounts& binds) const;
+	// Splits draws [0, drawCount) into workerCount contiguous ranges, recorded by pool into frame's worker command buffers:
+	// the first workerCount for the only pass, or for the depth pre-pass and the workerCount from mRecordingPool.size() on for
+	// the shading pass after it. Returns the triangles.
+	uint64_t recordDrawsInParallel(FrameResources& frame, scvk::ThreadPool& pool, uint32_t workerCount, uint32_t drawCount, const glm::vec3& viewer, float projectionScale, scvk::DrawBindCounts& binds);
+	void benchmarkRecording();
+	// Records the vertex pipeline's scene draws, twice with the depth pre-pass: the draws of drawList when GPU culling wrote
+	// one, otherwise every draw, with levels of detail selected for viewer when drawn one call each. Returns the triangles
+	// of per-call draws.
+	uint64_t recordMeshDraws(VkCommandBuffer cmd, const FrameResources& frame, const scvk::Buffer* drawList, const glm::vec3& viewer, float projectionScale, scvk::DrawBindCounts& binds);
+	void recordSceneCommands(FrameResources& frame);
+
 	void createSwapchain(uint32_t width, uint32_t height);
 	void destroySwapchain();
 	
@@ -115,26 +301,25 @@ private:
 	VkPhysicalDevice			mPhysicalDevice;
 	VkDevice					mDevice;
 	VkDebugUtilsMessengerEXT	mDebugMessenger;
+	float						mTimestampPeriod;	// Nanoseconds per timestamp tick.
 	VkQueue						mGraphicsQueue;
 	uint32_t					mGraphicsQueueFamily;
+	VkQueue						mTransferQueue;			// Same as mGraphicsQueue when there is no separate transfer queue.
+	uint32_t					mTransferQueueFamily;
 	VmaAllocator				mVmaAllocator;
 
-	// immediate submit structures
-	//-----------------------------------------------
-	VkFence						mImmFence;
-	VkCommandBuffer				mImmCommandBuffer;
-	VkCommandPool				mImmCommandPool;
-
-	// Descriptors
-	//-----------------------------------------------
-	DescriptorAllocator			mGlobalDescriptorAllocator;
-
 	// Pipeline Data
 	//-----------------------------------------------
 	VkShaderModule		mVertexShader;
 	VkShaderModule		mFragmentShader;
-	VkPipeline			mMeshPipeline;
+	std::array<std::array<VkPipeline, 2>, 3>	mMeshPipelines;	// Indexed by MeshPass, then by whether draws are alpha masked.
 	VkPipelineLayout	mMeshPipelineLayout;
+	std::array<std::array<VkPipeline, 2>, 3>	mMeshletPipelines{};	// As mMeshPipelines, with task and mesh shaders. Only created when bUseMeshShaders.
+	VkPipelineLayout	mMeshletPipelineLayout{ VK_NULL_HANDLE };
+	std::array<VkPipeline, 3>	mCullPipelines;		// Indexed by CullPass.
+	VkPipelineLayout	mCullPipelineLayout;
+	VkPipeline			mDepthReducePipeline;
+	VkPipelineLayout	mDepthReducePipelineLayout;
 	
 	//-----------------------------------------------
 	struct DeletionQueue
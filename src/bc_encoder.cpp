@@ -0,0 +1,580 @@
+#include "bc_encoder.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCVK_BC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace scvk::bc
+{
+	namespace
+	{
+		// A 4x4 block with its channels split into separate arrays, so that four texels are processed per SIMD instruction.
+		struct Block
+		{
+			alignas(16) float mChannels[4][16];
+		};
+
+		Block loadBlock(const uint8_t* rgba)
+		{
+			Block block;
+			for (int t = 0; t < 16; ++t) {
+				for (int c = 0; c < 4; ++c) {
+					block.mChannels[c][t] = rgba[t * 4 + c];
+				}
+			}
+			return block;
+		}
+
+		// For every texel, finds the closest palette entry over channels [firstChannel, firstChannel + channelCount).
+		// Returns the summed squared error of the block.
+		float selectIndices(const Block& block, const float (*palette)[4], int paletteSize, int firstChannel, int channelCount, uint8_t indices[16])
+		{
+#if SCVK_BC_SSE2
+			__m128 totalError = _mm_setzero_ps();
+			for (int t = 0; t < 16; t += 4) {
+				__m128 bestError = _mm_set1_ps(FLT_MAX);
+				__m128i bestIndex = _mm_setzero_si128();
+				for (int p = 0; p < paletteSize; ++p) {
+					__m128 error = _mm_setzero_ps();
+					for (int c = firstChannel; c < firstChannel + channelCount; ++c) {
+						const __m128 d = _mm_sub_ps(_mm_load_ps(&block.mChannels[c][t]), _mm_set1_ps(palette[p][c]));
+						error = _mm_add_ps(error, _mm_mul_ps(d, d));
+					}
+					const __m128i better = _mm_castps_si128(_mm_cmplt_ps(error, bestError));
+					bestError = _mm_min_ps(error, bestError);
+					bestIndex = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi32(p)), _mm_andnot_si128(better, bestIndex));
+				}
+				totalError = _mm_add_ps(totalError, bestError);
+
+				alignas(16) int32_t lanes[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(lanes), bestIndex);
+				for (int i = 0; i < 4; ++i) {
+					indices[t + i] = static_cast<uint8_t>(lanes[i]);
+				}
+			}
+			alignas(16) float errors[4];
+			_mm_store_ps(errors, totalError);
+			return errors[0] + errors[1] + errors[2] + errors[3];
+#else
+			float totalError = 0.f;
+			for (int t = 0; t < 16; ++t) {
+				float bestError = FLT_MAX;
+				for (int p = 0; p < paletteSize; ++p) {
+					float error = 0.f;
+					for (int c = firstChannel; c < firstChannel + channelCount; ++c) {
+						const float d = block.mChannels[c][t] - palette[p][c];
+						error += d * d;
+					}
+					if (error < bestError) {
+						bestError = error;
+						indices[t] = static_cast<uint8_t>(p);
+					}
+				}
+				totalError += bestError;
+			}
+			return totalError;
+#endif
+		}
+
+		// Fits a line through the texels along their principal axis, and returns its two extreme points clamped to [0, 255].
+		void fitEndpoints(const Block& block, int channelCount, float e0[4], float e1[4])
+		{
+			float mean[4] = {};
+			for (int c = 0; c < channelCount; ++c) {
+				for (int t = 0; t < 16; ++t) {
+					mean[c] += block.mChannels[c][t];
+				}
+				mean[c] /= 16.f;
+			}
+
+			float covariance[4][4] = {};
+			float minimum[4] = { 255.f, 255.f, 255.f, 255.f };
+			float maximum[4] = {};
+			for (int t = 0; t < 16; ++t) {
+				for (int i = 0; i < channelCount; ++i) {
+					const float di = block.mChannels[i][t] - mean[i];
+					for (int j = 0; j < channelCount; ++j) {
+						covariance[i][j] += di * (block.mChannels[j][t] - mean[j]);
+					}
+					minimum[i] = std::min(minimum[i], block.mChannels[i][t]);
+					maximum[i] = std::max(maximum[i], block.mChannels[i][t]);
+				}
+			}
+
+			// Power iteration, starting from the diagonal of the bounding box.
+			float axis[4] = {};
+			for (int c = 0; c < channelCount; ++c) {
+				axis[c] = maximum[c] - minimum[c];
+			}
+			for (int iteration = 0; iteration < 8; ++iteration) {
+				float next[4] = {};
+				float largest = 0.f;
+				for (int i = 0; i < channelCount; ++i) {
+					for (int j = 0; j < channelCount; ++j) {
+						next[i] += covariance[i][j] * axis[j];
+					}
+					largest = std::max(largest, std::abs(next[i]));
+				}
+				if (largest < 1e-6f) {
+					break;
+				}
+				for (int c = 0; c < channelCount; ++c) {
+					axis[c] = next[c] / largest;
+				}
+			}
+			float length = 0.f;
+			for (int c = 0; c < channelCount; ++c) {
+				length += axis[c] * axis[c];
+			}
+			length = std::sqrt(length);
+			if (length > 1e-6f) {
+				for (int c = 0; c < channelCount; ++c) {
+					axis[c] /= length;
+				}
+			}
+
+			float tMin = 0.f;
+			float tMax = 0.f;
+			for (int t = 0; t < 16; ++t) {
+				float projection = 0.f;
+				for (int c = 0; c < channelCount; ++c) {
+					projection += (block.mChannels[c][t] - mean[c]) * axis[c];
+				}
+				tMin = std::min(tMin, projection);
+				tMax = std::max(tMax, projection);
+			}
+
+			for (int c = 0; c < 4; ++c) {
+				e0[c] = c < channelCount ? std::clamp(mean[c] + axis[c] * tMin, 0.f, 255.f) : 255.f;
+				e1[c] = c < channelCount ? std::clamp(mean[c] + axis[c] * tMax, 0.f, 255.f) : 255.f;
+			}
+		}
+
+		// Least-squares fit of both endpoints to the texels, given the interpolation weight (0 = e0, 1 = e1) of every texel.
+		// Returns false when the weights do not constrain both endpoints.
+		bool refineEndpoints(const Block& block, int channelCount, const float weights[16], float e0[4], float e1[4])
+		{
+			float aa = 0.f, ab = 0.f, bb = 0.f;
+			float ax[4] = {}, bx[4] = {};
+			for (int t = 0; t < 16; ++t) {
+				const float b = weights[t];
+				const float a = 1.f - b;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (int c = 0; c < channelCount; ++c) {
+					ax[c] += a * block.mChannels[c][t];
+					bx[c] += b * block.mChannels[c][t];
+				}
+			}
+			const float determinant = aa * bb - ab * ab;
+			if (std::abs(determinant) < 1e-6f) {
+				return false;
+			}
+			for (int c = 0; c < channelCount; ++c) {
+				e0[c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.f, 255.f);
+				e1[c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.f, 255.f);
+			}
+			return true;
+		}
+
+		// Little-endian bit writer for a 128-bit block.
+		struct BitWriter
+		{
+			uint64_t	mBits[2] = {};
+			int			mPosition = 0;
+
+			void write(uint32_t value, int count)
+			{
+				for (int i = 0; i < count; ++i, ++mPosition) {
+					mBits[mPosition / 64] |= uint64_t((value >> i) & 1) << (mPosition % 64);
+				}
+			}
+		};
+
+		// BC1 ================================================================
+
+		uint16_t quantize565(const float color[4])
+		{
+			const uint32_t r = static_cast<uint32_t>(std::lround(color[0] * 31.f / 255.f));
+			const uint32_t g = static_cast<uint32_t>(std::lround(color[1] * 63.f / 255.f));
+			const uint32_t b = static_cast<uint32_t>(std::lround(color[2] * 31.f / 255.f));
+			return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+		}
+
+		void unquantize565(uint16_t value, float color[4])
+		{
+			const uint32_t r = (value >> 11) & 31;
+			const uint32_t g = (value >> 5) & 63;
+			const uint32_t b = value & 31;
+			color[0] = static_cast<float>((r << 3) | (r >> 2));
+			color[1] = static_cast<float>((g << 2) | (g >> 4));
+			color[2] = static_cast<float>((b << 3) | (b >> 2));
+			color[3] = 255.f;
+		}
+
+		// Quantizes the endpoints, orders them for four-color mode and picks the indices. Returns the block's squared error.
+		float encodeBC1Endpoints(const Block& block, const float e0[4], const float e1[4], uint16_t& c0, uint16_t& c1, uint8_t indices[16])
+		{
+			c0 = quantize565(e0);
+			c1 = quantize565(e1);
+			// Four-color mode requires c0 > c1. Equal endpoints would select the three-color mode, so only index 0 may be used.
+			if (c0 < c1) {
+				std::swap(c0, c1);
+			}
+
+			float palette[4][4];
+			unquantize565(c0, palette[0]);
+			unquantize565(c1, palette[1]);
+			for (int c = 0; c < 4; ++c) {
+				palette[2][c] = (2.f * palette[0][c] + palette[1][c]) / 3.f;
+				palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) / 3.f;
+			}
+			return selectIndices(block, palette, c0 == c1 ? 1 : 4, 0, 3, indices);
+		}
+
+		// BC4 ================================================================
+
+		// Encodes one channel of the block as a BC4 block of 8 bytes.
+		void encodeBC4(const Block& block, int channel, uint8_t* out)
+		{
+			float minimum = 255.f;
+			float maximum = 0.f;
+			for (int t = 0; t < 16; ++t) {
+				minimum = std::min(minimum, block.mChannels[channel][t]);
+				maximum = std::max(maximum, block.mChannels[channel][t]);
+			}
+
+			// With red0 > red1 the palette holds both endpoints and six interpolated values.
+			const uint8_t red0 = static_cast<uint8_t>(maximum);
+			const uint8_t red1 = static_cast<uint8_t>(minimum);
+			float palette[8][4] = {};
+			palette[0][channel] = red0;
+			palette[1][channel] = red1;
+			for (int i = 2; i < 8; ++i) {
+				palette[i][channel] = ((8 - i) * float(red0) + (i - 1) * float(red1)) / 7.f;
+			}
+
+			uint8_t indices[16] = {};
+			if (red0 > red1) {
+				selectIndices(block, palette, 8, channel, 1, indices);
+			}
+
+			out[0] = red0;
+			out[1] = red1;
+			uint64_t bits = 0;
+			for (int t = 0; t < 16; ++t) {
+				bits |= uint64_t(indices[t]) << (3 * t);
+			}
+			for (int i = 0; i < 6; ++i) {
+				out[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+			}
+		}
+
+		// BC7 ================================================================
+
+		constexpr int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		// Quantizes an endpoint to 7 bits per channel plus a shared p-bit, keeping whichever p-bit is closer.
+		void quantizeBC7Endpoint(const float endpoint[4], uint8_t quantized[4], uint8_t& pBit)
+		{
+			float bestError = FLT_MAX;
+			for (uint8_t p = 0; p < 2; ++p) {
+				uint8_t candidate[4];
+				float error = 0.f;
+				for (int c = 0; c < 4; ++c) {
+					const int value = std::clamp(static_cast<int>(std::lround((endpoint[c] - p) / 2.f)), 0, 127);
+					candidate[c] = static_cast<uint8_t>(value);
+					const float d = float((value << 1) | p) - endpoint[c];
+					error += d * d;
+				}
+				if (error < bestError) {
+					bestError = error;
+					pBit = p;
+					memcpy(quantized, candidate, 4);
+				}
+			}
+		}
+
+		float encodeBC7Endpoints(const Block& block, const float e0[4], const float e1[4], uint8_t q0[4], uint8_t q1[4], uint8_t& p0, uint8_t& p1, uint8_t indices[16])
+		{
+			quantizeBC7Endpoint(e0, q0, p0);
+			quantizeBC7Endpoint(e1, q1, p1);
+
+			float palette[16][4];
+			for (int i = 0; i < 16; ++i) {
+				for (int c = 0; c < 4; ++c) {
+					const int a = (q0[c] << 1) | p0;
+					const int b = (q1[c] << 1) | p1;
+					palette[i][c] = static_cast<float>(((64 - BC7_WEIGHTS4[i]) * a + BC7_WEIGHTS4[i] * b + 32) >> 6);
+				}
+			}
+			return selectIndices(block, palette, 16, 0, 4, indices);
+		}
+
+		// Mip generation =====================================================
+
+		float srgbToLinear(float value)
+		{
+			value /= 255.f;
+			return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+		}
+
+		uint8_t linearToSrgb(float value)
+		{
+			value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+			return static_cast<uint8_t>(std::clamp(std::lround(value * 255.f), 0l, 255l));
+		}
+
+		// Halves an RGBA8 image with a 2x2 box filter. Base color is filtered in linear space and normals are renormalized.
+		std::vector<uint8_t> downsample(const uint8_t* src, uint32_t width, uint32_t height, TextureRole role)
+		{
+			static const auto srgbTable = []() {
+				std::array<float, 256> table;
+				for (int i = 0; i < 256; ++i) {
+					table[i] = srgbToLinear(float(i));
+				}
+				return table;
+			}();
+
+			const uint32_t dstWidth = std::max(width / 2, 1u);
+			const uint32_t dstHeight = std::max(height / 2, 1u);
+			std::vector<uint8_t> dst(size_t(dstWidth) * dstHeight * 4);
+
+			for (uint32_t y = 0; y < dstHeight; ++y) {
+				for (uint32_t x = 0; x < dstWidth; ++x) {
+					const uint32_t x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+					const uint32_t y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+					const uint8_t* taps[4] = {
+						src + (size_t(y0) * width + x0) * 4, src + (size_t(y0) * width + x1) * 4,
+						src + (size_t(y1) * width + x0) * 4, src + (size_t(y1) * width + x1) * 4,
+					};
+					uint8_t* out = &dst[(size_t(y) * dstWidth + x) * 4];
+
+					float sum[4] = {};
+					for (const uint8_t* tap : taps) {
+						for (int c = 0; c < 4; ++c) {
+							if (role == TextureRole::BaseColor && c < 3) {
+								sum[c] += srgbTable[tap[c]];
+							}
+							else if (role == TextureRole::Normal && c < 3) {
+								sum[c] += tap[c] / 127.5f - 1.f;
+							}
+							else {
+								sum[c] += tap[c];
+							}
+						}
+					}
+
+					if (role == TextureRole::BaseColor) {
+						for (int c = 0; c < 3; ++c) {
+							out[c] = linearToSrgb(sum[c] / 4.f);
+						}
+					}
+					else if (role == TextureRole::Normal) {
+						const float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+						for (int c = 0; c < 3; ++c) {
+							const float n = length > 1e-6f ? sum[c] / length : (c == 2 ? 1.f : 0.f);
+							out[c] = static_cast<uint8_t>(std::clamp(std::lround((n + 1.f) * 127.5f), 0l, 255l));
+						}
+					}
+					else {
+						for (int c = 0; c < 3; ++c) {
+							out[c] = static_cast<uint8_t>(std::lround(sum[c] / 4.f));
+						}
+					}
+					out[3] = static_cast<uint8_t>(std::lround(sum[3] / 4.f));
+				}
+			}
+			return dst;
+		}
+
+		// Encodes one RGBA8 level block by block. Texels past the edge of the image repeat the last row/column.
+		void encodeLevel(const uint8_t* rgba, uint32_t width, uint32_t height, TextureRole role, uint8_t* out)
+		{
+			const uint32_t blocksX = (width + 3) / 4;
+			const uint32_t blocksY = (height + 3) / 4;
+			const size_t blockBytes = role == TextureRole::Data ? 8 : 16;
+
+			uint8_t texels[16 * 4];
+			for (uint32_t by = 0; by < blocksY; ++by) {
+				for (uint32_t bx = 0; bx < blocksX; ++bx) {
+					for (uint32_t t = 0; t < 16; ++t) {
+						const uint32_t x = std::min(bx * 4 + t % 4, width - 1);
+						const uint32_t y = std::min(by * 4 + t / 4, height - 1);
+						memcpy(&texels[t * 4], &rgba[(size_t(y) * width + x) * 4], 4);
+					}
+
+					uint8_t* block = out + (size_t(by) * blocksX + bx) * blockBytes;
+					switch (role) {
+					case TextureRole::BaseColor:	encodeBlockBC7(texels, block); break;
+					case TextureRole::Normal:		encodeBlockBC5(texels, block); break;
+					case TextureRole::Data:			encodeBlockBC1(texels, block); break;
+					}
+				}
+			}
+		}
+	}
+
+	void encodeBlockBC1(const uint8_t* rgba, uint8_t* out)
+	{
+		const Block block = loadBlock(rgba);
+
+		float e0[4], e1[4];
+		fitEndpoints(block, 3, e0, e1);
+
+		uint16_t c0, c1;
+		uint8_t indices[16];
+		float error = encodeBC1Endpoints(block, e0, e1, c0, c1, indices);
+
+		// One least-squares refinement using the weights implied by the chosen indices.
+		if (c0 != c1) {
+			constexpr float weightOf[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+			float weights[16];
+			for (int t = 0; t < 16; ++t) {
+				weights[t] = weightOf[indices[t]];
+			}
+			float r0[4], r1[4];
+			unquantize565(c0, r0);
+			unquantize565(c1, r1);
+			if (refineEndpoints(block, 3, weights, r0, r1)) {
+				uint16_t refined0, refined1;
+				uint8_t refinedIndices[16];
+				const float refinedError = encodeBC1Endpoints(block, r0, r1, refined0, refined1, refinedIndices);
+				if (refinedError < error) {
+					error = refinedError;
+					c0 = refined0;
+					c1 = refined1;
+					memcpy(indices, refinedIndices, sizeof(indices));
+				}
+			}
+		}
+
+		uint32_t bits = 0;
+		for (int t = 0; t < 16; ++t) {
+			bits |= uint32_t(indices[t]) << (2 * t);
+		}
+		out[0] = static_cast<uint8_t>(c0);
+		out[1] = static_cast<uint8_t>(c0 >> 8);
+		out[2] = static_cast<uint8_t>(c1);
+		out[3] = static_cast<uint8_t>(c1 >> 8);
+		for (int i = 0; i < 4; ++i) {
+			out[4 + i] = static_cast<uint8_t>(bits >> (8 * i));
+		}
+	}
+
+	void encodeBlockBC5(const uint8_t* rgba, uint8_t* out)
+	{
+		const Block block = loadBlock(rgba);
+		encodeBC4(block, 0, out);
+		encodeBC4(block, 1, out + 8);
+	}
+
+	void encodeBlockBC7(const uint8_t* rgba, uint8_t* out)
+	{
+		const Block block = loadBlock(rgba);
+
+		float e0[4], e1[4];
+		fitEndpoints(block, 4, e0, e1);
+
+		uint8_t q0[4], q1[4], p0, p1;
+		uint8_t indices[16];
+		const float error = encodeBC7Endpoints(block, e0, e1, q0, q1, p0, p1, indices);
+
+		// One least-squares refinement using the weights implied by the chosen indices.
+		float weights[16];
+		for (int t = 0; t < 16; ++t) {
+			weights[t] = BC7_WEIGHTS4[indices[t]] / 64.f;
+		}
+		if (refineEndpoints(block, 4, weights, e0, e1)) {
+			uint8_t refined0[4], refined1[4], refinedP0, refinedP1;
+			uint8_t refinedIndices[16];
+			const float refinedError = encodeBC7Endpoints(block, e0, e1, refined0, refined1, refinedP0, refinedP1, refinedIndices);
+			if (refinedError < error) {
+				memcpy(q0, refined0, 4);
+				memcpy(q1, refined1, 4);
+				p0 = refinedP0;
+				p1 = refinedP1;
+				memcpy(indices, refinedIndices, sizeof(indices));
+			}
+		}
+
+		// The anchor texel's index is stored without its top bit, so it must be below 8. Swap the endpoints if it is not.
+		if (indices[0] & 8) {
+			for (int c = 0; c < 4; ++c) {
+				std::swap(q0[c], q1[c]);
+			}
+			std::swap(p0, p1);
+			for (int t = 0; t < 16; ++t) {
+				indices[t] = static_cast<uint8_t>(15 - indices[t]);
+			}
+		}
+
+		// Mode 6: one subset, RGBA endpoints with 7 bits per channel plus a p-bit each, and 4-bit indices.
+		BitWriter writer;
+		writer.write(1u << 6, 7);
+		for (int c = 0; c < 4; ++c) {
+			writer.write(q0[c], 7);
+			writer.write(q1[c], 7);
+		}
+		writer.write(p0, 1);
+		writer.write(p1, 1);
+		writer.write(indices[0], 3);
+		for (int t = 1; t < 16; ++t) {
+			writer.write(indices[t], 4);
+		}
+		memcpy(out, writer.mBits, 16);
+	}
+
+	VkFormat compressedFormat(TextureRole role)
+	{
+		switch (role) {
+		case TextureRole::BaseColor:	return VK_FORMAT_BC7_SRGB_BLOCK;
+		case TextureRole::Normal:		return VK_FORMAT_BC5_UNORM_BLOCK;
+		case TextureRole::Data:			return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+		}
+		return VK_FORMAT_UNDEFINED;
+	}
+
+	TextureData compressTexture(const uint8_t* rgba, uint32_t width, uint32_t height, TextureRole role)
+	{
+		TextureData data;
+		data.mFormat = compressedFormat(role);
+		data.mWidth = width;
+		data.mHeight = height;
+
+		// Lay out every level of the chain, down to 1x1.
+		const size_t blockBytes = role == TextureRole::Data ? 8 : 16;
+		size_t totalSize = 0;
+		for (uint32_t w = width, h = height;; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u)) {
+			const size_t size = size_t((w + 3) / 4) * ((h + 3) / 4) * blockBytes;
+			data.mLevels.push_back({ .mWidth = w, .mHeight = h, .mOffset = totalSize, .mSize = size });
+			totalSize += size;
+			if (w == 1 && h == 1) {
+				break;
+			}
+		}
+
+		auto storage = std::make_shared<std::vector<uint8_t>>(totalSize);
+
+		std::vector<uint8_t> level;
+		const uint8_t* pixels = rgba;
+		for (size_t i = 0; i < data.mLevels.size(); ++i) {
+			const TextureLevel& dst = data.mLevels[i];
+			if (i > 0) {
+				level = downsample(pixels, data.mLevels[i - 1].mWidth, data.mLevels[i - 1].mHeight, role);
+				pixels = level.data();
+			}
+			encodeLevel(pixels, dst.mWidth, dst.mHeight, role, storage->data() + dst.mOffset);
+		}
+
+		data.mBytes = std::span<const uint8_t>(storage->data(), storage->size());
+		data.mOwner = std::move(storage);
+		return data;
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "texture.h"
+
+// CPU encoder for the BC1, BC5 and BC7 block-compressed formats.
+namespace scvk::bc
+{
+	// Block encoders. Each one reads a 4x4 block of RGBA8 texels (16 texels, row-major) and writes a single compressed block.
+	void encodeBlockBC1(const uint8_t* rgba, uint8_t* out);		// 8 bytes, RGB.
+	void encodeBlockBC5(const uint8_t* rgba, uint8_t* out);		// 16 bytes, RG.
+	void encodeBlockBC7(const uint8_t* rgba, uint8_t* out);		// 16 bytes, RGBA (mode 6).
+
+	// The block format textures of the given role are compressed to.
+	VkFormat compressedFormat(TextureRole role);
+
+	// Builds the full mip chain of an RGBA8 image on the CPU and compresses every level to compressedFormat(role).
+	// Runs on the calling thread; callers spread whole textures across worker threads.
+	TextureData compressTexture(const uint8_t* rgba, uint32_t width, uint32_t height, TextureRole role);
+
+	// Bumped whenever the encoder output changes, so stale cache entries are not reused.
+	constexpr uint32_t ENCODER_VERSION = 1;
+}
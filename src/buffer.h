@@ -10,7 +10,7 @@ namespace scvk
         VkBuffer			mBuffer;
         VmaAllocation		mAllocation;
 		VmaAllocationInfo	mAllocInfo;
-		uint32_t			mSizeBytes;
+		VkDeviceSize		mSizeBytes;
     };
 
     //Buffer createBuffer(uint32_t byteSize, VkBufferUsageFlags flags)
@@ -41,10 +41,11 @@ namespace scvk
 		return vkGetBufferDeviceAddress(device, &addressInfo);
 	}
 
-	inline Buffer createHostVisibleStagingBuffer(VmaAllocator allocator, uint32_t size_bytes,
+	inline Buffer createHostVisibleStagingBuffer(VmaAllocator allocator, VkDeviceSize size_bytes,
 		VkBufferUsageFlags usage = 0, VkMemoryPropertyFlags alloc_flags = 0)
 	{
 		Buffer buf;
+		buf.mSizeBytes = size_bytes;
 		VkBufferCreateInfo createInfo{
 			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 			.size			= size_bytes,
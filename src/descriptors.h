@@ -69,7 +69,7 @@ inline VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice device, VkS
     VkDescriptorSetLayoutCreateInfo info = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
     info.pNext = pNext;
     info.pBindings = bindings.data();
-    info.bindingCount = std::accumulate(bindings.cbegin(), bindings.cend(), 0u, [](uint32_t sum, VkDescriptorSetLayoutBinding b) {return sum + b.descriptorCount;});
+    info.bindingCount = static_cast<uint32_t>(bindings.size());
     info.flags = flags;
 
     VkDescriptorSetLayout set;
@@ -0,0 +1,53 @@
+#include "draw_sort.h"
+
+#include <array>
+#include <numeric>
+
+namespace scvk
+{
+	std::span<const uint32_t> DrawSorter::sort(std::span<const uint64_t> keys)
+	{
+		const size_t count = keys.size();
+		mKeys.assign(keys.begin(), keys.end());
+		mKeyScratch.resize(count);
+		mOrder.resize(count);
+		mOrderScratch.resize(count);
+		std::iota(mOrder.begin(), mOrder.end(), 0u);
+		if (count == 0) {
+			return mOrder;
+		}
+
+		// Passes only move keys around, so the histograms of every byte are gathered in a single read of the keys.
+		std::array<std::array<uint32_t, 256>, sizeof(uint64_t)> histograms{};
+		for (const uint64_t key : mKeys) {
+			for (uint32_t digit = 0; digit < histograms.size(); ++digit) {
+				++histograms[digit][(key >> (digit * 8)) & 0xff];
+			}
+		}
+
+		for (uint32_t digit = 0; digit < histograms.size(); ++digit)
+		{
+			// A byte every key shares leaves the order as it is, which skips the constant fields of the keys.
+			std::array<uint32_t, 256>& histogram = histograms[digit];
+			const uint32_t shift = digit * 8;
+			if (histogram[(mKeys[0] >> shift) & 0xff] == count) {
+				continue;
+			}
+
+			uint32_t offset = 0;
+			for (uint32_t& bucket : histogram) {
+				const uint32_t size = bucket;
+				bucket = offset;
+				offset += size;
+			}
+			for (size_t i = 0; i < count; ++i) {
+				const uint32_t slot = histogram[(mKeys[i] >> shift) & 0xff]++;
+				mKeyScratch[slot] = mKeys[i];
+				mOrderScratch[slot] = mOrder[i];
+			}
+			std::swap(mKeys, mKeyScratch);
+			std::swap(mOrder, mOrderScratch);
+		}
+		return mOrder;
+	}
+}
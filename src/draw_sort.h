@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Draw ordering by sort keys, so draws sharing state are recorded next to each other and opaque geometry front to back.
+namespace scvk
+{
+	// Fields of a draw sort key, most significant first: sorting the keys groups draws by pipeline, then by material,
+	// then orders them by depth.
+	constexpr uint32_t SORT_KEY_PIPELINE_BITS = 8;
+	constexpr uint32_t SORT_KEY_MATERIAL_BITS = 24;
+	constexpr uint32_t SORT_KEY_DEPTH_BITS = 32;
+	static_assert(SORT_KEY_PIPELINE_BITS + SORT_KEY_MATERIAL_BITS + SORT_KEY_DEPTH_BITS == 64);
+
+	// depth is clamped to [0, 1] and quantized to SORT_KEY_DEPTH_BITS, 0 sorting first.
+	inline uint64_t makeDrawSortKey(uint32_t pipeline, uint32_t material, float depth)
+	{
+		constexpr uint64_t materialMask = (uint64_t(1) << SORT_KEY_MATERIAL_BITS) - 1;
+		const uint64_t quantizedDepth = static_cast<uint64_t>(std::clamp(depth, 0.f, 1.f) * double(UINT32_MAX));
+		return uint64_t(pipeline) << (SORT_KEY_MATERIAL_BITS + SORT_KEY_DEPTH_BITS) | (material & materialMask) << SORT_KEY_DEPTH_BITS | quantizedDepth;
+	}
+
+	// Sorts 64-bit keys with a least significant digit radix sort over bytes. The buffers are kept between calls, so
+	// sorting the same number of draws every frame does not allocate.
+	class DrawSorter
+	{
+	public:
+
+		// Returns the indices of keys in ascending key order. Equal keys keep their relative order. Valid until the next call.
+		std::span<const uint32_t> sort(std::span<const uint64_t> keys);
+
+	private:
+
+		std::vector<uint64_t>	mKeys;
+		std::vector<uint64_t>	mKeyScratch;
+		std::vector<uint32_t>	mOrder;
+		std::vector<uint32_t>	mOrderScratch;
+	};
+
+	// State set while recording draws, counted per frame.
+	struct DrawBindCounts
+	{
+		uint32_t mPipelineBinds{ 0 };
+		uint32_t mDescriptorSetBinds{ 0 };
+		uint32_t mMaterialChanges{ 0 };		// Draws whose texture differs from the draw recorded before them.
+		uint32_t mTransformChanges{ 0 };	// Meshlet draws of another instance than the draw before them, which push its world matrix.
+
+		DrawBindCounts& operator+=(const DrawBindCounts& other)
+		{
+			mPipelineBinds += other.mPipelineBinds;
+			mDescriptorSetBinds += other.mDescriptorSetBinds;
+			mMaterialChanges += other.mMaterialChanges;
+			mTransformChanges += other.mTransformChanges;
+			return *this;
+		}
+	};
+}
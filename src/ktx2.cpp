@@ -0,0 +1,112 @@
+#include "ktx2.h"
+
+#include <cstring>
+
+namespace scvk::ktx2
+{
+	namespace
+	{
+		// «KTX 20»\r\n\x1A\n
+		constexpr uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+		struct Header
+		{
+			uint8_t		mIdentifier[12];
+			uint32_t	mVkFormat;
+			uint32_t	mTypeSize;
+			uint32_t	mPixelWidth;
+			uint32_t	mPixelHeight;
+			uint32_t	mPixelDepth;
+			uint32_t	mLayerCount;
+			uint32_t	mFaceCount;
+			uint32_t	mLevelCount;
+			uint32_t	mSupercompressionScheme;
+
+			// Index.
+			uint32_t	mDfdByteOffset;
+			uint32_t	mDfdByteLength;
+			uint32_t	mKvdByteOffset;
+			uint32_t	mKvdByteLength;
+			uint64_t	mSgdByteOffset;
+			uint64_t	mSgdByteLength;
+		};
+		static_assert(sizeof(Header) == HEADER_SIZE);
+
+		struct LevelIndex
+		{
+			uint64_t	mByteOffset;
+			uint64_t	mByteLength;
+			uint64_t	mUncompressedByteLength;
+		};
+	}
+
+	bool isKtx2(std::span<const std::byte> bytes)
+	{
+		return bytes.size() >= sizeof(KTX2_IDENTIFIER) && memcmp(bytes.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0;
+	}
+
+	bool isSupported(std::span<const std::byte> bytes, bool bBlockCompressedFormats)
+	{
+		Header header;
+		if (!isKtx2(bytes) || bytes.size() < sizeof(header)) {
+			return false;
+		}
+		memcpy(&header, bytes.data(), sizeof(header));
+		const VkFormat format = static_cast<VkFormat>(header.mVkFormat);
+		return format != VK_FORMAT_UNDEFINED && header.mSupercompressionScheme == 0
+			&& header.mPixelHeight != 0 && header.mPixelDepth == 0 && header.mLayerCount <= 1 && header.mFaceCount == 1
+			&& (bBlockCompressedFormats || !isBlockCompressed(format));
+	}
+
+	TextureData load(std::span<const std::byte> bytes, std::shared_ptr<const void> owner, const std::string& name)
+	{
+		Header header;
+		if (!isKtx2(bytes) || bytes.size() < sizeof(header)) {
+			throw std::runtime_error(fmt::format("'{}' is not a KTX2 file", name));
+		}
+		memcpy(&header, bytes.data(), sizeof(header));
+
+		if (header.mVkFormat == VK_FORMAT_UNDEFINED || header.mSupercompressionScheme != 0) {
+			throw std::runtime_error(fmt::format("KTX2 file '{}' is supercompressed or Basis Universal encoded, which is not supported", name));
+		}
+		if (header.mPixelHeight == 0 || header.mPixelDepth != 0 || header.mLayerCount > 1 || header.mFaceCount != 1) {
+			throw std::runtime_error(fmt::format("KTX2 file '{}' is not a plain 2D texture", name));
+		}
+
+		// A level count of 0 asks the loader to generate the mips, which createTexture does for uncompressed formats.
+		const uint32_t levelCount = std::max(header.mLevelCount, 1u);
+		if (bytes.size() < sizeof(header) + levelCount * sizeof(LevelIndex)) {
+			throw std::runtime_error(fmt::format("KTX2 file '{}' is truncated", name));
+		}
+		std::vector<LevelIndex> levelIndex(levelCount);
+		memcpy(levelIndex.data(), bytes.data() + sizeof(header), levelCount * sizeof(LevelIndex));
+
+		// Levels are stored smallest first after the header and metadata. Only the range spanning them is exposed,
+		// so the upload copies texel data and nothing else.
+		uint64_t begin = bytes.size();
+		uint64_t end = 0;
+		for (const auto& level : levelIndex) {
+			if (level.mByteLength == 0 || level.mByteOffset > bytes.size() || level.mByteLength > bytes.size() - level.mByteOffset) {
+				throw std::runtime_error(fmt::format("KTX2 file '{}' has a level outside the file", name));
+			}
+			begin = std::min(begin, level.mByteOffset);
+			end = std::max(end, level.mByteOffset + level.mByteLength);
+		}
+
+		TextureData data;
+		data.mFormat = static_cast<VkFormat>(header.mVkFormat);
+		data.mWidth = header.mPixelWidth;
+		data.mHeight = header.mPixelHeight;
+		for (uint32_t i = 0; i < levelCount; ++i) {
+			data.mLevels.push_back({
+				.mWidth = std::max(header.mPixelWidth >> i, 1u),
+				.mHeight = std::max(header.mPixelHeight >> i, 1u),
+				.mOffset = static_cast<size_t>(levelIndex[i].mByteOffset - begin),
+				.mSize = static_cast<size_t>(levelIndex[i].mByteLength)
+			});
+		}
+		data.mBytes = std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(bytes.data()) + begin, static_cast<size_t>(end - begin));
+		data.mOwner = std::move(owner);
+		return data;
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "texture.h"
+
+// Reader for KTX2 containers holding textures already in a GPU format.
+namespace scvk::ktx2
+{
+	constexpr size_t HEADER_SIZE = 80;
+
+	// Returns true if bytes start with the KTX2 file identifier.
+	bool isKtx2(std::span<const std::byte> bytes);
+
+	// Returns true if bytes start with the header of a KTX2 file load() accepts, in a format that is not BC compressed
+	// unless bBlockCompressedFormats. Only the first HEADER_SIZE bytes are read.
+	bool isSupported(std::span<const std::byte> bytes, bool bBlockCompressedFormats);
+
+	// Describes the levels of a KTX2 file in place, without copying or decoding any texel data.
+	// The returned TextureData points into bytes and holds owner, so bytes must stay alive for as long as owner does.
+	// Only single-layer, single-face 2D textures without supercompression are supported; anything else throws.
+	TextureData load(std::span<const std::byte> bytes, std::shared_ptr<const void> owner, const std::string& name);
+}
@@ -1,12 +1,87 @@
-﻿#include "app.h"
+#include "app.h"
 
 #include <chrono>
+#include <string_view>
 
 
 
-int main()
+int main(int argc, char* argv[])
 {
     VulkanApp engine;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--bench-texture-decode") {
+            engine.bBenchmarkTextureDecode = true;
+        }
+        else if (arg == "--bench-geometry") {
+            engine.bBenchmarkGeometry = true;
+        }
+        else if (arg == "--no-mipmaps") {
+            engine.bGenerateMipmaps = false;
+        }
+        else if (arg == "--no-texture-compression") {
+            engine.bCompressTextures = false;
+        }
+        else if (arg == "--no-scene-cache") {
+            engine.bUseSceneCache = false;
+        }
+        else if (arg == "--no-texture-streaming") {
+            engine.bStreamTextures = false;
+        }
+        else if (arg == "--stream-budget-mb" && i + 1 < argc) {
+            engine.mStreamingBudgetBytes = std::stoull(argv[++i]) * 1024 * 1024;
+        }
+        else if (arg == "--scene" && i + 1 < argc) {
+            engine.mScenePath = argv[++i];
+        }
+        else if (arg == "--vertex-format" && i + 1 < argc) {
+            const std::string_view format = argv[++i];
+            engine.mVertexFormat = format == "packed" ? VertexFormat::Packed : format == "quantized" ? VertexFormat::Quantized : VertexFormat::Float;
+        }
+        else if (arg == "--no-transfer-queue") {
+            engine.bUseTransferQueue = false;
+        }
+        else if (arg == "--optimize-meshes") {
+            engine.bOptimizeMeshes = true;
+        }
+        else if (arg == "--no-mesh-shaders") {
+            engine.bUseMeshShaders = false;
+        }
+        else if (arg == "--no-lods") {
+            engine.bGenerateLods = false;
+        }
+        else if (arg == "--lod-pixel-error" && i + 1 < argc) {
+            engine.mLodPixelError = std::stof(argv[++i]);
+        }
+        else if (arg == "--no-indirect-draws") {
+            engine.bUseIndirectDraws = false;
+        }
+        else if (arg == "--no-gpu-culling") {
+            engine.bGpuCulling = false;
+        }
+        else if (arg == "--no-occlusion-culling") {
+            engine.bOcclusionCulling = false;
+        }
+        else if (arg == "--no-command-reuse") {
+            engine.bReuseSceneCommands = false;
+        }
+        else if (arg == "--recording-threads" && i + 1 < argc) {
+            engine.mRecordingThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (arg == "--bench-recording") {
+            engine.bBenchmarkRecording = true;
+        }
+        else if (arg == "--no-draw-sorting") {
+            engine.bSortDraws = false;
+        }
+        else if (arg == "--depth-prepass") {
+            engine.bDepthPrepass = true;
+        }
+        else if (arg == "--scene-copies" && i + 1 < argc) {
+            engine.mSceneCopies = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+        }
+    }
     
     engine.init();
     engine.run();
@@ -0,0 +1,100 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace scvk
+{
+#ifdef _WIN32
+	std::shared_ptr<const MappedFile> MappedFile::open(const std::filesystem::path& path)
+	{
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return nullptr;
+		}
+
+		std::shared_ptr<MappedFile> mapped(new MappedFile());
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size)) {
+			CloseHandle(file);
+			return nullptr;
+		}
+		mapped->mSize = static_cast<size_t>(size.QuadPart);
+
+		// Empty files cannot be mapped, but are still valid.
+		if (mapped->mSize > 0) {
+			HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping) {
+				mapped->mData = static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+				mapped->mMapping = mapping;
+			}
+		}
+		// The view keeps the file open.
+		CloseHandle(file);
+
+		if (mapped->mSize > 0 && !mapped->mData) {
+			return nullptr;
+		}
+		return mapped;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (mData) {
+			UnmapViewOfFile(mData);
+		}
+		if (mMapping) {
+			CloseHandle(mMapping);
+		}
+	}
+#else
+	std::shared_ptr<const MappedFile> MappedFile::open(const std::filesystem::path& path)
+	{
+		const int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (file < 0) {
+			return nullptr;
+		}
+
+		std::shared_ptr<MappedFile> mapped(new MappedFile());
+
+		struct stat status;
+		if (fstat(file, &status) != 0) {
+			close(file);
+			return nullptr;
+		}
+		mapped->mSize = static_cast<size_t>(status.st_size);
+
+		// Empty files cannot be mapped, but are still valid.
+		if (mapped->mSize > 0) {
+			void* data = mmap(nullptr, mapped->mSize, PROT_READ, MAP_PRIVATE, file, 0);
+			if (data != MAP_FAILED) {
+				madvise(data, mapped->mSize, MADV_SEQUENTIAL);
+				mapped->mData = static_cast<const std::byte*>(data);
+			}
+		}
+		// The mapping keeps the file open.
+		close(file);
+
+		if (mapped->mSize > 0 && !mapped->mData) {
+			return nullptr;
+		}
+		return mapped;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (mData) {
+			munmap(const_cast<std::byte*>(mData), mSize);
+		}
+	}
+#endif
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vk_types.h>
+
+namespace scvk
+{
+	// A read-only memory map of a whole file. The pages are only read from disk when touched,
+	// so the mapped bytes can be copied straight into staging memory without an intermediate buffer.
+	class MappedFile
+	{
+	public:
+
+		// Returns nullptr if the file cannot be opened or mapped.
+		static std::shared_ptr<const MappedFile> open(const std::filesystem::path& path);
+
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		std::span<const std::byte> bytes() const { return { mData, mSize }; }
+
+	private:
+
+		MappedFile() = default;
+
+		const std::byte*	mData{ nullptr };
+		size_t				mSize{ 0 };
+#ifdef _WIN32
+		void*				mMapping{ nullptr };
+#endif
+	};
+}
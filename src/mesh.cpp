@@ -1 +1,68 @@
 #include "mesh.h"
+
+#include <cmath>
+#include <limits>
+
+glm::vec4 computeBoundingSphere(const LoadedMesh& mesh, const Primitive& primitive)
+{
+	if (primitive.indexCount == 0) {
+		return glm::vec4(0.f);
+	}
+	const std::span<const Vertex> vertices = mesh.vertexData();
+	const std::span<const uint32_t> indices = mesh.indexData().subspan(primitive.firstIndex, primitive.indexCount);
+
+	// Centered on the bounding box, which is at most a little larger than the optimal sphere.
+	glm::vec3 minimum(std::numeric_limits<float>::max());
+	glm::vec3 maximum(-std::numeric_limits<float>::max());
+	for (const uint32_t index : indices) {
+		minimum = glm::min(minimum, vertices[index].position);
+		maximum = glm::max(maximum, vertices[index].position);
+	}
+	const glm::vec3 center = (minimum + maximum) * 0.5f;
+	float radiusSquared = 0.f;
+	for (const uint32_t index : indices) {
+		const glm::vec3 d = vertices[index].position - center;
+		radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+	}
+	return glm::vec4(center, std::sqrt(radiusSquared));
+}
+
+void replicateInstances(LoadedMesh& mesh, uint32_t gridSize)
+{
+	if (gridSize <= 1 || mesh.mInstances.empty()) {
+		return;
+	}
+
+	// Bounds of the vertices in the mesh's space, then of every instance's transformed bounds.
+	glm::vec3 meshMin(std::numeric_limits<float>::max());
+	glm::vec3 meshMax(-std::numeric_limits<float>::max());
+	for (const Vertex& v : mesh.vertexData()) {
+		meshMin = glm::min(meshMin, v.position);
+		meshMax = glm::max(meshMax, v.position);
+	}
+	glm::vec3 sceneMin(std::numeric_limits<float>::max());
+	glm::vec3 sceneMax(-std::numeric_limits<float>::max());
+	for (const MeshInstance& instance : mesh.mInstances) {
+		for (uint32_t corner = 0; corner < 8; ++corner) {
+			const glm::vec3 p = { corner & 1 ? meshMax.x : meshMin.x, corner & 2 ? meshMax.y : meshMin.y, corner & 4 ? meshMax.z : meshMin.z };
+			const glm::vec3 world = glm::vec3(instance.worldMatrix * glm::vec4(p, 1.f));
+			sceneMin = glm::min(sceneMin, world);
+			sceneMax = glm::max(sceneMax, world);
+		}
+	}
+	const glm::vec3 spacing = glm::max(sceneMax - sceneMin, glm::vec3(1.f)) * 1.1f;
+
+	const size_t originalCount = mesh.mInstances.size();
+	mesh.mInstances.reserve(originalCount * gridSize * gridSize);
+	for (uint32_t z = 0; z < gridSize; ++z) {
+		for (uint32_t x = 0; x < gridSize; ++x) {
+			if (x == 0 && z == 0) {
+				continue;
+			}
+			const glm::mat4 offset = glm::translate(glm::mat4(1.f), glm::vec3(x * spacing.x, 0.f, z * spacing.z));
+			for (size_t i = 0; i < originalCount; ++i) {
+				mesh.mInstances.push_back({ .worldMatrix = offset * mesh.mInstances[i].worldMatrix, .meshIndex = mesh.mInstances[i].meshIndex });
+			}
+		}
+	}
+}
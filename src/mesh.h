@@ -2,6 +2,7 @@
 
 #include "buffer.h"
 #include "texture.h"
+#include "uninitialized_vector.h"
 #include "vk_types.h"
 
 
@@ -14,19 +15,153 @@ struct Vertex {
 	glm::vec4 color;
 };
 
+// The layouts vertices can be uploaded in. The values are the vertex shader's VERTEX_FORMAT specialization constant.
+enum class VertexFormat : uint32_t
+{
+	Float,		// Vertex, 48 bytes.
+	Packed,		// PackedVertex, 24 bytes.
+	Quantized,	// QuantizedVertex, 16 bytes.
+};
+
+// Float position, octahedral normal in two snorm16, half-float uv and unorm8 color.
+struct PackedVertex
+{
+	glm::vec3	position;
+	uint32_t	normal;
+	uint32_t	uv;
+	uint32_t	color;
+};
+static_assert(sizeof(PackedVertex) == 24);
+
+// As PackedVertex, but with positions quantized to unorm16 within the bounds of the mesh and the octahedral normal in two snorm8.
+// LoadedMesh::mPositionDequantization maps the unorm positions back into the mesh's space.
+struct QuantizedVertex
+{
+	uint16_t	position[3];
+	uint16_t	normal;
+	uint32_t	uv;
+	uint32_t	color;
+};
+static_assert(sizeof(QuantizedVertex) == 16);
+
+// Limits of the meshlets built for the mesh shading path. 124 triangles rather than 128 leaves room for
+// per-primitive outputs on hardware that allocates them in blocks of 128 bytes.
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+constexpr uint32_t MESHLETS_PER_TASK = 32;	// Meshlets culled by one task shader workgroup. Matches meshlets.inc.
+// A cluster of triangles of one primitive, laid out as the task and mesh shaders read it.
+// Bounds are in the space of the uploaded vertex positions, before LoadedMesh::mPositionDequantization.
+struct Meshlet
+{
+	glm::vec3	center;			// Bounding sphere.
+	float		radius;
+	glm::vec3	coneApex;		// Every triangle faces away from a viewer at v if dot(normalize(coneApex - v), coneAxis) >= coneCutoff.
+	float		coneCutoff;		// Above 1 when the triangles face too many ways for the meshlet to be culled.
+	glm::vec3	coneAxis;
+	uint32_t	vertexOffset;	// Into LoadedMesh::mMeshletVertices.
+	uint32_t	triangleOffset;	// Into LoadedMesh::mMeshletTriangles.
+	uint32_t	vertexCount;
+	uint32_t	triangleCount;
+	uint32_t	padding;
+};
+static_assert(sizeof(Meshlet) == 64);
+
+// The meshlets of a Primitive or of one of its levels of detail: a contiguous range of LoadedMesh::mMeshlets.
+struct MeshletRange
+{
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
 // holds the resources needed for a mesh
 struct GPUMeshBuffers {
 	scvk::Buffer	mIndexBuffer;
 	scvk::Buffer	mVertexBuffer;
 	VkDeviceAddress mVertexBufferAddress;
+
+	// Meshlets, their vertex indices and their triangles, one after the other. Only created for mesh shading.
+	scvk::Buffer	mMeshletBuffer{};
+	VkDeviceAddress	mMeshletAddress{ 0 };
+	VkDeviceAddress	mMeshletVertexAddress{ 0 };
+	VkDeviceAddress	mMeshletTriangleAddress{ 0 };
+};
+
+// What the vertex pipeline needs to draw one primitive of one instance. mesh.vert reads the draw's entry
+// at the draw's firstInstance, so indirect draws need no per-draw state changes.
+struct GPUDrawData {
+	glm::mat4	mWorldMatrix;		// Includes the dequantization of quantized positions.
+	glm::vec4	mBoundingSphere;	// World space center and radius, for culling.
+	uint32_t	mTextureIndex;		// Into the bindless texture array.
+	float		mAlphaCutoff;		// As Primitive::alphaCutoff.
+	uint32_t	padding[2];
 };
+static_assert(sizeof(GPUDrawData) == 96);
 
-// push constants for our mesh object draws
+// push constants for our mesh object draws, pushed once for the whole scene
 struct GPUDrawPushConstants {
-	glm::mat4		mWorldMatrix = glm::mat4(1.f);
 	VkDeviceAddress mVertexBufferAddress;
+	VkDeviceAddress mDrawDataAddress;	// GPUDrawData of every draw.
+};
+
+// The passes over the scene, each with a pipeline for opaque and one for alpha masked draws.
+enum class MeshPass : uint32_t
+{
+	Forward,		// Depth tested and written, and shaded, in one pass.
+	DepthPrepass,	// Depth only. Opaque draws run a position-only vertex shader, or no fragment shader with meshlets.
+	EqualDepth,		// Shaded where the depth pre-pass left the draw's own depth, without depth writes.
+};
+
+// The passes of cull.comp, selected by its CULL_PASS specialization constant.
+enum class CullPass : uint32_t
+{
+	Frustum,	// Frustum culling only.
+	Early,		// Draws visible last frame that are inside the frustum.
+	Late,		// Draws not visible last frame that pass the depth pyramid test. Updates every draw's visibility.
+};
+
+// push constants for the compute pass that culls the scene's draws
+struct CullPushConstants {
+	VkDeviceAddress mDrawDataAddress;
+	VkDeviceAddress mDrawCommandAddress;	// A VkDrawIndexedIndirectCommand per draw.
+	VkDeviceAddress mVisibleDrawAddress;	// Receives a VisibleDrawHeader, then the visible draws' commands from VISIBLE_DRAWS_OFFSET.
+	uint32_t		mDrawCount;
+	VkDeviceAddress mVisibilityAddress;		// A uint32_t per draw, non-zero if it was visible last frame. Early and late passes only.
+	glm::vec2		mPyramidSize;			// Texels in level 0 of the depth pyramid. Late pass only.
+	float			mZNear;
+	uint32_t		mOpaqueDrawCount;		// Draws from this index on are alpha masked.
 };
 
+// The start of a compacted draw list written by cull.comp.
+struct VisibleDrawHeader {
+	uint32_t mCount;
+	uint32_t mOccludedCount;	// Late pass: draws in the frustum, not visible last frame, hidden by the depth pyramid.
+	uint32_t mMaskedCount;		// Alpha masked draws, whose commands start after room for every opaque draw.
+	uint32_t padding;
+};
+constexpr VkDeviceSize VISIBLE_DRAWS_OFFSET = sizeof(VisibleDrawHeader);
+static_assert(VISIBLE_DRAWS_OFFSET == 16);
+
+// push constants for building one level of the depth pyramid
+struct DepthReducePushConstants {
+	glm::vec2 mOutputSize;
+};
+
+// push constants for the meshlets of one primitive of one instance, read by the task and mesh shaders
+struct MeshletDrawPushConstants {
+	glm::mat4		mWorldMatrix = glm::mat4(1.f);	// As GPUDrawData::mWorldMatrix.
+	glm::vec3		mViewerPosition;				// The camera in the space of the vertex positions, for normal cone culling.
+	uint32_t		mTextureIndex;		// As GPUDrawData::mTextureIndex.
+	float			mAlphaCutoff;		// As Primitive::alphaCutoff, pushed with the texture.
+	uint32_t		mPadding;			// Keeps the addresses 8-byte aligned, which the shaders' scalar layout does not.
+	VkDeviceAddress mVertexBufferAddress;
+	VkDeviceAddress mMeshletAddress;
+	VkDeviceAddress mMeshletVertexAddress;
+	VkDeviceAddress mMeshletTriangleAddress;
+	uint32_t		mFirstMeshlet;		// The meshlets of a primitive come last, as they are the only fields pushed for every draw.
+	uint32_t		mMeshletCount;
+};
+static_assert(sizeof(MeshletDrawPushConstants) <= 128);
+
 
 struct Primitive
 {
@@ -34,16 +169,83 @@ struct Primitive
 	uint32_t firstIndex;
 
 	uint32_t textureID;
+	float alphaCutoff;	// Fragments with a lower base color alpha are discarded. 0 for opaque primitives.
+	uint32_t doubleSided;	// Non-zero when the back faces are meant to be seen, so meshlets are not culled for facing away.
+
+	// Index into the scene's textures to draw with. Primitives without a texture use the first one.
+	uint32_t textureIndex() const { return textureID != UINT32_MAX ? textureID : 0; }
+};
+
+// A simplified version of the triangles of a Primitive. Its indices follow the full detail ones in LoadedMesh::mIndices.
+struct PrimitiveLod
+{
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	float error;		// Estimated distance between this level's surface and the full detail one, in the mesh's space.
+};
+
+// The levels of detail of a Primitive, from finest to coarsest, and the bounds used to project their error on screen.
+struct PrimitiveLods
+{
+	glm::vec3 center;	// Bounding sphere of the full detail triangles, in the mesh's space.
+	float radius;
+	uint32_t firstLod;	// Into LoadedMesh::mLods.
+	uint32_t lodCount;	// 0 when the primitive could not be simplified.
+};
+
+// A glTF mesh: a contiguous range of LoadedMesh::mPrimitives.
+struct MeshRange
+{
+	uint32_t firstPrimitive;
+	uint32_t primitiveCount;
+};
+
+// A node of the scene graph that draws a mesh.
+struct MeshInstance
+{
+	glm::mat4 worldMatrix;
+	uint32_t meshIndex;
 };
 
 struct LoadedMesh
 {
 	std::vector<Primitive> mPrimitives;
 
+	// Every mesh's geometry is stored once, however many nodes draw it.
+	std::vector<MeshRange>		mMeshes;
+	std::vector<MeshInstance>	mInstances;
+
+
+	// CPU data, in the layout it is uploaded in. Read it through vertexData() and indexData(): when the mesh
+	// comes from the scene cache the vectors stay empty and the data is mapped from the cache file instead.
+	// Growing them leaves the new elements uninitialized, so loaders write every element exactly once.
+	scvk::UninitializedVector<Vertex>	mVertices;
+	scvk::UninitializedVector<uint32_t>	mIndices;
 
-	// CPU data.
-	std::vector<Vertex>			mVertices;
-	std::vector<uint32_t>		mIndices;
+	std::shared_ptr<const void>	mMappedGeometry;	// Keeps the mapped cache file alive.
+	std::span<const Vertex>		mMappedVertices;
+	std::span<const uint32_t>	mMappedIndices;
+
+	std::span<const Vertex>		vertexData() const { return mMappedGeometry ? mMappedVertices : std::span<const Vertex>(mVertices); }
+	std::span<const uint32_t>	indexData() const { return mMappedGeometry ? mMappedIndices : std::span<const uint32_t>(mIndices); }
+
+	// Levels of detail built by scvk::generateLods(). mPrimitiveLods is indexed like mPrimitives, or empty without LODs.
+	std::vector<PrimitiveLods>	mPrimitiveLods;
+	std::vector<PrimitiveLod>	mLods;
+
+	// The vertices as they are uploaded. Formats other than Float are produced from vertexData() by packVertices().
+	VertexFormat				mVertexFormat{ VertexFormat::Float };
+	std::vector<std::byte>		mPackedVertices;
+	glm::mat4					mPositionDequantization{ 1.f };		// Applied before an instance's world matrix.
+
+	std::span<const std::byte>	gpuVertexData() const { return mVertexFormat == VertexFormat::Float ? std::as_bytes(vertexData()) : std::span<const std::byte>(mPackedVertices); }
+
+	// Meshlets for the mesh shading path, built by scvk::buildMeshlets().
+	std::vector<MeshletRange>	mPrimitiveMeshlets;	// Indexed like mPrimitives.
+	std::vector<MeshletRange>	mLodMeshlets;		// Indexed like mLods.
+	std::vector<Meshlet>		mMeshlets;
+	std::vector<uint32_t>		mMeshletVertices;	// Indices into the vertex buffer.
+	std::vector<uint32_t>		mMeshletTriangles;	// Three 8-bit indices into the meshlet's vertices per triangle.
 
 
 	//std::vector<std::string>	mTexturePaths;
@@ -51,3 +253,10 @@ struct LoadedMesh
 	GPUMeshBuffers mBuffers;
 	std::vector<scvk::Texture>	mTextures;
 };
+
+// Bounding sphere of a primitive's triangles in the mesh's space, as center and radius. Zero for empty primitives.
+glm::vec4 computeBoundingSphere(const LoadedMesh& mesh, const Primitive& primitive);
+
+// Adds copies of the scene's instances on a gridSize x gridSize grid in the XZ plane, spaced by the scene's bounds.
+// Used to stress the renderer with many draws; the geometry itself is shared by every copy.
+void replicateInstances(LoadedMesh& mesh, uint32_t gridSize);
@@ -9,161 +9,673 @@
 #include "vk_types.h"
 #include "stb_image.h"
 
+#include "hash.h"
+#include "ktx2.h"
+#include "mapped_file.h"
 #include "mesh.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "obj_loader.h"
+#include "scene_cache.h"
+#include "strided_conversion.h"
+#include "texture_loader.h"
+#include "thread_pool.h"
+#include "timer.h"
+#include "vertex_packing.h"
+#include "vk_initializers.h"
+
+// Finds where the encoded bytes of a glTF image live. Only reads from the asset, so the result can be handed to worker threads.
+inline scvk::TextureSource getGltfImageSource(const fastgltf::Asset& asset, const fastgltf::Image& gltfImage, const std::filesystem::path& rootPath)
+{
+	scvk::TextureSource source;
+	source.mName = gltfImage.name.c_str();
+	const auto& gltfImageData = gltfImage.data;
+
+	// The image data is stored in an external file, referenced by a URI
+	if (const auto* path = std::get_if<fastgltf::sources::URI>(&gltfImageData)) {
+		assert(path->uri.isLocalPath());
+		assert(path->fileByteOffset == 0);
+
+		source.mPath = rootPath.parent_path() / path->uri.c_str();
+		source.mName = source.mPath.string();
+	}
+	// The image data is stored as a raw array of bytes
+	else if (const auto* array = std::get_if<fastgltf::sources::Array>(&gltfImageData)) {
+		source.mBytes = std::span<const std::byte>(array->bytes.data(), array->bytes.size());
+	}
+	// The image data is stored in a buffer view within the GLTF
+	else if (const auto* bufferView = std::get_if<fastgltf::sources::BufferView>(&gltfImageData)) {
+		auto& bufView = asset.bufferViews[bufferView->bufferViewIndex];
+		auto& buffer = asset.buffers[bufView.bufferIndex];
+
+		if (const auto* vector = std::get_if<fastgltf::sources::Vector>(&buffer.data)) {
+			source.mBytes = std::span<const std::byte>(vector->bytes.data() + bufView.byteOffset, bufView.byteLength);
+		}
+		else if (const auto* array = std::get_if<fastgltf::sources::Array>(&buffer.data)) {
+			source.mBytes = std::span<const std::byte>(array->bytes.data() + bufView.byteOffset, bufView.byteLength);
+		}
+	}
+	else if (std::holds_alternative<fastgltf::sources::ByteView>(gltfImageData)) { throw std::runtime_error("Texture is sourced in byte view\n"); }
+	else if (std::holds_alternative<fastgltf::sources::Vector>(gltfImageData)) { throw std::runtime_error("Texture is sourced in vector\n"); }
+
+	return source;
+}
+
+// Whether source is a KTX2 image the texture loader can use as it is. Only its header is read.
+inline bool isLoadableKtx2(const scvk::TextureSource& source, bool bBlockCompressedFormats)
+{
+	if (source.mPath.empty()) {
+		return scvk::ktx2::isSupported(source.mBytes, bBlockCompressedFormats);
+	}
+	std::array<std::byte, scvk::ktx2::HEADER_SIZE> header{};
+	std::ifstream file(source.mPath, std::ios::binary);
+	file.read(reinterpret_cast<char*>(header.data()), header.size());
+	return scvk::ktx2::isSupported(std::span<const std::byte>(header.data(), static_cast<size_t>(file.gcount())), bBlockCompressedFormats);
+}
+
+// The image a texture samples. KHR_texture_basisu images are usually Basis Universal encoded, which the loader cannot
+// transcode, so one is only taken when its header names a format the loader supports, and the core image otherwise.
+inline scvk::TextureSource getGltfTextureSource(const fastgltf::Asset& asset, const fastgltf::Texture& texture, const std::filesystem::path& rootPath, bool bBlockCompressedFormats)
+{
+	if (texture.basisuImageIndex) {
+		scvk::TextureSource source = getGltfImageSource(asset, asset.images[texture.basisuImageIndex.value()], rootPath);
+		if (isLoadableKtx2(source, bBlockCompressedFormats)) {
+			return source;
+		}
+	}
+	if (!texture.imageIndex) {
+		throw std::runtime_error(fmt::format("Texture '{}' has no image in a supported format", texture.name.c_str()));
+	}
+	return getGltfImageSource(asset, asset.images[texture.imageIndex.value()], rootPath);
+}
+
+inline VkFilter getVkFilter(fastgltf::Filter filter)
+{
+	switch (filter) {
+	case fastgltf::Filter::Nearest:
+	case fastgltf::Filter::NearestMipMapNearest:
+	case fastgltf::Filter::NearestMipMapLinear:
+		return VK_FILTER_NEAREST;
+	default:
+		return VK_FILTER_LINEAR;
+	}
+}
+
+inline VkSamplerMipmapMode getVkMipmapMode(fastgltf::Filter filter)
+{
+	switch (filter) {
+	case fastgltf::Filter::NearestMipMapNearest:
+	case fastgltf::Filter::LinearMipMapNearest:
+		return VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	default:
+		return VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	}
+}
+
+inline VkSamplerAddressMode getVkAddressMode(fastgltf::Wrap wrap)
+{
+	switch (wrap) {
+	case fastgltf::Wrap::ClampToEdge:		return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	case fastgltf::Wrap::MirroredRepeat:	return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+	default:								return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	}
+}
+
+// The sampler state of a glTF texture. Textures without a sampler use linear filtering and repeat wrapping, as the spec suggests.
+inline VkSamplerCreateInfo getGltfSamplerInfo(const fastgltf::Asset& asset, const fastgltf::Texture& texture)
+{
+	VkSamplerCreateInfo info = vkinit::samplerCreateInfo();
+	if (!texture.samplerIndex) {
+		return info;
+	}
+
+	const fastgltf::Sampler& sampler = asset.samplers[texture.samplerIndex.value()];
+	const fastgltf::Filter minFilter = sampler.minFilter.value_or(fastgltf::Filter::LinearMipMapLinear);
+	info.magFilter = getVkFilter(sampler.magFilter.value_or(fastgltf::Filter::Linear));
+	info.minFilter = getVkFilter(minFilter);
+	info.mipmapMode = getVkMipmapMode(minFilter);
+	// Minification without a mipmap mode samples the base level only.
+	if (minFilter == fastgltf::Filter::Nearest || minFilter == fastgltf::Filter::Linear) {
+		info.maxLod = 0.f;
+	}
+	info.addressModeU = getVkAddressMode(sampler.wrapS);
+	info.addressModeV = getVkAddressMode(sampler.wrapT);
+	return info;
+}
+
+// Works out how each texture is sampled from the materials referencing it. Unreferenced textures are treated as base color.
+inline std::vector<scvk::TextureRole> getGltfTextureRoles(const fastgltf::Asset& asset)
+{
+	std::vector<scvk::TextureRole> roles(asset.textures.size(), scvk::TextureRole::BaseColor);
+	for (const auto& material : asset.materials) {
+		if (material.normalTexture) {
+			roles[material.normalTexture->textureIndex] = scvk::TextureRole::Normal;
+		}
+		if (material.pbrData.metallicRoughnessTexture) {
+			roles[material.pbrData.metallicRoughnessTexture->textureIndex] = scvk::TextureRole::Data;
+		}
+		if (material.occlusionTexture) {
+			roles[material.occlusionTexture->textureIndex] = scvk::TextureRole::Data;
+		}
+	}
+	return roles;
+}
 
 //TODO: Note: GLTF 2.0 only supports static 2D Textures. This is good to know.
-inline std::vector<scvk::Texture> loadTexturesFromGLTFAsset(VulkanApp* app, const fastgltf::Asset& asset, const std::filesystem::path& rootPath) {
-
-    std::vector<scvk::Texture> textures;
-
-    for (const auto& tex : asset.textures) {
-        //TODO: Assuming no extensions, we can safely assume the texture will always have an image index.
-        auto& gltfImageData = asset.images[tex.imageIndex.value()].data;
-		int width, height;
-		// The image data is stored in an external file, referenced by a URI
-        if (const auto* path = std::get_if<fastgltf::sources::URI>(&gltfImageData)) {
-            assert(path->uri.isLocalPath());
-            assert(path->fileByteOffset == 0);
-
-            std::filesystem::path imagePath = rootPath.parent_path() / path->uri.c_str();
-            textures.emplace_back(app->uploadTexture(imagePath.string().c_str()));
-        }
-        // The image data is stored as a raw array of bytes
-        else if (const auto* array = std::get_if<fastgltf::sources::Array>(&gltfImageData)) {
-			const auto rawImageData = array->bytes;
-            const auto dataSize = array->bytes.size();
-			unsigned char* data = stbi_load_from_memory(reinterpret_cast<const unsigned char*>(rawImageData.data()), static_cast<int>(dataSize), &width, &height, nullptr, 4);
-			textures.emplace_back(app->uploadTexture(data, width, height));
-        }
-        // The image data is stored in a buffer view within the GLTF
-        else if (const auto* bufferView = std::get_if<fastgltf::sources::BufferView>(&gltfImageData)) {
-            auto& bufView = asset.bufferViews[bufferView->bufferViewIndex];
-            auto& buffer = asset.buffers[bufView.bufferIndex];
-
-            if (const auto* vector = std::get_if<fastgltf::sources::Vector>(&buffer.data)) {
-
-				unsigned char* data = stbi_load_from_memory(
-					reinterpret_cast<const unsigned char*>(vector->bytes.data() + bufView.byteOffset),
-					static_cast<int>(bufView.byteLength),
-					&width, &height, nullptr, 4);
-				textures.emplace_back(app->uploadTexture(data, width, height));
-            }
-            else if (const auto* array = std::get_if<fastgltf::sources::Array>(&buffer.data)) {
-				unsigned char* data = stbi_load_from_memory(
-					reinterpret_cast<const unsigned char*>(array->bytes.data() + bufView.byteOffset),
-					static_cast<int>(bufView.byteLength),
-					&width, &height, nullptr, 4);
-					textures.emplace_back(app->uploadTexture(data, width, height));
-            }
-        }
-        else if (const auto* byteView = std::get_if<fastgltf::sources::ByteView>(&gltfImageData)) { throw std::runtime_error("Texture is sourced in byte view\n"); }
-        else if (std::holds_alternative<fastgltf::sources::Vector>(gltfImageData)) { throw std::runtime_error("Texture is sourced in vector\n"); }
-    }
-
-    return textures;
-}
-
-inline LoadedMesh processGltfMesh(const fastgltf::Asset& asset, const fastgltf::Mesh& gltf_mesh)
-{
-    std::vector<Primitive>      primitives;
-	std::vector<Vertex>			vertices;
-	std::vector<std::uint32_t>  indices;
-
-    for (const auto& gltfPrimitive : gltf_mesh.primitives)
-    {
-		Primitive prim;
-		prim.firstIndex = indices.size();
-		prim.indexCount = asset.accessors[gltfPrimitive.indicesAccessor.value()].count;
-
-		assert(gltfPrimitive.materialIndex.has_value());
-
-		auto matID = gltfPrimitive.materialIndex.value();
-		prim.textureID = asset.materials[matID].pbrData.baseColorTexture.value().textureIndex;
-
-		const auto initial_vertex = vertices.size();
-
-		// Process indices for the primitive.
-		const auto& indicesAccessor = asset.accessors[gltfPrimitive.indicesAccessor.value()];
-		indices.reserve(indices.size() + indicesAccessor.count);
-		fastgltf::iterateAccessor<std::uint32_t>(asset, indicesAccessor,
-			[&](std::uint32_t index) {
-				indices.push_back(index + initial_vertex);
+// Loads all of the asset's textures on the thread pool. The asset is shared with the loading jobs, which may outlive this call.
+// With app->bStreamTextures, placeholders are returned immediately and app->mTextureStreamer swaps in the real textures as they finish.
+// Otherwise the uploads of the real textures are recorded in texture order, so texture indices are preserved.
+// The uploads are only recorded into app->mUploader; the caller submits them.
+inline std::vector<scvk::Texture> loadTexturesFromGLTFAsset(VulkanApp* app, scvk::ThreadPool& pool, std::shared_ptr<const fastgltf::Asset> sharedAsset, const std::filesystem::path& rootPath) {
+
+	const fastgltf::Asset& asset = *sharedAsset;
+	const std::vector<scvk::TextureRole> roles = getGltfTextureRoles(asset);
+	const scvk::TextureLoadOptions options = {
+		.bCompress = app->bCompressTextures,
+		.bBlockCompressedFormats = app->bSupportsBlockCompression,
+		.mCacheDirectory = rootPath.parent_path() / ".texture_cache"
+	};
+
+	std::vector<std::future<scvk::TextureData>> loadedTextures;
+	std::vector<std::string> names;
+	loadedTextures.reserve(asset.textures.size());
+	names.reserve(asset.textures.size());
+	for (size_t i = 0; i < asset.textures.size(); ++i) {
+		const scvk::TextureSource source = getGltfTextureSource(asset, asset.textures[i], rootPath, options.bBlockCompressedFormats);
+		names.push_back(source.mName);
+		// The source may point into the asset's buffers, so the job keeps the asset alive.
+		loadedTextures.emplace_back(pool.submit([sharedAsset, source, role = roles[i], options]() {
+			return scvk::loadTextureData(source, role, options);
+			}));
+	}
+
+	std::vector<scvk::Texture> textures;
+	textures.reserve(loadedTextures.size());
+
+	if (app->bStreamTextures) {
+		for (size_t i = 0; i < loadedTextures.size(); ++i) {
+			const VkSamplerCreateInfo samplerInfo = getGltfSamplerInfo(asset, asset.textures[i]);
+			textures.emplace_back(app->createTexture(scvk::placeholderTextureData(roles[i]), samplerInfo));
+			app->mTextureStreamer.request(static_cast<uint32_t>(i), std::move(names[i]), std::move(loadedTextures[i]), samplerInfo);
+		}
+		return textures;
+	}
+
+	// Record each texture's upload as soon as it is ready, so the remaining loads overlap with the staging copies.
+	for (size_t i = 0; i < loadedTextures.size(); ++i) {
+		textures.emplace_back(app->createTexture(loadedTextures[i].get(), getGltfSamplerInfo(asset, asset.textures[i])));
+	}
+
+	return textures;
+}
+
+// Decodes every texture of the asset with 1, 2, 4, ... up to the number of hardware threads and prints how the decode time scales.
+inline void benchmarkTextureDecoding(const fastgltf::Asset& asset, const std::filesystem::path& rootPath)
+{
+	const unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int threads = 1; threads < maxThreads; threads *= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	fmt::println("Texture decode scaling ({} textures):", asset.textures.size());
+	float singleThreadedMs = 0.f;
+	for (const unsigned int threads : threadCounts) {
+		scvk::ThreadPool pool(threads);
+		scvk::Timer timer;
+		timer.start();
+		pool.parallelFor(asset.textures.size(), [&](size_t i) {
+			const auto source = getGltfTextureSource(asset, asset.textures[i], rootPath, true);
+			scvk::loadTextureData(source, scvk::TextureRole::BaseColor, {});
 			});
-		
-		// Process vertex positions.
-		const auto& posAccessor = asset.accessors[gltfPrimitive.findAttribute("POSITION")->accessorIndex];
-		vertices.resize(vertices.size() + posAccessor.count);
-		fastgltf::iterateAccessorWithIndex<glm::vec3>(asset, posAccessor,
-			[&](glm::vec3 v, size_t index) {
-				Vertex newvtx;
-				newvtx.position = v;
-				newvtx.normal = { 0, 1, 0 };
-				newvtx.color = glm::vec4{ 1.f };
-				newvtx.uv_x = 0;
-				newvtx.uv_y = 0;
-				vertices[initial_vertex + index] = newvtx;
+		const float ms = timer.total<std::milli>();
+		if (threads == 1) {
+			singleThreadedMs = ms;
+		}
+		fmt::println("  {:>3} threads: {:>9.2f} ms  ({:.2f}x)", threads, ms, singleThreadedMs / ms);
+	}
+}
+
+// Returns where the elements of an accessor live in memory, or nullopt when they can only be read through fastgltf,
+// e.g. for sparse accessors, buffers that are not loaded or component types the bulk conversions do not handle.
+inline std::optional<scvk::StridedView> getGltfAccessorView(const fastgltf::Asset& asset, const fastgltf::Accessor& accessor)
+{
+	if (accessor.sparse.has_value() || !accessor.bufferViewIndex.has_value()) {
+		return std::nullopt;
+	}
+
+	scvk::StridedView view;
+	switch (accessor.componentType) {
+	case fastgltf::ComponentType::Float:			view.mKind = scvk::ComponentKind::Float32; break;
+	case fastgltf::ComponentType::UnsignedByte:		view.mKind = accessor.normalized ? scvk::ComponentKind::UNorm8 : scvk::ComponentKind::UInt8; break;
+	case fastgltf::ComponentType::UnsignedShort:	view.mKind = accessor.normalized ? scvk::ComponentKind::UNorm16 : scvk::ComponentKind::UInt16; break;
+	case fastgltf::ComponentType::UnsignedInt:		view.mKind = scvk::ComponentKind::UInt32; break;
+	default:										return std::nullopt;
+	}
+	if (accessor.normalized && view.mKind == scvk::ComponentKind::UInt32) {
+		return std::nullopt;
+	}
+
+	const fastgltf::BufferView& bufferView = asset.bufferViews[accessor.bufferViewIndex.value()];
+	const auto& buffer = asset.buffers[bufferView.bufferIndex];
+	std::span<const std::byte> bytes;
+	if (const auto* vector = std::get_if<fastgltf::sources::Vector>(&buffer.data)) {
+		bytes = std::span<const std::byte>(vector->bytes.data(), vector->bytes.size());
+	}
+	else if (const auto* array = std::get_if<fastgltf::sources::Array>(&buffer.data)) {
+		bytes = std::span<const std::byte>(array->bytes.data(), array->bytes.size());
+	}
+	else {
+		return std::nullopt;
+	}
+
+	const size_t elementSize = fastgltf::getElementByteSize(accessor.type, accessor.componentType);
+	view.mStride = bufferView.byteStride.value_or(elementSize);
+	view.mCount = accessor.count;
+	view.mComponentCount = static_cast<uint32_t>(fastgltf::getNumComponents(accessor.type));
+
+	// Reject accessors that reach outside of their buffer view rather than reading past the buffer.
+	const size_t offset = bufferView.byteOffset + accessor.byteOffset;
+	const size_t extent = accessor.count == 0 ? 0 : (accessor.count - 1) * view.mStride + elementSize;
+	if (accessor.byteOffset + extent > bufferView.byteLength || offset + extent > bytes.size()) {
+		return std::nullopt;
+	}
+	view.mData = bytes.data() + offset;
+	return view;
+}
+
+// Converts a vertex attribute accessor into the given floats of every vertex, in bulk when possible and one element at a time
+// through fastgltf otherwise. Element is the glm vector type fastgltf converts to on the slow path.
+template<typename Element, size_t N>
+inline void convertGltfAttribute(const fastgltf::Asset& asset, const fastgltf::Accessor& accessor, Vertex* vertices, const std::array<uint32_t, N>& offsets, float fill, bool bBulk)
+{
+	if (bBulk) {
+		if (const auto view = getGltfAccessorView(asset, accessor)) {
+			if (scvk::convertAttribute<N>(*view, reinterpret_cast<std::byte*>(vertices), sizeof(Vertex), offsets, fill)) {
+				return;
+			}
+		}
+	}
+	fastgltf::iterateAccessorWithIndex<Element>(asset, accessor,
+		[&](const Element& element, size_t index) {
+			auto* dst = reinterpret_cast<std::byte*>(vertices + index);
+			for (size_t c = 0; c < N; ++c) {
+				const float value = c < Element::length() ? element[static_cast<typename Element::length_type>(c)] : fill;
+				memcpy(dst + offsets[c], &value, sizeof(float));
+			}
+		});
+}
+
+constexpr std::array<uint32_t, 3> VERTEX_POSITION_OFFSETS = { offsetof(Vertex, position), offsetof(Vertex, position) + 4, offsetof(Vertex, position) + 8 };
+constexpr std::array<uint32_t, 3> VERTEX_NORMAL_OFFSETS = { offsetof(Vertex, normal), offsetof(Vertex, normal) + 4, offsetof(Vertex, normal) + 8 };
+constexpr std::array<uint32_t, 2> VERTEX_UV_OFFSETS = { offsetof(Vertex, uv_x), offsetof(Vertex, uv_y) };
+constexpr std::array<uint32_t, 4> VERTEX_COLOR_OFFSETS = { offsetof(Vertex, color), offsetof(Vertex, color) + 4, offsetof(Vertex, color) + 8, offsetof(Vertex, color) + 12 };
+
+// Converts one glTF primitive into vertexCount vertices and its indices, offset by baseVertex, in ranges allocated by the caller.
+// Each attribute is converted in one pass over its accessor and every vertex field is written exactly once:
+// attributes a primitive does not have are filled with their default instead.
+// bBulkConversion = false reads every element through fastgltf instead, which is only kept as a baseline for benchmarking.
+inline void processGltfPrimitive(const fastgltf::Asset& asset, const fastgltf::Primitive& gltfPrimitive, Vertex* primitiveVertices, size_t vertexCount,
+	uint32_t* primitiveIndices, uint32_t baseVertex, bool bBulkConversion)
+{
+	// Process indices for the primitive.
+	const auto& indicesAccessor = asset.accessors[gltfPrimitive.indicesAccessor.value()];
+	const auto indicesView = bBulkConversion ? getGltfAccessorView(asset, indicesAccessor) : std::nullopt;
+	if (!indicesView || !scvk::convertIndices(*indicesView, baseVertex, primitiveIndices)) {
+		fastgltf::iterateAccessorWithIndex<std::uint32_t>(asset, indicesAccessor,
+			[&](std::uint32_t index, size_t idx) {
+				primitiveIndices[idx] = index + baseVertex;
 			});
+	}
 
-        // Process vertex normals.
-        // TODO: Follow gltf 2.0 spec: "When normals are not specified, client implementations MUST calculate flat normals and the provided tangents (if present) MUST be ignored."
-        auto& normalAccessor = asset.accessors[gltfPrimitive.findAttribute("NORMAL")->accessorIndex];
-		assert(normalAccessor.bufferViewIndex.has_value());
-        fastgltf::iterateAccessorWithIndex<glm::vec3>(
-            asset,
-            normalAccessor,
-            [&](glm::vec3 normal, std::size_t idx) {
-                vertices[initial_vertex + idx].normal = normal;
-            });
-
-		// Process vertex texture coords.
-        //TODO: Read spec about 2nd set of tex coords - They are for skinning.
-        if (gltfPrimitive.findAttribute("TEXCOORD_0") != gltfPrimitive.attributes.end()){
-            auto& texAccessor = asset.accessors[gltfPrimitive.findAttribute("TEXCOORD_0")->accessorIndex];
-            assert(texAccessor.bufferViewIndex.has_value());
-            fastgltf::iterateAccessorWithIndex<glm::vec2>(
-                asset,
-                texAccessor,
-                [&](glm::vec2 t, std::size_t idx) {
-					vertices[initial_vertex + idx].uv_x = t.x;
-					vertices[initial_vertex + idx].uv_y = t.y;
-                });
-		}
-
-		// Process vertex colors.
-		if (gltfPrimitive.findAttribute("COLOR_0") != gltfPrimitive.attributes.end()) {
-			auto& colAccessor = asset.accessors[gltfPrimitive.findAttribute("COLOR_0")->accessorIndex];
-			assert(colAccessor.bufferViewIndex.has_value());
-			fastgltf::iterateAccessorWithIndex<glm::vec4>(
-				asset,
-				colAccessor,
-				[&](glm::vec4 c, std::size_t idx) {
-					vertices[initial_vertex + idx].color = c;
-				});
+	// Process vertex positions.
+	const auto& posAccessor = asset.accessors[gltfPrimitive.findAttribute("POSITION")->accessorIndex];
+	convertGltfAttribute<glm::vec3>(asset, posAccessor, primitiveVertices, VERTEX_POSITION_OFFSETS, 1.f, bBulkConversion);
+
+    // Process vertex normals.
+    // TODO: Follow gltf 2.0 spec: "When normals are not specified, client implementations MUST calculate flat normals and the provided tangents (if present) MUST be ignored."
+	if (const auto normals = gltfPrimitive.findAttribute("NORMAL"); normals != gltfPrimitive.attributes.end()) {
+		convertGltfAttribute<glm::vec3>(asset, asset.accessors[normals->accessorIndex], primitiveVertices, VERTEX_NORMAL_OFFSETS, 1.f, bBulkConversion);
+	}
+	else {
+		scvk::fillAttribute<3>({ 0.f, 1.f, 0.f }, reinterpret_cast<std::byte*>(primitiveVertices), sizeof(Vertex), vertexCount, VERTEX_NORMAL_OFFSETS);
+	}
+
+	// Process vertex texture coords.
+    //TODO: Read spec about 2nd set of tex coords - They are for skinning.
+	if (const auto texcoords = gltfPrimitive.findAttribute("TEXCOORD_0"); texcoords != gltfPrimitive.attributes.end()) {
+		convertGltfAttribute<glm::vec2>(asset, asset.accessors[texcoords->accessorIndex], primitiveVertices, VERTEX_UV_OFFSETS, 0.f, bBulkConversion);
+	}
+	else {
+		scvk::fillAttribute<2>({ 0.f, 0.f }, reinterpret_cast<std::byte*>(primitiveVertices), sizeof(Vertex), vertexCount, VERTEX_UV_OFFSETS);
+	}
+
+	// Process vertex colors. RGB colors get an alpha of 1.
+	if (const auto colors = gltfPrimitive.findAttribute("COLOR_0"); colors != gltfPrimitive.attributes.end()) {
+		const auto& colAccessor = asset.accessors[colors->accessorIndex];
+		if (colAccessor.type == fastgltf::AccessorType::Vec3) {
+			convertGltfAttribute<glm::vec3>(asset, colAccessor, primitiveVertices, VERTEX_COLOR_OFFSETS, 1.f, bBulkConversion);
 		}
+		else {
+			convertGltfAttribute<glm::vec4>(asset, colAccessor, primitiveVertices, VERTEX_COLOR_OFFSETS, 1.f, bBulkConversion);
+		}
+	}
+	else {
+		scvk::fillAttribute<4>({ 1.f, 1.f, 1.f, 1.f }, reinterpret_cast<std::byte*>(primitiveVertices), sizeof(Vertex), vertexCount, VERTEX_COLOR_OFFSETS);
+	}
+}
+
+// Converts the primitives, vertices and indices of every glTF mesh into mesh, and records each mesh's range in mesh.mMeshes.
+// Every primitive's size is known from its accessors, so all offsets are computed up front, the arrays are allocated once
+// and the primitives are then converted on the pool's workers, each into its own range.
+inline void processGltfGeometry(const fastgltf::Asset& asset, LoadedMesh& mesh, scvk::ThreadPool& pool, bool bBulkConversion = true)
+{
+	struct PrimitiveJob
+	{
+		const fastgltf::Primitive*	mPrimitive;
+		size_t						mFirstVertex;
+		size_t						mVertexCount;
+	};
+	std::vector<PrimitiveJob> jobs;
+
+	size_t vertexCount = mesh.mVertices.size();
+	size_t indexCount = mesh.mIndices.size();
+	for (const auto& gltf_mesh : asset.meshes) {
+		mesh.mMeshes.push_back({ .firstPrimitive = static_cast<uint32_t>(mesh.mPrimitives.size()), .primitiveCount = static_cast<uint32_t>(gltf_mesh.primitives.size()) });
+
+		for (const auto& gltfPrimitive : gltf_mesh.primitives)
+		{
+			Primitive prim;
+			prim.firstIndex = static_cast<uint32_t>(indexCount);
+			prim.indexCount = asset.accessors[gltfPrimitive.indicesAccessor.value()].count;
+
+			assert(gltfPrimitive.materialIndex.has_value());
+
+			auto matID = gltfPrimitive.materialIndex.value();
+			prim.textureID = asset.materials[matID].pbrData.baseColorTexture.value().textureIndex;
+			// Blended materials are drawn opaque, as before.
+			prim.alphaCutoff = asset.materials[matID].alphaMode == fastgltf::AlphaMode::Mask ? asset.materials[matID].alphaCutoff : 0.f;
+			prim.doubleSided = asset.materials[matID].doubleSided ? 1 : 0;
+
+			const size_t primitiveVertexCount = asset.accessors[gltfPrimitive.findAttribute("POSITION")->accessorIndex].count;
+			jobs.push_back({ .mPrimitive = &gltfPrimitive, .mFirstVertex = vertexCount, .mVertexCount = primitiveVertexCount });
+
+			vertexCount += primitiveVertexCount;
+			indexCount += prim.indexCount;
+			mesh.mPrimitives.push_back(prim);
+		}
+	}
+
+	// Growing the vectors leaves the new elements uninitialized; every one is written by exactly one job.
+	const size_t firstPrimitive = mesh.mPrimitives.size() - jobs.size();
+	mesh.mVertices.resize(vertexCount);
+	mesh.mIndices.resize(indexCount);
+
+	pool.parallelFor(jobs.size(), [&](size_t i) {
+		const PrimitiveJob& job = jobs[i];
+		const Primitive& prim = mesh.mPrimitives[firstPrimitive + i];
+		processGltfPrimitive(asset, *job.mPrimitive, mesh.mVertices.data() + job.mFirstVertex, job.mVertexCount,
+			mesh.mIndices.data() + prim.firstIndex, static_cast<uint32_t>(job.mFirstVertex), bBulkConversion);
+		});
+}
+
+// Converts the geometry of every mesh with per-element accessor iteration on one thread, with the bulk conversions on one thread
+// and with the bulk conversions on every worker of pool, and prints the best of a few runs of each.
+inline void benchmarkGeometryProcessing(const fastgltf::Asset& asset, std::string_view name, scvk::ThreadPool& pool)
+{
+	constexpr int RUNS = 5;
+	scvk::ThreadPool singleThread(1);
+	struct Config
+	{
+		scvk::ThreadPool*	mPool;
+		bool				bBulk;
+		float				mBestMs{ std::numeric_limits<float>::max() };
+		LoadedMesh			mResult;
+	};
+	Config configs[] = { { &singleThread, false }, { &singleThread, true }, { &pool, true } };
+	for (Config& config : configs) {
+		for (int run = 0; run < RUNS; ++run) {
+			LoadedMesh mesh;
+			scvk::Timer timer;
+			timer.start();
+			processGltfGeometry(asset, mesh, *config.mPool, config.bBulk);
+			config.mBestMs = std::min(config.mBestMs, timer.total<std::milli>());
+			config.mResult = std::move(mesh);
+		}
+	}
+
+	const LoadedMesh& reference = configs[0].mResult;
+	bool bIdentical = true;
+	for (const Config& config : configs) {
+		bIdentical = bIdentical && config.mResult.mVertices.size() == reference.mVertices.size() && config.mResult.mIndices == reference.mIndices &&
+			memcmp(config.mResult.mVertices.data(), reference.mVertices.data(), reference.mVertices.size() * sizeof(Vertex)) == 0;
+	}
+	const float vertexCount = static_cast<float>(reference.mVertices.size());
+	fmt::println("Geometry conversion of '{}' ({} vertices, {} indices, {} primitives, best of {}):{}",
+		name, reference.mVertices.size(), reference.mIndices.size(), reference.mPrimitives.size(), RUNS, bIdentical ? "" : " RESULTS DIFFER");
+	fmt::println("  per element, 1 thread: {:>9.2f} ms  {:>7.1f} M vertices/s", configs[0].mBestMs, vertexCount / (configs[0].mBestMs * 1000.f));
+	fmt::println("  bulk, 1 thread:        {:>9.2f} ms  {:>7.1f} M vertices/s  ({:.2f}x)", configs[1].mBestMs, vertexCount / (configs[1].mBestMs * 1000.f), configs[0].mBestMs / configs[1].mBestMs);
+	fmt::println("  bulk, {:>3} threads:    {:>9.2f} ms  {:>7.1f} M vertices/s  ({:.2f}x)", pool.size(), configs[2].mBestMs, vertexCount / (configs[2].mBestMs * 1000.f), configs[0].mBestMs / configs[2].mBestMs);
+}
 
-		primitives.push_back(std::move(prim));
+// Writes a glTF of a gridWidth x gridHeight vertex grid, split into primitiveCount primitives of whole rows.
+// Positions and normals are interleaved floats, texture coordinates are normalized shorts and colors normalized bytes,
+// so the benchmark covers strided and normalized accessors.
+inline fs::path writeSyntheticGltf(const fs::path& directory, uint32_t gridWidth, uint32_t gridHeight, uint32_t primitiveCount)
+{
+	const uint32_t rowsPerPrimitive = gridHeight / primitiveCount;
+	const size_t verticesPerPrimitive = size_t(gridWidth) * rowsPerPrimitive;
+	const size_t indicesPerPrimitive = size_t(gridWidth - 1) * (rowsPerPrimitive - 1) * 6;
+	const size_t vertexCount = verticesPerPrimitive * primitiveCount;
+	const size_t indexCount = indicesPerPrimitive * primitiveCount;
+
+	const size_t positionNormalOffset = 0;
+	const size_t texcoordOffset = vertexCount * 24;
+	const size_t colorOffset = texcoordOffset + vertexCount * 4;
+	const size_t indexOffset = colorOffset + vertexCount * 4;
+	std::vector<std::byte> bin(indexOffset + indexCount * 4);
+
+	for (uint32_t y = 0; y < rowsPerPrimitive * primitiveCount; ++y) {
+		for (uint32_t x = 0; x < gridWidth; ++x) {
+			const size_t v = size_t(y) * gridWidth + x;
+			const float positionNormal[6] = { float(x), float(y), 0.f, 0.f, 0.f, 1.f };
+			const uint16_t texcoord[2] = { uint16_t(x * 65535u / gridWidth), uint16_t(y * 65535u / gridHeight) };
+			const uint8_t color[4] = { uint8_t(x), uint8_t(y), uint8_t(x + y), 255 };
+			memcpy(bin.data() + positionNormalOffset + v * 24, positionNormal, sizeof(positionNormal));
+			memcpy(bin.data() + texcoordOffset + v * 4, texcoord, sizeof(texcoord));
+			memcpy(bin.data() + colorOffset + v * 4, color, sizeof(color));
+		}
+	}
+	uint32_t* indices = reinterpret_cast<uint32_t*>(bin.data() + indexOffset);
+	for (uint32_t p = 0; p < primitiveCount; ++p) {
+		for (uint32_t y = 0; y + 1 < rowsPerPrimitive; ++y) {
+			for (uint32_t x = 0; x + 1 < gridWidth; ++x) {
+				const uint32_t i = y * gridWidth + x;
+				const uint32_t quad[6] = { i, i + gridWidth, i + 1, i + 1, i + gridWidth, i + gridWidth + 1 };
+				memcpy(indices, quad, sizeof(quad));
+				indices += 6;
+			}
+		}
+	}
+
+	std::string accessors;
+	std::string primitives;
+	for (uint32_t p = 0; p < primitiveCount; ++p) {
+		const size_t firstVertex = p * verticesPerPrimitive;
+		const uint32_t a = p * 5;
+		fmt::format_to(std::back_inserter(accessors),
+			R"({}{{"bufferView":0,"byteOffset":{},"componentType":5126,"count":{},"type":"VEC3","min":[0,{},0],"max":[{},{},0]}},)"
+			R"({{"bufferView":0,"byteOffset":{},"componentType":5126,"count":{},"type":"VEC3"}},)"
+			R"({{"bufferView":1,"byteOffset":{},"componentType":5123,"normalized":true,"count":{},"type":"VEC2"}},)"
+			R"({{"bufferView":2,"byteOffset":{},"componentType":5121,"normalized":true,"count":{},"type":"VEC4"}},)"
+			R"({{"bufferView":3,"byteOffset":{},"componentType":5125,"count":{},"type":"SCALAR"}})",
+			p == 0 ? "" : ",",
+			firstVertex * 24, verticesPerPrimitive, p * rowsPerPrimitive, gridWidth - 1, (p + 1) * rowsPerPrimitive - 1,
+			firstVertex * 24 + 12, verticesPerPrimitive,
+			firstVertex * 4, verticesPerPrimitive,
+			firstVertex * 4, verticesPerPrimitive,
+			p * indicesPerPrimitive * 4, indicesPerPrimitive);
+		fmt::format_to(std::back_inserter(primitives),
+			R"({}{{"attributes":{{"POSITION":{},"NORMAL":{},"TEXCOORD_0":{},"COLOR_0":{}}},"indices":{},"material":0}})",
+			p == 0 ? "" : ",", a, a + 1, a + 2, a + 3, a + 4);
+	}
+
+	const std::string json = fmt::format(
+		R"({{"asset":{{"version":"2.0"}},"scene":0,"scenes":[{{"nodes":[0]}}],"nodes":[{{"mesh":0}}],)"
+		R"("meshes":[{{"primitives":[{}]}}],)"
+		R"("materials":[{{"pbrMetallicRoughness":{{"baseColorTexture":{{"index":0}}}}}}],"textures":[{{"source":0}}],"images":[{{"uri":"missing.png"}}],)"
+		R"("buffers":[{{"uri":"synthetic.bin","byteLength":{}}}],)"
+		R"("bufferViews":[{{"buffer":0,"byteOffset":{},"byteLength":{},"byteStride":24}},{{"buffer":0,"byteOffset":{},"byteLength":{},"byteStride":4}},)"
+		R"({{"buffer":0,"byteOffset":{},"byteLength":{},"byteStride":4}},{{"buffer":0,"byteOffset":{},"byteLength":{}}}],)"
+		R"("accessors":[{}]}})",
+		primitives, bin.size(),
+		positionNormalOffset, vertexCount * 24, texcoordOffset, vertexCount * 4,
+		colorOffset, vertexCount * 4, indexOffset, indexCount * 4,
+		accessors);
+
+	fs::create_directories(directory);
+	std::ofstream(directory / "synthetic.bin", std::ios::binary).write(reinterpret_cast<const char*>(bin.data()), bin.size());
+	std::ofstream(directory / "synthetic.gltf", std::ios::binary).write(json.data(), json.size());
+	return directory / "synthetic.gltf";
+}
+
+// Runs benchmarkGeometryProcessing on a generated multi-million vertex glTF.
+inline void benchmarkSyntheticGeometry(scvk::ThreadPool& pool)
+{
+	const fs::path path = writeSyntheticGltf(fs::temp_directory_path() / "scvk_synthetic_gltf", 2048, 1024, 64);
+
+	auto eGltfFile = fastgltf::GltfDataBuffer::FromPath(path);
+	if (eGltfFile.error() != fastgltf::Error::None) {
+		fmt::println("Failed to read '{}'", path.string());
+		return;
+	}
+	auto parser = fastgltf::Parser();
+	auto eAsset = parser.loadGltf(eGltfFile.get(), path.parent_path(), fastgltf::Options::LoadExternalBuffers);
+	if (eAsset.error() != fastgltf::Error::None) {
+		fmt::println("Failed to parse '{}': {}", path.string(), fastgltf::getErrorMessage(eAsset.error()));
+		return;
+	}
+	benchmarkGeometryProcessing(eAsset.get(), "synthetic grid", pool);
+}
+
+// Adds an instance for every node in the subtree rooted at nodeIndex that has a mesh.
+inline void collectGltfInstances(const fastgltf::Asset& asset, size_t nodeIndex, const glm::mat4& parentMatrix, std::vector<MeshInstance>& instances)
+{
+	const fastgltf::Node& node = asset.nodes[nodeIndex];
+
+	// fastgltf and glm both store matrices column-major.
+	const fastgltf::math::fmat4x4 localTransform = fastgltf::getTransformMatrix(node);
+	glm::mat4 localMatrix;
+	static_assert(sizeof(localMatrix) == sizeof(localTransform));
+	memcpy(&localMatrix, localTransform.data(), sizeof(localMatrix));
+
+	const glm::mat4 worldMatrix = parentMatrix * localMatrix;
+	if (node.meshIndex) {
+		instances.push_back({ .worldMatrix = worldMatrix, .meshIndex = static_cast<uint32_t>(node.meshIndex.value()) });
+	}
+	for (const size_t child : node.children) {
+		collectGltfInstances(asset, child, worldMatrix, instances);
+	}
+}
 
-    }
-    
+// Processes the geometry of every mesh once, then walks the node hierarchy of every scene to instance them.
+inline LoadedMesh processGltfScene(const fastgltf::Asset& asset, scvk::ThreadPool& pool)
+{
+	LoadedMesh mesh;
+	processGltfGeometry(asset, mesh, pool);
 
-    LoadedMesh mesh = {
-        .mPrimitives = std::move(primitives),
-		.mVertices = std::move(vertices),
-		.mIndices = std::move(indices),
-    };
+	for (const auto& scene : asset.scenes) {
+		for (const size_t rootNode : scene.nodeIndices) {
+			collectGltfInstances(asset, rootNode, glm::mat4(1.f), mesh.mInstances);
+		}
+	}
 
+	// Assets without scenes are only a library of meshes; show each of them untransformed.
+	if (asset.scenes.empty()) {
+		for (uint32_t i = 0; i < mesh.mMeshes.size(); ++i) {
+			mesh.mInstances.push_back({ .worldMatrix = glm::mat4(1.f), .meshIndex = i });
+		}
+	}
 	return mesh;
+}
+
+
+// Hashes everything the processed geometry depends on: the glTF document itself and the contents of all of its buffers.
+inline uint64_t hashGltfSource(const fastgltf::Asset& asset, const fs::path& path)
+{
+	uint64_t hash = scvk::SCENE_CACHE_VERSION;
+	if (auto document = scvk::MappedFile::open(path)) {
+		hash = scvk::hashBytes(document->bytes().data(), document->bytes().size(), hash);
+	}
+	for (const auto& buffer : asset.buffers) {
+		if (const auto* vector = std::get_if<fastgltf::sources::Vector>(&buffer.data)) {
+			hash = scvk::hashBytes(vector->bytes.data(), vector->bytes.size(), hash);
+		}
+		else if (const auto* array = std::get_if<fastgltf::sources::Array>(&buffer.data)) {
+			hash = scvk::hashBytes(array->bytes.data(), array->bytes.size(), hash);
+		}
+	}
+	return hash;
+}
+
+// Packs the loaded vertices into the app's vertex format, if it is not the plain float layout.
+inline void packLoadedVertices(VulkanApp* app, LoadedMesh& loaded)
+{
+	if (app->mVertexFormat == VertexFormat::Float) {
+		return;
+	}
+	scvk::Timer packTimer;
+	packTimer.start();
+	scvk::packVertices(loaded, app->mVertexFormat, app->mThreadPool);
+	fmt::println("Packed {} vertices as {} in {:.2f} ms: {:.2f} MB instead of {:.2f} MB", loaded.vertexData().size(), scvk::vertexFormatName(loaded.mVertexFormat),
+		packTimer.total<std::milli>(), loaded.mPackedVertices.size() / (1024.0 * 1024.0), loaded.vertexData().size_bytes() / (1024.0 * 1024.0));
+}
 
+// Reorders the loaded triangles and vertices for the vertex cache, overdraw and vertex fetch, if the app asks for it.
+inline void optimizeLoadedMesh(VulkanApp* app, LoadedMesh& loaded)
+{
+	if (!app->bOptimizeMeshes) {
+		return;
+	}
+	scvk::Timer optimizeTimer;
+	optimizeTimer.start();
+	const scvk::MeshOptimizationStats stats = scvk::optimizeMesh(loaded, app->mThreadPool);
+	fmt::println("Optimized {} primitives in {:.2f} ms: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}", loaded.mPrimitives.size(),
+		optimizeTimer.total<std::milli>(), stats.mBefore.mACMR, stats.mAfter.mACMR, stats.mBefore.mATVR, stats.mAfter.mATVR);
 }
 
+// Builds the level of detail chains of the loaded primitives, if the app asks for them.
+inline void generateLoadedLods(VulkanApp* app, LoadedMesh& loaded)
+{
+	if (!app->bGenerateLods) {
+		return;
+	}
+	scvk::Timer lodTimer;
+	lodTimer.start();
+	const size_t fullDetailIndices = loaded.mIndices.size();
+	scvk::generateLods(loaded, app->mThreadPool);
+	size_t coarsestIndices = 0;
+	for (size_t p = 0; p < loaded.mPrimitives.size(); ++p) {
+		const PrimitiveLods& lods = loaded.mPrimitiveLods[p];
+		coarsestIndices += lods.lodCount > 0 ? loaded.mLods[lods.firstLod + lods.lodCount - 1].indexCount : loaded.mPrimitives[p].indexCount;
+	}
+	fmt::println("Generated {} levels of detail for {} primitives in {:.2f} ms: {} triangles at full detail, {} at the coarsest levels, {:.2f} MB of extra indices",
+		loaded.mLods.size(), loaded.mPrimitives.size(), lodTimer.total<std::milli>(), fullDetailIndices / 3, coarsestIndices / 3,
+		(loaded.mIndices.size() - fullDetailIndices) * sizeof(uint32_t) / (1024.0 * 1024.0));
+}
 
 bool loadGltfFromFile(VulkanApp* app, const fs::path& path, LoadedMesh& loaded)
 {
 	constexpr auto extensions =
 		fastgltf::Extensions::KHR_lights_punctual |
-		fastgltf::Extensions::EXT_mesh_gpu_instancing;
+		fastgltf::Extensions::EXT_mesh_gpu_instancing |
+		fastgltf::Extensions::KHR_texture_basisu;
 	auto parser = fastgltf::Parser(extensions);
 
+	scvk::Timer loadTimer;
+	loadTimer.start();
+
 	// Load contents of the file into a buffer.
 	auto eGltfFile = fastgltf::GltfDataBuffer::FromPath(path);
 	if (auto error = eGltfFile.error(); error != fastgltf::Error::None) {
@@ -182,9 +694,100 @@ bool loadGltfFromFile(VulkanApp* app, const fs::path& path, LoadedMesh& loaded)
 	if (auto error = eAsset.error(); error != fastgltf::Error::None) {
 		//return fastgltf::Error(eGltfFile.error());
 	}
-	auto asset = std::move(eAsset.get());
+	// Shared, because streamed texture loads can still be reading from it after this function returns.
+	const auto sharedAsset = std::make_shared<const fastgltf::Asset>(std::move(eAsset.get()));
+	const fastgltf::Asset& asset = *sharedAsset;
+	const float parseMs = loadTimer.total<std::milli>();
+
+	// Geometry comes from the scene cache when it was built from identical source data, and is processed and cached otherwise.
+	scvk::Timer geometryTimer;
+	geometryTimer.start();
+	const fs::path cachePath = scvk::sceneCachePath(path);
+	// Optimized geometry and levels of detail are part of the cache key, so toggling either never reuses the other variant.
+	const uint64_t processing = (app->bOptimizeMeshes ? scvk::MESH_OPTIMIZER_VERSION : 0) | (uint64_t(app->bGenerateLods ? scvk::LOD_GENERATOR_VERSION : 0) << 32);
+	const uint64_t sourceHash = scvk::hashCombine(hashGltfSource(asset, path), processing);
+	const bool bWarm = app->bUseSceneCache && scvk::readSceneCache(cachePath, sourceHash, loaded);
+	if (!bWarm) {
+		loaded = processGltfScene(asset, app->mThreadPool);
+		optimizeLoadedMesh(app, loaded);
+		generateLoadedLods(app, loaded);
+		if (app->bUseSceneCache) {
+			scvk::writeSceneCache(cachePath, sourceHash, loaded);
+		}
+	}
+	fmt::println("Loaded {} geometry in {:.2f} ms (glTF parse {:.2f} ms): {} vertices, {} indices, {} primitives in {} meshes, {} mesh instances",
+		bWarm ? "warm (scene cache)" : "cold", geometryTimer.total<std::milli>(), parseMs,
+		loaded.vertexData().size(), loaded.indexData().size(), loaded.mPrimitives.size(), loaded.mMeshes.size(), loaded.mInstances.size());
+	packLoadedVertices(app, loaded);
+
+	if (app->bBenchmarkGeometry) {
+		benchmarkGeometryProcessing(asset, path.filename().string(), app->mThreadPool);
+		benchmarkSyntheticGeometry(app->mThreadPool);
+	}
+
+	if (app->bBenchmarkTextureDecode) {
+		benchmarkTextureDecoding(asset, path);
+	}
+
+	scvk::Timer textureTimer;
+	textureTimer.start();
+	loaded.mTextures = loadTexturesFromGLTFAsset(app, app->mThreadPool, sharedAsset, path);
+	fmt::println("{} {} textures in {:.2f} ms using {} threads{}", app->bStreamTextures ? "Queued streaming of" : "Loaded",
+		loaded.mTextures.size(), textureTimer.total<std::milli>(), app->mThreadPool.size(), app->bCompressTextures ? " (BC compressed)" : "");
+	fmt::println("Loaded '{}' in {:.2f} ms ({} start)", path.filename().string(), loadTimer.total<std::milli>(), bWarm ? "warm" : "cold");
+	return true;
+}
+
+// Loads an OBJ file and the diffuse texture of each of its materials, and reports how fast the geometry was ingested.
+bool loadObjFromFile(VulkanApp* app, const fs::path& path, LoadedMesh& loaded)
+{
+	scvk::Timer loadTimer;
+	loadTimer.start();
+
+	scvk::ObjScene scene;
+	if (!scvk::loadObj(path, app->mThreadPool, scene)) {
+		return false;
+	}
+	loaded = std::move(scene.mMesh);
+	const float geometryMs = loadTimer.total<std::milli>();
+	const float megabytes = scene.mFileBytes / (1024.f * 1024.f);
+	fmt::println("Loaded OBJ geometry in {:.2f} ms (parse {:.2f} ms, weld {:.2f} ms): {:.1f} MB at {:.1f} MB/s, {} vertices, {} indices, {} primitives",
+		geometryMs, scene.mParseMs, scene.mWeldMs, megabytes, megabytes / (geometryMs / 1000.f),
+		loaded.mVertices.size(), loaded.mIndices.size(), loaded.mPrimitives.size());
+	optimizeLoadedMesh(app, loaded);
+	generateLoadedLods(app, loaded);
+	packLoadedVertices(app, loaded);
+
+	// Materials without a texture keep the base color placeholder.
+	scvk::Timer textureTimer;
+	textureTimer.start();
+	const scvk::TextureLoadOptions options = {
+		.bCompress = app->bCompressTextures,
+		.bBlockCompressedFormats = app->bSupportsBlockCompression,
+		.mCacheDirectory = path.parent_path() / ".texture_cache"
+	};
+	std::vector<std::optional<std::future<scvk::TextureData>>> loadedTextures(scene.mTexturePaths.size());
+	for (size_t i = 0; i < scene.mTexturePaths.size(); ++i) {
+		if (!scene.mTexturePaths[i].empty()) {
+			const scvk::TextureSource source = { .mPath = scene.mTexturePaths[i], .mName = scene.mTexturePaths[i].filename().string() };
+			loadedTextures[i] = app->mThreadPool.submit([source, options]() {
+				return scvk::loadTextureData(source, scvk::TextureRole::BaseColor, options);
+				});
+		}
+	}
 
-	loaded = processGltfMesh(asset, asset.meshes[0]);
-	loaded.mTextures = loadTexturesFromGLTFAsset(app, asset, path);
+	loaded.mTextures.reserve(loadedTextures.size());
+	for (size_t i = 0; i < loadedTextures.size(); ++i) {
+		if (loadedTextures[i] && !app->bStreamTextures) {
+			loaded.mTextures.emplace_back(app->createTexture(loadedTextures[i]->get()));
+			continue;
+		}
+		loaded.mTextures.emplace_back(app->createTexture(scvk::placeholderTextureData(scvk::TextureRole::BaseColor)));
+		if (loadedTextures[i]) {
+			app->mTextureStreamer.request(static_cast<uint32_t>(i), scene.mTexturePaths[i].string(), std::move(*loadedTextures[i]), vkinit::samplerCreateInfo());
+		}
+	}
+	fmt::println("{} {} textures in {:.2f} ms", app->bStreamTextures ? "Queued streaming of" : "Loaded", loaded.mTextures.size(), textureTimer.total<std::milli>());
+	fmt::println("Loaded '{}' in {:.2f} ms", path.filename().string(), loadTimer.total<std::milli>());
 	return true;
 }
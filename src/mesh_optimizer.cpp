@@ -0,0 +1,312 @@
+#include "mesh_optimizer.h"
+
+namespace scvk
+{
+	namespace
+	{
+		constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+		struct CacheCounts
+		{
+			size_t mMisses{ 0 };
+			size_t mTriangles{ 0 };
+			size_t mVertices{ 0 };	// Distinct vertices referenced.
+		};
+
+		// The smallest index and the number of vertices up to the largest one, so per-vertex state can be kept in small arrays.
+		std::pair<uint32_t, size_t> indexRange(std::span<const uint32_t> indices)
+		{
+			if (indices.empty()) {
+				return { 0, 0 };
+			}
+			const auto [minIndex, maxIndex] = std::minmax_element(indices.begin(), indices.end());
+			return { *minIndex, size_t(*maxIndex - *minIndex) + 1 };
+		}
+
+		// A FIFO cache simulated with timestamps: a vertex is cached if fewer than cacheSize misses happened since it was loaded.
+		// If missesPerTriangle is not null, the misses of every triangle are written to it.
+		CacheCounts countCacheMisses(std::span<const uint32_t> indices, uint32_t cacheSize, uint8_t* missesPerTriangle = nullptr)
+		{
+			const auto [base, vertexCount] = indexRange(indices);
+			std::vector<uint32_t> loadedAt(vertexCount, 0);
+			std::vector<uint8_t> referenced(vertexCount, 0);
+
+			CacheCounts counts;
+			counts.mTriangles = indices.size() / 3;
+			uint32_t time = cacheSize + 1;
+			for (size_t t = 0; t < counts.mTriangles; ++t) {
+				uint8_t misses = 0;
+				for (size_t c = 0; c < 3; ++c) {
+					const uint32_t v = indices[t * 3 + c] - base;
+					if (time - loadedAt[v] > cacheSize) {
+						loadedAt[v] = time++;
+						++misses;
+					}
+					counts.mVertices += !referenced[v];
+					referenced[v] = 1;
+				}
+				counts.mMisses += misses;
+				if (missesPerTriangle) {
+					missesPerTriangle[t] = misses;
+				}
+			}
+			return counts;
+		}
+
+		VertexCacheStats toStats(const CacheCounts& counts)
+		{
+			return {
+				.mACMR = counts.mTriangles ? float(counts.mMisses) / float(counts.mTriangles) : 0.f,
+				.mATVR = counts.mVertices ? float(counts.mMisses) / float(counts.mVertices) : 0.f };
+		}
+
+		CacheCounts& operator+=(CacheCounts& a, const CacheCounts& b)
+		{
+			a.mMisses += b.mMisses;
+			a.mTriangles += b.mTriangles;
+			a.mVertices += b.mVertices;
+			return a;
+		}
+	}
+
+	VertexCacheStats analyzeVertexCache(std::span<const uint32_t> indices, uint32_t cacheSize)
+	{
+		return toStats(countCacheMisses(indices, cacheSize));
+	}
+
+	void optimizeVertexCache(std::span<uint32_t> indices, uint32_t cacheSize)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+		const auto [base, vertexCount] = indexRange(indices);
+
+		// The triangles using each vertex, and how many of them are still to be emitted.
+		std::vector<uint32_t> liveTriangles(vertexCount, 0);
+		for (const uint32_t index : indices) {
+			++liveTriangles[index - base];
+		}
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+		std::partial_sum(liveTriangles.begin(), liveTriangles.end(), adjacencyOffsets.begin() + 1);
+		std::vector<uint32_t> adjacency(indices.size());
+		{
+			std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i) {
+				adjacency[cursor[indices[i] - base]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		std::vector<uint32_t> cachedAt(vertexCount, 0);
+		std::vector<uint8_t> emitted(triangleCount, 0);
+		std::vector<uint32_t> deadEnds;
+		std::vector<uint32_t> candidates;
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+		uint32_t time = cacheSize + 1;
+		size_t cursor = 0;
+
+		// Picks the next vertex to fan around: the candidate that will still be cached after emitting all of its triangles,
+		// preferring the one that has been in the cache longest. Falls back to recently used vertices, then to input order.
+		const auto nextVertex = [&]() -> uint32_t {
+			uint32_t best = NO_VERTEX;
+			int64_t bestPriority = -1;
+			for (const uint32_t v : candidates) {
+				if (liveTriangles[v] == 0) {
+					continue;
+				}
+				int64_t priority = 0;
+				if (int64_t(time) - cachedAt[v] + 2 * int64_t(liveTriangles[v]) <= int64_t(cacheSize)) {
+					priority = int64_t(time) - cachedAt[v];
+				}
+				if (priority > bestPriority) {
+					best = v;
+					bestPriority = priority;
+				}
+			}
+			if (best != NO_VERTEX) {
+				return best;
+			}
+			while (!deadEnds.empty()) {
+				const uint32_t v = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[v] > 0) {
+					return v;
+				}
+			}
+			for (; cursor < triangleCount; ++cursor) {
+				if (!emitted[cursor]) {
+					return indices[cursor * 3] - base;
+				}
+			}
+			return NO_VERTEX;
+		};
+
+		for (uint32_t fanning = indices[0] - base; fanning != NO_VERTEX; fanning = nextVertex()) {
+			candidates.clear();
+			for (uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; ++a) {
+				const uint32_t t = adjacency[a];
+				if (emitted[t]) {
+					continue;
+				}
+				emitted[t] = 1;
+				for (size_t c = 0; c < 3; ++c) {
+					const uint32_t v = indices[t * 3 + c] - base;
+					output.push_back(v + base);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					--liveTriangles[v];
+					if (time - cachedAt[v] > cacheSize) {
+						cachedAt[v] = time++;
+					}
+				}
+			}
+		}
+
+		std::copy(output.begin(), output.end(), indices.begin());
+	}
+
+	void optimizeOverdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices, float threshold, uint32_t cacheSize)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount < 2) {
+			return;
+		}
+
+		// Hard boundaries are where the cache restarts: all three vertices of a triangle miss, so nothing is lost by cutting there.
+		std::vector<uint8_t> misses(triangleCount);
+		countCacheMisses(indices, cacheSize, misses.data());
+		std::vector<size_t> clusterStarts;
+		for (size_t t = 0; t < triangleCount; ++t) {
+			if (t == 0 || misses[t] == 3) {
+				clusterStarts.push_back(t);
+			}
+		}
+		clusterStarts.push_back(triangleCount);
+
+		// Soft boundaries split a hard cluster further wherever the part so far, simulated from an empty cache as it may
+		// follow any other cluster once they are sorted, is already about as cache efficient as the whole hard cluster.
+		const auto [base, vertexCount] = indexRange(indices);
+		std::vector<uint32_t> loadedAt(vertexCount, 0);
+		uint32_t time = cacheSize + 1;
+		std::vector<size_t> softStarts;
+		for (size_t h = 0; h + 1 < clusterStarts.size(); ++h) {
+			const size_t begin = clusterStarts[h];
+			const size_t end = clusterStarts[h + 1];
+			size_t clusterMisses = 0;
+			for (size_t t = begin; t < end; ++t) {
+				clusterMisses += misses[t];
+			}
+			const float limit = threshold * float(clusterMisses) / float(end - begin);
+
+			softStarts.push_back(begin);
+			time += cacheSize + 1;
+			size_t softMisses = 0;
+			for (size_t t = begin; t < end; ++t) {
+				for (size_t c = 0; c < 3; ++c) {
+					const uint32_t v = indices[t * 3 + c] - base;
+					if (time - loadedAt[v] > cacheSize) {
+						loadedAt[v] = time++;
+						++softMisses;
+					}
+				}
+				const size_t softTriangles = t + 1 - softStarts.back();
+				if (t + 1 < end && float(softMisses) <= limit * float(softTriangles)) {
+					softStarts.push_back(t + 1);
+					time += cacheSize + 1;
+					softMisses = 0;
+				}
+			}
+		}
+		softStarts.push_back(triangleCount);
+
+		// Sort clusters by how far they face away from the centre of the primitive: those are the ones likely to occlude the rest.
+		const auto position = [&](size_t corner) { return vertices[indices[corner]].position; };
+		const size_t clusterCount = softStarts.size() - 1;
+		std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.f));
+		std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.f));
+		glm::vec3 meshCentroid(0.f);
+		float meshArea = 0.f;
+		for (size_t c = 0; c < clusterCount; ++c) {
+			float clusterArea = 0.f;
+			for (size_t t = softStarts[c]; t < softStarts[c + 1]; ++t) {
+				const glm::vec3 p0 = position(t * 3);
+				const glm::vec3 p1 = position(t * 3 + 1);
+				const glm::vec3 p2 = position(t * 3 + 2);
+				const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);	// Twice the area, in the normal's direction.
+				const float area = glm::length(normal);
+				clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.f);
+				clusterNormals[c] += normal;
+				clusterArea += area;
+			}
+			meshCentroid += clusterCentroids[c];
+			meshArea += clusterArea;
+			clusterCentroids[c] = clusterArea > 0.f ? clusterCentroids[c] / clusterArea : position(softStarts[c] * 3);
+		}
+		meshCentroid = meshArea > 0.f ? meshCentroid / meshArea : glm::vec3(0.f);
+
+		std::vector<float> sortKeys(clusterCount);
+		std::vector<uint32_t> order(clusterCount);
+		for (size_t c = 0; c < clusterCount; ++c) {
+			const float normalLength = glm::length(clusterNormals[c]);
+			sortKeys[c] = normalLength > 0.f ? glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c] / normalLength) : 0.f;
+			order[c] = static_cast<uint32_t>(c);
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+		for (const uint32_t c : order) {
+			output.insert(output.end(), indices.begin() + softStarts[c] * 3, indices.begin() + softStarts[c + 1] * 3);
+		}
+		std::copy(output.begin(), output.end(), indices.begin());
+	}
+
+	void optimizeVertexFetch(LoadedMesh& mesh)
+	{
+		std::vector<uint32_t> remap(mesh.mVertices.size(), NO_VERTEX);
+		uint32_t nextVertex = 0;
+		for (uint32_t& index : mesh.mIndices) {
+			if (remap[index] == NO_VERTEX) {
+				remap[index] = nextVertex++;
+			}
+			index = remap[index];
+		}
+
+		UninitializedVector<Vertex> vertices(mesh.mVertices.size());
+		for (size_t v = 0; v < mesh.mVertices.size(); ++v) {
+			if (remap[v] == NO_VERTEX) {
+				remap[v] = nextVertex++;
+			}
+			vertices[remap[v]] = mesh.mVertices[v];
+		}
+		mesh.mVertices = std::move(vertices);
+	}
+
+	MeshOptimizationStats optimizeMesh(LoadedMesh& mesh, ThreadPool& pool)
+	{
+		const auto primitiveIndices = [&](size_t p) {
+			const Primitive& primitive = mesh.mPrimitives[p];
+			return std::span<uint32_t>(mesh.mIndices.data() + primitive.firstIndex, primitive.indexCount);
+		};
+		const auto analyze = [&]() {
+			std::vector<CacheCounts> counts(mesh.mPrimitives.size());
+			pool.parallelFor(counts.size(), [&](size_t p) { counts[p] = countCacheMisses(primitiveIndices(p), 16); });
+			CacheCounts total;
+			for (const CacheCounts& primitiveCounts : counts) {
+				total += primitiveCounts;
+			}
+			return toStats(total);
+		};
+
+		MeshOptimizationStats stats;
+		stats.mBefore = analyze();
+		pool.parallelFor(mesh.mPrimitives.size(), [&](size_t p) {
+			optimizeVertexCache(primitiveIndices(p));
+			optimizeOverdraw(primitiveIndices(p), mesh.mVertices);
+			});
+		optimizeVertexFetch(mesh);
+		stats.mAfter = analyze();
+		return stats;
+	}
+}
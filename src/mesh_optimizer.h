@@ -0,0 +1,44 @@
+#pragma once
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+// Load-time reordering of triangles and vertices for the GPU's post-transform vertex cache, overdraw and vertex fetch.
+// Every step is deterministic: the same input always gives the same output, whatever the thread count.
+namespace scvk
+{
+	struct VertexCacheStats
+	{
+		float	mACMR{ 0.f };	// Average cache miss ratio: transformed vertices per triangle. 0.5 is ideal for large regular meshes, 3 the worst.
+		float	mATVR{ 0.f };	// Average transform to vertex ratio: transformed vertices per referenced vertex. 1 is ideal.
+	};
+
+	// Simulates a FIFO post-transform cache of cacheSize vertices over indices.
+	VertexCacheStats analyzeVertexCache(std::span<const uint32_t> indices, uint32_t cacheSize = 16);
+
+	// Reorders the triangles of indices for vertex cache locality with Tipsify (Sander et al., "Fast Triangle Reordering
+	// for Vertex Locality and Reduced Overdraw", 2007).
+	void optimizeVertexCache(std::span<uint32_t> indices, uint32_t cacheSize = 16);
+
+	// Splits cache-optimized indices into clusters at cache restarts, and further wherever a cluster's ACMR so far is
+	// within threshold times that of the whole, then draws the clusters most likely to occlude others first.
+	// A higher threshold gives more, smaller clusters: less overdraw for somewhat worse vertex cache efficiency.
+	void optimizeOverdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices, float threshold = 1.05f, uint32_t cacheSize = 16);
+
+	// Renumbers the vertices of mesh in the order the index buffer first references them, so vertex fetches walk memory linearly.
+	// Vertices no index references are kept, after the referenced ones.
+	void optimizeVertexFetch(LoadedMesh& mesh);
+
+	struct MeshOptimizationStats
+	{
+		VertexCacheStats	mBefore;
+		VertexCacheStats	mAfter;
+	};
+
+	// Optimizes the triangle order of every primitive on the pool's workers, then the vertex order of the whole mesh.
+	// mesh must hold its geometry in mVertices and mIndices, not mapped from the scene cache.
+	MeshOptimizationStats optimizeMesh(LoadedMesh& mesh, ThreadPool& pool);
+
+	// Bumped whenever the optimized output changes, so scene caches built with an older version are not reused.
+	constexpr uint32_t MESH_OPTIMIZER_VERSION = 1;
+}
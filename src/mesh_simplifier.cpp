@@ -0,0 +1,321 @@
+#include "mesh_simplifier.h"
+
+#include "mesh_optimizer.h"
+
+namespace scvk
+{
+	namespace
+	{
+		// Stops a level of detail chain when a level keeps more than this fraction of the triangles of the one before.
+		constexpr float MIN_LOD_REDUCTION = 0.8f;
+
+		// Sum of squared distances to a set of planes, as the symmetric matrix of the quadratic form.
+		struct Quadric
+		{
+			double mXX{ 0 }, mXY{ 0 }, mXZ{ 0 }, mXW{ 0 };
+			double mYY{ 0 }, mYZ{ 0 }, mYW{ 0 };
+			double mZZ{ 0 }, mZW{ 0 };
+			double mWW{ 0 };
+			double mPlaneCount{ 0 };
+
+			// The plane dot(normal, p) + d = 0, with a unit normal.
+			void addPlane(const glm::dvec3& normal, double d)
+			{
+				mXX += normal.x * normal.x;	mXY += normal.x * normal.y;	mXZ += normal.x * normal.z;	mXW += normal.x * d;
+				mYY += normal.y * normal.y;	mYZ += normal.y * normal.z;	mYW += normal.y * d;
+				mZZ += normal.z * normal.z;	mZW += normal.z * d;
+				mWW += d * d;
+				mPlaneCount += 1;
+			}
+
+			Quadric& operator+=(const Quadric& q)
+			{
+				mXX += q.mXX; mXY += q.mXY; mXZ += q.mXZ; mXW += q.mXW;
+				mYY += q.mYY; mYZ += q.mYZ; mYW += q.mYW;
+				mZZ += q.mZZ; mZW += q.mZW;
+				mWW += q.mWW;
+				mPlaneCount += q.mPlaneCount;
+				return *this;
+			}
+
+			// Mean squared distance from p to the planes.
+			double evaluate(const glm::dvec3& p) const
+			{
+				const double error = p.x * p.x * mXX + p.y * p.y * mYY + p.z * p.z * mZZ + mWW
+					+ 2 * (p.x * p.y * mXY + p.x * p.z * mXZ + p.y * p.z * mYZ + p.x * mXW + p.y * mYW + p.z * mZW);
+				return mPlaneCount > 0 ? std::max(error, 0.0) / mPlaneCount : 0.0;
+			}
+		};
+
+		struct Collapse
+		{
+			uint32_t	mFrom;
+			uint32_t	mTo;
+			double		mCost;
+		};
+
+		// The triangles around every vertex, in compressed rows.
+		struct Adjacency
+		{
+			std::vector<uint32_t> mOffsets;
+			std::vector<uint32_t> mTriangles;
+
+			std::span<const uint32_t> triangles(uint32_t v) const { return { mTriangles.data() + mOffsets[v], mOffsets[v + 1] - mOffsets[v] }; }
+		};
+
+		Adjacency buildAdjacency(std::span<const uint32_t> indices, size_t vertexCount)
+		{
+			Adjacency adjacency;
+			adjacency.mOffsets.assign(vertexCount + 1, 0);
+			for (const uint32_t v : indices) {
+				++adjacency.mOffsets[v + 1];
+			}
+			std::partial_sum(adjacency.mOffsets.begin(), adjacency.mOffsets.end(), adjacency.mOffsets.begin());
+			adjacency.mTriangles.resize(indices.size());
+			std::vector<uint32_t> cursor(adjacency.mOffsets.begin(), adjacency.mOffsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i) {
+				adjacency.mTriangles[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+			return adjacency;
+		}
+
+		uint64_t edgeKey(uint32_t a, uint32_t b)
+		{
+			return (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+		}
+
+		// False if moving from onto to would flip or collapse a triangle around from that does not contain to.
+		bool keepsOrientation(std::span<const uint32_t> indices, const Adjacency& adjacency, std::span<const glm::vec3> positions, uint32_t from, uint32_t to)
+		{
+			for (const uint32_t t : adjacency.triangles(from)) {
+				const uint32_t* triangle = &indices[t * 3];
+				if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+					continue;
+				}
+				glm::vec3 corners[3];
+				glm::vec3 moved[3];
+				for (size_t c = 0; c < 3; ++c) {
+					corners[c] = positions[triangle[c]];
+					moved[c] = triangle[c] == from ? positions[to] : corners[c];
+				}
+				const glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+				const glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+				if (glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after)) {
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+
+	std::vector<uint32_t> simplifyIndices(std::span<const uint32_t> indices, std::span<const Vertex> vertices, size_t targetIndexCount, float& error)
+	{
+		error = 0.f;
+		if (indices.size() <= targetIndexCount || indices.empty()) {
+			return std::vector<uint32_t>(indices.begin(), indices.end());
+		}
+
+		// Work on local vertex numbers in [0, vertexCount), so per-vertex state stays small for small primitives.
+		const auto [minIndex, maxIndex] = std::minmax_element(indices.begin(), indices.end());
+		const uint32_t base = *minIndex;
+		const size_t vertexCount = size_t(*maxIndex - base) + 1;
+		std::vector<uint32_t> local(indices.size());
+		for (size_t i = 0; i < indices.size(); ++i) {
+			local[i] = indices[i] - base;
+		}
+		std::vector<glm::vec3> positions(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v) {
+			positions[v] = vertices[base + v].position;
+		}
+
+		// Every vertex starts with the planes of its triangles. Collapses accumulate them, so the error of placing a
+		// vertex is its root mean square distance to all the original planes around the triangles it replaced.
+		std::vector<Quadric> quadrics(vertexCount);
+		for (size_t i = 0; i < local.size(); i += 3) {
+			const glm::dvec3 p0 = positions[local[i]];
+			const glm::dvec3 normal = glm::cross(glm::dvec3(positions[local[i + 1]]) - p0, glm::dvec3(positions[local[i + 2]]) - p0);
+			const double length = glm::length(normal);
+			if (length == 0.0) {
+				continue;
+			}
+			Quadric plane;
+			plane.addPlane(normal / length, -glm::dot(normal / length, p0));
+			for (size_t c = 0; c < 3; ++c) {
+				quadrics[local[i + c]] += plane;
+			}
+		}
+
+		// Edges with one triangle are open borders, and edges with more than two are non-manifold. Their vertices are
+		// locked, which keeps the silhouette of open surfaces and the attribute seams where vertices are split.
+		std::vector<uint8_t> locked(vertexCount, 0);
+		{
+			std::vector<uint64_t> edges;
+			edges.reserve(local.size());
+			for (size_t i = 0; i < local.size(); i += 3) {
+				for (size_t c = 0; c < 3; ++c) {
+					edges.push_back(edgeKey(local[i + c], local[i + (c + 1) % 3]));
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+			for (size_t i = 0; i < edges.size();) {
+				size_t j = i + 1;
+				while (j < edges.size() && edges[j] == edges[i]) {
+					++j;
+				}
+				if (j - i != 2) {
+					locked[edges[i] >> 32] = 1;
+					locked[edges[i] & 0xffffffff] = 1;
+				}
+				i = j;
+			}
+		}
+
+		// Each pass collapses the cheapest edges that do not share a neighbourhood, then rebuilds the triangles.
+		const size_t targetTriangles = targetIndexCount / 3;
+		double maxCost = 0.0;
+		std::vector<Collapse> collapses;
+		std::vector<uint64_t> edges;
+		std::vector<uint32_t> remap(vertexCount);
+		std::vector<uint8_t> touched(vertexCount);
+		while (local.size() / 3 > targetTriangles) {
+			const Adjacency adjacency = buildAdjacency(local, vertexCount);
+
+			edges.clear();
+			for (size_t i = 0; i < local.size(); i += 3) {
+				for (size_t c = 0; c < 3; ++c) {
+					edges.push_back(edgeKey(local[i + c], local[i + (c + 1) % 3]));
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+			edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+			collapses.clear();
+			for (const uint64_t edge : edges) {
+				const uint32_t a = static_cast<uint32_t>(edge >> 32);
+				const uint32_t b = static_cast<uint32_t>(edge & 0xffffffff);
+				if (a == b || (locked[a] && locked[b])) {
+					continue;
+				}
+				Quadric combined = quadrics[a];
+				combined += quadrics[b];
+				const double costAB = locked[a] ? std::numeric_limits<double>::max() : combined.evaluate(positions[b]);
+				const double costBA = locked[b] ? std::numeric_limits<double>::max() : combined.evaluate(positions[a]);
+				collapses.push_back(costAB <= costBA ? Collapse{ a, b, costAB } : Collapse{ b, a, costBA });
+			}
+			std::stable_sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.mCost < y.mCost; });
+
+			std::iota(remap.begin(), remap.end(), 0u);
+			std::fill(touched.begin(), touched.end(), uint8_t(0));
+			size_t triangleCount = local.size() / 3;
+			size_t collapsed = 0;
+			for (const Collapse& collapse : collapses) {
+				if (triangleCount <= targetTriangles) {
+					break;
+				}
+				if (touched[collapse.mFrom] || touched[collapse.mTo]) {
+					continue;
+				}
+				if (!keepsOrientation(local, adjacency, positions, collapse.mFrom, collapse.mTo)) {
+					continue;
+				}
+
+				remap[collapse.mFrom] = collapse.mTo;
+				quadrics[collapse.mTo] += quadrics[collapse.mFrom];
+				maxCost = std::max(maxCost, collapse.mCost);
+				++collapsed;
+				// Every triangle around the collapsed vertex changes, so none of their vertices may move again in this pass.
+				for (const uint32_t t : adjacency.triangles(collapse.mFrom)) {
+					const uint32_t* triangle = &local[t * 3];
+					triangleCount -= (triangle[0] == collapse.mTo || triangle[1] == collapse.mTo || triangle[2] == collapse.mTo);
+					for (size_t c = 0; c < 3; ++c) {
+						touched[triangle[c]] = 1;
+					}
+				}
+			}
+			if (collapsed == 0) {
+				break;
+			}
+
+			size_t kept = 0;
+			for (size_t i = 0; i < local.size(); i += 3) {
+				const uint32_t a = remap[local[i]];
+				const uint32_t b = remap[local[i + 1]];
+				const uint32_t c = remap[local[i + 2]];
+				if (a != b && b != c && c != a) {
+					local[kept++] = a;
+					local[kept++] = b;
+					local[kept++] = c;
+				}
+			}
+			local.resize(kept);
+		}
+
+		error = static_cast<float>(std::sqrt(maxCost));
+		for (uint32_t& index : local) {
+			index += base;
+		}
+		return local;
+	}
+
+	void generateLods(LoadedMesh& mesh, ThreadPool& pool)
+	{
+		struct PrimitiveChain
+		{
+			std::vector<std::vector<uint32_t>>	mLevels;
+			std::vector<float>					mErrors;
+		};
+		std::vector<PrimitiveChain> chains(mesh.mPrimitives.size());
+		const std::span<const Vertex> vertices = mesh.mVertices;
+
+		// Every level is simplified from the one before, which is cheaper than starting over from full detail.
+		// The errors of successive levels add up, so a level's error is measured against the full detail surface.
+		pool.parallelFor(chains.size(), [&](size_t p) {
+			const Primitive& primitive = mesh.mPrimitives[p];
+			std::vector<uint32_t> previous(mesh.mIndices.begin() + primitive.firstIndex, mesh.mIndices.begin() + primitive.firstIndex + primitive.indexCount);
+			float previousError = 0.f;
+			for (uint32_t level = 0; level < MAX_LOD_COUNT; ++level) {
+				const size_t target = previous.size() / 6 * 3;
+				float error = 0.f;
+				std::vector<uint32_t> simplified = simplifyIndices(previous, vertices, target, error);
+				if (simplified.empty() || simplified.size() > previous.size() * MIN_LOD_REDUCTION) {
+					break;
+				}
+				optimizeVertexCache(simplified);
+				previousError += error;
+				chains[p].mErrors.push_back(previousError);
+				chains[p].mLevels.push_back(simplified);
+				previous = std::move(simplified);
+			}
+			});
+
+		// Bounding spheres for projecting the errors on screen.
+		mesh.mPrimitiveLods.resize(mesh.mPrimitives.size());
+		pool.parallelFor(mesh.mPrimitives.size(), [&](size_t p) {
+			const Primitive& primitive = mesh.mPrimitives[p];
+			glm::vec3 minimum(std::numeric_limits<float>::max());
+			glm::vec3 maximum(std::numeric_limits<float>::lowest());
+			for (uint32_t i = primitive.firstIndex; i < primitive.firstIndex + primitive.indexCount; ++i) {
+				minimum = glm::min(minimum, vertices[mesh.mIndices[i]].position);
+				maximum = glm::max(maximum, vertices[mesh.mIndices[i]].position);
+			}
+			PrimitiveLods& lods = mesh.mPrimitiveLods[p];
+			lods.center = primitive.indexCount > 0 ? (minimum + maximum) * 0.5f : glm::vec3(0.f);
+			lods.radius = primitive.indexCount > 0 ? glm::length(maximum - minimum) * 0.5f : 0.f;
+			});
+
+		mesh.mLods.clear();
+		for (size_t p = 0; p < chains.size(); ++p) {
+			PrimitiveLods& lods = mesh.mPrimitiveLods[p];
+			lods.firstLod = static_cast<uint32_t>(mesh.mLods.size());
+			lods.lodCount = static_cast<uint32_t>(chains[p].mLevels.size());
+			for (size_t level = 0; level < chains[p].mLevels.size(); ++level) {
+				const std::vector<uint32_t>& levelIndices = chains[p].mLevels[level];
+				mesh.mLods.push_back({
+					.indexCount = static_cast<uint32_t>(levelIndices.size()),
+					.firstIndex = static_cast<uint32_t>(mesh.mIndices.size()),
+					.error = chains[p].mErrors[level] });
+				mesh.mIndices.insert(mesh.mIndices.end(), levelIndices.begin(), levelIndices.end());
+			}
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+// Edge-collapse simplification driven by quadric error metrics (Garland and Heckbert, "Surface Simplification
+// Using Quadric Error Metrics", 1997), and the level of detail chains built with it.
+namespace scvk
+{
+	// Collapses edges of the triangles in indices, cheapest first, until at most targetIndexCount indices remain
+	// or no edge can be collapsed. Vertices only move onto other existing vertices, so the result indexes the same
+	// vertex buffer. Vertices on open or non-manifold edges, which include UV and normal seams, never move.
+	// error receives the largest error of the collapses made: the root mean square distance from a moved vertex to the
+	// planes of the input triangles it replaced, in the units of the positions.
+	std::vector<uint32_t> simplifyIndices(std::span<const uint32_t> indices, std::span<const Vertex> vertices, size_t targetIndexCount, float& error);
+
+	// Builds up to MAX_LOD_COUNT levels of detail for every primitive, each with about half the triangles of the one
+	// before, on the pool's workers. Their indices are appended to mesh.mIndices, reordered for the vertex cache, and
+	// described by mesh.mLods and mesh.mPrimitiveLods. A primitive's chain stops early once simplification stalls.
+	// mesh must hold its geometry in mVertices and mIndices, not mapped from the scene cache.
+	void generateLods(LoadedMesh& mesh, ThreadPool& pool);
+
+	constexpr uint32_t MAX_LOD_COUNT = 5;
+
+	// Bumped whenever the generated levels change, so scene caches built with an older version are not reused.
+	constexpr uint32_t LOD_GENERATOR_VERSION = 1;
+}
@@ -0,0 +1,192 @@
+#include "meshlet_builder.h"
+
+namespace scvk
+{
+	namespace
+	{
+		constexpr uint8_t NO_SLOT = 0xff;
+
+		struct PrimitiveMeshlets
+		{
+			std::vector<Meshlet>	mMeshlets;
+			std::vector<uint32_t>	mVertices;
+			std::vector<uint32_t>	mTriangles;
+		};
+
+		// Bounding sphere and normal cone of the triangles of meshlet, which index positions through its vertices.
+		void computeMeshletBounds(Meshlet& meshlet, std::span<const uint32_t> vertices, std::span<const uint32_t> triangles, std::span<const glm::vec3> positions, bool bDoubleSided)
+		{
+			glm::vec3 minimum(std::numeric_limits<float>::max());
+			glm::vec3 maximum(std::numeric_limits<float>::lowest());
+			for (const uint32_t v : vertices) {
+				minimum = glm::min(minimum, positions[v]);
+				maximum = glm::max(maximum, positions[v]);
+			}
+			meshlet.center = (minimum + maximum) * 0.5f;
+			meshlet.radius = 0.f;
+			for (const uint32_t v : vertices) {
+				meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, positions[v]));
+			}
+
+			// Without a usable cone the meshlet is never culled for facing away.
+			meshlet.coneApex = meshlet.center;
+			meshlet.coneAxis = glm::vec3(0.f, 0.f, 1.f);
+			meshlet.coneCutoff = 2.f;
+			if (bDoubleSided) {
+				return;
+			}
+
+			// The unit normal and a point of every triangle that has an area.
+			struct TrianglePlane
+			{
+				glm::vec3 mPoint;
+				glm::vec3 mNormal;
+			};
+			const auto corner = [&](uint32_t triangle, uint32_t c) { return positions[vertices[(triangle >> (c * 8)) & 0xff]]; };
+			std::vector<TrianglePlane> planes;
+			planes.reserve(triangles.size());
+			glm::vec3 axis(0.f);
+			for (const uint32_t triangle : triangles) {
+				const glm::vec3 p0 = corner(triangle, 0);
+				const glm::vec3 normal = glm::cross(corner(triangle, 1) - p0, corner(triangle, 2) - p0);
+				const float length = glm::length(normal);
+				if (length > 0.f) {
+					planes.push_back({ p0, normal / length });
+					axis += planes.back().mNormal;
+				}
+			}
+
+			const float axisLength = glm::length(axis);
+			if (axisLength == 0.f) {
+				return;
+			}
+			axis /= axisLength;
+			float minimumDot = 1.f;
+			for (const TrianglePlane& plane : planes) {
+				minimumDot = std::min(minimumDot, glm::dot(axis, plane.mNormal));
+			}
+			// Normals spread over nearly a hemisphere or more leave too few viewpoints from which everything faces away.
+			if (minimumDot <= 0.1f) {
+				return;
+			}
+
+			// Move the apex back along the axis until it is behind the plane of every triangle,
+			// so that a viewer inside the cone behind it sees the back of all of them.
+			float apexDistance = 0.f;
+			for (const TrianglePlane& plane : planes) {
+				apexDistance = std::max(apexDistance, glm::dot(meshlet.center - plane.mPoint, plane.mNormal) / glm::dot(axis, plane.mNormal));
+			}
+			meshlet.coneApex = meshlet.center - axis * apexDistance;
+			meshlet.coneAxis = axis;
+			meshlet.coneCutoff = std::sqrt(1.f - minimumDot * minimumDot);
+		}
+
+		// Greedily fills meshlets with the triangles of indices in order, starting a new one when the next triangle
+		// would exceed either limit.
+		PrimitiveMeshlets buildPrimitiveMeshlets(std::span<const uint32_t> indices, std::span<const glm::vec3> positions, bool bDoubleSided)
+		{
+			PrimitiveMeshlets result;
+			if (indices.empty()) {
+				return result;
+			}
+			const auto [minIndex, maxIndex] = std::minmax_element(indices.begin(), indices.end());
+			const uint32_t base = *minIndex;
+			std::vector<uint8_t> slots(size_t(*maxIndex - base) + 1, NO_SLOT);	// Position of a vertex in the current meshlet.
+
+			Meshlet meshlet{};
+			const auto finishMeshlet = [&]() {
+				const std::span<const uint32_t> vertices(result.mVertices.data() + meshlet.vertexOffset, meshlet.vertexCount);
+				const std::span<const uint32_t> triangles(result.mTriangles.data() + meshlet.triangleOffset, meshlet.triangleCount);
+				computeMeshletBounds(meshlet, vertices, triangles, positions, bDoubleSided);
+				for (const uint32_t v : vertices) {
+					slots[v - base] = NO_SLOT;
+				}
+				result.mMeshlets.push_back(meshlet);
+				meshlet = {};
+				meshlet.vertexOffset = static_cast<uint32_t>(result.mVertices.size());
+				meshlet.triangleOffset = static_cast<uint32_t>(result.mTriangles.size());
+			};
+
+			for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+				const uint32_t corners[3] = { indices[i], indices[i + 1], indices[i + 2] };
+				uint32_t newVertices = 0;
+				for (size_t c = 0; c < 3; ++c) {
+					const bool bRepeated = (c > 0 && corners[c] == corners[0]) || (c > 1 && corners[c] == corners[1]);
+					newVertices += slots[corners[c] - base] == NO_SLOT && !bRepeated;
+				}
+				if (meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES || meshlet.triangleCount == MESHLET_MAX_TRIANGLES) {
+					finishMeshlet();
+				}
+
+				uint32_t triangle = 0;
+				for (size_t c = 0; c < 3; ++c) {
+					uint8_t& slot = slots[corners[c] - base];
+					if (slot == NO_SLOT) {
+						slot = static_cast<uint8_t>(meshlet.vertexCount++);
+						result.mVertices.push_back(corners[c]);
+					}
+					triangle |= uint32_t(slot) << (c * 8);
+				}
+				result.mTriangles.push_back(triangle);
+				++meshlet.triangleCount;
+			}
+			if (meshlet.triangleCount > 0) {
+				finishMeshlet();
+			}
+			return result;
+		}
+	}
+
+	void buildMeshlets(LoadedMesh& mesh, ThreadPool& pool)
+	{
+		// Bounds are computed on the positions the shaders decode, before dequantization.
+		const std::span<const Vertex> vertices = mesh.vertexData();
+		const glm::mat4 toVertexSpace = glm::inverse(mesh.mPositionDequantization);
+		std::vector<glm::vec3> positions(vertices.size());
+		pool.parallelFor(positions.size(), [&](size_t v) { positions[v] = glm::vec3(toVertexSpace * glm::vec4(vertices[v].position, 1.f)); });
+
+		// Every primitive, then every level of detail, each split on its own.
+		struct MeshletSource
+		{
+			uint32_t	mFirstIndex;
+			uint32_t	mIndexCount;
+			bool		bDoubleSided;
+		};
+		std::vector<MeshletSource> sources(mesh.mPrimitives.size() + mesh.mLods.size());
+		for (size_t p = 0; p < mesh.mPrimitives.size(); ++p) {
+			const Primitive& primitive = mesh.mPrimitives[p];
+			sources[p] = { primitive.firstIndex, primitive.indexCount, primitive.doubleSided != 0 };
+			if (p < mesh.mPrimitiveLods.size()) {
+				const PrimitiveLods& lods = mesh.mPrimitiveLods[p];
+				for (uint32_t l = lods.firstLod; l < lods.firstLod + lods.lodCount; ++l) {
+					sources[mesh.mPrimitives.size() + l] = { mesh.mLods[l].firstIndex, mesh.mLods[l].indexCount, primitive.doubleSided != 0 };
+				}
+			}
+		}
+
+		const std::span<const uint32_t> indices = mesh.indexData();
+		std::vector<PrimitiveMeshlets> primitives(sources.size());
+		pool.parallelFor(primitives.size(), [&](size_t p) {
+			const MeshletSource& source = sources[p];
+			primitives[p] = buildPrimitiveMeshlets(indices.subspan(source.mFirstIndex, source.mIndexCount), positions, source.bDoubleSided);
+			});
+
+		mesh.mPrimitiveMeshlets.clear();
+		mesh.mLodMeshlets.clear();
+		mesh.mMeshlets.clear();
+		mesh.mMeshletVertices.clear();
+		mesh.mMeshletTriangles.clear();
+		for (size_t p = 0; p < primitives.size(); ++p) {
+			const PrimitiveMeshlets& primitive = primitives[p];
+			std::vector<MeshletRange>& ranges = p < mesh.mPrimitives.size() ? mesh.mPrimitiveMeshlets : mesh.mLodMeshlets;
+			ranges.push_back({ static_cast<uint32_t>(mesh.mMeshlets.size()), static_cast<uint32_t>(primitive.mMeshlets.size()) });
+			for (Meshlet meshlet : primitive.mMeshlets) {
+				meshlet.vertexOffset += static_cast<uint32_t>(mesh.mMeshletVertices.size());
+				meshlet.triangleOffset += static_cast<uint32_t>(mesh.mMeshletTriangles.size());
+				mesh.mMeshlets.push_back(meshlet);
+			}
+			mesh.mMeshletVertices.insert(mesh.mMeshletVertices.end(), primitive.mVertices.begin(), primitive.mVertices.end());
+			mesh.mMeshletTriangles.insert(mesh.mMeshletTriangles.end(), primitive.mTriangles.begin(), primitive.mTriangles.end());
+		}
+	}
+}
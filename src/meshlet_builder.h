@@ -0,0 +1,16 @@
+#pragma once
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace scvk
+{
+	// Splits every primitive and level of detail of mesh into meshlets of at most MESHLET_MAX_VERTICES vertices and
+	// MESHLET_MAX_TRIANGLES triangles, filling mesh.mPrimitiveMeshlets, mLodMeshlets, mMeshlets, mMeshletVertices and
+	// mMeshletTriangles.
+	// Triangles are taken in index buffer order, so meshlets are most compact after optimizeMesh().
+	// Run it after packVertices(): bounds and normal cones are computed in the space of the uploaded positions.
+	// Meshlets of double-sided primitives get no normal cone, as every pipeline rasterizes both faces.
+	// Primitives are processed on the pool's workers; the result does not depend on the thread count.
+	void buildMeshlets(LoadedMesh& mesh, ThreadPool& pool);
+}
@@ -0,0 +1,637 @@
+#include "obj_loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <unordered_map>
+
+#include "hash.h"
+#include "mapped_file.h"
+#include "timer.h"
+
+namespace scvk
+{
+	namespace
+	{
+		constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+		// Chunks are at least this large, so small files are not split into more jobs than they are worth.
+		constexpr size_t MIN_CHUNK_BYTES = 1024 * 1024;
+
+		// The position, texcoord and normal indices of one face corner, 0-based and file-wide. NO_INDEX marks a missing attribute.
+		struct ObjCorner
+		{
+			uint32_t mPosition;
+			uint32_t mTexcoord;
+			uint32_t mNormal;
+
+			bool operator==(const ObjCorner&) const = default;
+		};
+
+		struct MaterialRun
+		{
+			size_t		mFirstTriangle;
+			std::string	mName;
+		};
+
+		// Everything parsed from one chunk of lines. Triangle and element numbers are relative to the chunk until it is merged.
+		struct ObjChunk
+		{
+			std::string_view			mText;
+
+			std::vector<float>			mPositions;		// xyz
+			std::vector<float>			mColors;		// rgb per position. Empty unless a vertex in the chunk has a color.
+			std::vector<float>			mTexcoords;		// uv
+			std::vector<float>			mNormals;		// xyz
+			std::vector<ObjCorner>		mCorners;		// 3 per triangle.
+
+			// Negative OBJ indices count back from the latest element, which may be in an earlier chunk. They are stored as signed
+			// offsets from the chunk's first element, and these are the components (corner * 3 + attribute) to rebase once it is known.
+			std::vector<size_t>			mRelativeIndices;
+
+			std::vector<MaterialRun>	mMaterialRuns;
+			std::vector<std::string>	mMaterialLibraries;
+			std::string					mError;
+			size_t						mErrorLine{ 0 };	// Within the chunk, 1-based.
+		};
+
+		const char* skipSpaces(const char* p, const char* end)
+		{
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+				++p;
+			}
+			return p;
+		}
+
+		std::string_view trim(std::string_view text)
+		{
+			const size_t first = text.find_first_not_of(" \t\r");
+			if (first == std::string_view::npos) {
+				return {};
+			}
+			return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+		}
+
+		// Parses up to maxCount whitespace-separated floats and returns how many were read.
+		int parseFloats(const char*& p, const char* end, float* values, int maxCount)
+		{
+			int count = 0;
+			while (count < maxCount) {
+				p = skipSpaces(p, end);
+				if (p < end && *p == '+') {
+					++p;
+				}
+				const auto [next, error] = std::from_chars(p, end, values[count]);
+				if (error != std::errc()) {
+					break;
+				}
+				p = next;
+				++count;
+			}
+			return count;
+		}
+
+		bool parseIndex(const char*& p, const char* end, int64_t& index)
+		{
+			const auto [next, error] = std::from_chars(p, end, index);
+			if (error != std::errc() || index == 0) {
+				return false;
+			}
+			p = next;
+			return true;
+		}
+
+		// Parses a "v", "v/t", "v//n" or "v/t/n" face vertex into 1-based or negative OBJ indices, 0 marking a missing one.
+		bool parseFaceVertex(const char*& p, const char* end, int64_t (&indices)[3])
+		{
+			indices[0] = indices[1] = indices[2] = 0;
+			if (!parseIndex(p, end, indices[0])) {
+				return false;
+			}
+			if (p < end && *p == '/') {
+				++p;
+				if (p < end && *p != '/' && !parseIndex(p, end, indices[1])) {
+					return false;
+				}
+				if (p < end && *p == '/') {
+					++p;
+					if (!parseIndex(p, end, indices[2])) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		// Turns an OBJ index into a 0-based one. Negative indices become offsets from the chunk's first element, and set bRelative.
+		uint32_t resolveIndex(int64_t index, size_t elementCount, bool& bRelative)
+		{
+			bRelative = index < 0;
+			if (index == 0) {
+				return NO_INDEX;
+			}
+			if (index > 0) {
+				return static_cast<uint32_t>(index - 1);
+			}
+			return static_cast<uint32_t>(static_cast<int32_t>(static_cast<int64_t>(elementCount) + index));
+		}
+
+		struct PolygonCorner
+		{
+			ObjCorner	mCorner;
+			bool		bRelative[3];
+		};
+
+		void parseChunk(ObjChunk& chunk)
+		{
+			std::vector<PolygonCorner> polygon;
+			const char* p = chunk.mText.data();
+			const char* const end = p + chunk.mText.size();
+			size_t lineNumber = 0;
+
+			while (p < end && chunk.mError.empty()) {
+				const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+				if (!lineEnd) {
+					lineEnd = end;
+				}
+				++lineNumber;
+
+				const char* cursor = skipSpaces(p, lineEnd);
+				const char* keywordEnd = cursor;
+				while (keywordEnd < lineEnd && *keywordEnd != ' ' && *keywordEnd != '\t' && *keywordEnd != '\r') {
+					++keywordEnd;
+				}
+				const std::string_view keyword(cursor, keywordEnd - cursor);
+				cursor = keywordEnd;
+
+				if (keyword == "v") {
+					// "v x y z", optionally followed by w, or by an rgb color as written by many scanners.
+					float values[7];
+					const int count = parseFloats(cursor, lineEnd, values, 7);
+					if (count < 3) {
+						chunk.mError = "invalid vertex position";
+						break;
+					}
+					chunk.mPositions.insert(chunk.mPositions.end(), values, values + 3);
+					if (count >= 6) {
+						if (chunk.mColors.empty()) {
+							chunk.mColors.resize(chunk.mPositions.size() - 3, 1.f);
+						}
+						const float* color = values + (count == 7 ? 4 : 3);
+						chunk.mColors.insert(chunk.mColors.end(), color, color + 3);
+					}
+					else if (!chunk.mColors.empty()) {
+						chunk.mColors.insert(chunk.mColors.end(), { 1.f, 1.f, 1.f });
+					}
+				}
+				else if (keyword == "vt") {
+					float values[3] = { 0.f, 0.f, 0.f };
+					if (parseFloats(cursor, lineEnd, values, 3) < 1) {
+						chunk.mError = "invalid texture coordinate";
+						break;
+					}
+					chunk.mTexcoords.insert(chunk.mTexcoords.end(), values, values + 2);
+				}
+				else if (keyword == "vn") {
+					float values[3];
+					if (parseFloats(cursor, lineEnd, values, 3) != 3) {
+						chunk.mError = "invalid normal";
+						break;
+					}
+					chunk.mNormals.insert(chunk.mNormals.end(), values, values + 3);
+				}
+				else if (keyword == "f") {
+					polygon.clear();
+					while (true) {
+						cursor = skipSpaces(cursor, lineEnd);
+						if (cursor == lineEnd) {
+							break;
+						}
+						int64_t indices[3];
+						if (!parseFaceVertex(cursor, lineEnd, indices)) {
+							chunk.mError = "invalid face";
+							break;
+						}
+						PolygonCorner& corner = polygon.emplace_back();
+						corner.mCorner.mPosition = resolveIndex(indices[0], chunk.mPositions.size() / 3, corner.bRelative[0]);
+						corner.mCorner.mTexcoord = resolveIndex(indices[1], chunk.mTexcoords.size() / 2, corner.bRelative[1]);
+						corner.mCorner.mNormal = resolveIndex(indices[2], chunk.mNormals.size() / 3, corner.bRelative[2]);
+					}
+					if (!chunk.mError.empty()) {
+						break;
+					}
+					if (polygon.size() < 3) {
+						chunk.mError = "face with fewer than 3 vertices";
+						break;
+					}
+
+					// Triangulate as a fan.
+					for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+						for (const size_t fanCorner : { size_t(0), i, i + 1 }) {
+							const PolygonCorner& corner = polygon[fanCorner];
+							for (size_t attribute = 0; attribute < 3; ++attribute) {
+								if (corner.bRelative[attribute]) {
+									chunk.mRelativeIndices.push_back(chunk.mCorners.size() * 3 + attribute);
+								}
+							}
+							chunk.mCorners.push_back(corner.mCorner);
+						}
+					}
+				}
+				else if (keyword == "usemtl") {
+					chunk.mMaterialRuns.push_back({ .mFirstTriangle = chunk.mCorners.size() / 3, .mName = std::string(trim(std::string_view(cursor, lineEnd - cursor))) });
+				}
+				else if (keyword == "mtllib") {
+					std::string_view libraries = trim(std::string_view(cursor, lineEnd - cursor));
+					while (!libraries.empty()) {
+						const size_t space = libraries.find_first_of(" \t");
+						chunk.mMaterialLibraries.emplace_back(libraries.substr(0, space));
+						libraries = space == std::string_view::npos ? std::string_view() : trim(libraries.substr(space));
+					}
+				}
+				// Anything else (comments, groups, smoothing groups, lines, points) does not affect the triangles.
+
+				p = lineEnd + 1;
+			}
+
+			if (!chunk.mError.empty()) {
+				chunk.mErrorLine = lineNumber;
+			}
+		}
+
+		// Splits text into about chunkCount chunks that each end after a newline.
+		std::vector<ObjChunk> splitIntoChunks(std::string_view text, size_t chunkCount)
+		{
+			const size_t chunkBytes = std::max(MIN_CHUNK_BYTES, text.size() / std::max<size_t>(chunkCount, 1) + 1);
+			std::vector<ObjChunk> chunks;
+			size_t begin = 0;
+			while (begin < text.size()) {
+				size_t end = std::min(text.size(), begin + chunkBytes);
+				if (end < text.size()) {
+					const size_t newline = text.find('\n', end);
+					end = newline == std::string_view::npos ? text.size() : newline + 1;
+				}
+				chunks.emplace_back().mText = text.substr(begin, end - begin);
+				begin = end;
+			}
+			return chunks;
+		}
+
+		// Reads the diffuse texture of every material of an MTL file. Missing textures are reported and left empty.
+		void parseMaterialLibrary(const std::filesystem::path& path, std::unordered_map<std::string, std::filesystem::path>& diffuseTextures)
+		{
+			std::ifstream file(path);
+			if (!file) {
+				fmt::println("Failed to open material library '{}'", path.string());
+				return;
+			}
+			std::string currentMaterial;
+			std::string line;
+			while (std::getline(file, line)) {
+				const std::string_view text = trim(line);
+				if (text.starts_with("newmtl")) {
+					currentMaterial = trim(text.substr(6));
+					diffuseTextures.try_emplace(currentMaterial);
+				}
+				else if (text.starts_with("map_Kd")) {
+					// Texture options may precede the file name, which is taken to be the last token.
+					const std::string_view arguments = trim(text.substr(6));
+					std::string fileName(arguments.substr(arguments.find_last_of(" \t") == std::string_view::npos ? 0 : arguments.find_last_of(" \t") + 1));
+					std::replace(fileName.begin(), fileName.end(), '\\', '/');
+					const std::filesystem::path texturePath = path.parent_path() / fileName;
+					if (std::filesystem::exists(texturePath)) {
+						diffuseTextures[currentMaterial] = texturePath;
+					}
+					else {
+						fmt::println("Texture '{}' of material '{}' not found", texturePath.string(), currentMaterial);
+					}
+				}
+			}
+		}
+
+		// Open-addressing hash set of corners, keyed on their indices. Slots hold corner numbers, so the keys are read from corners.
+		class CornerTable
+		{
+		public:
+
+			CornerTable(std::span<const ObjCorner> corners, std::span<const uint64_t> hashes, size_t expectedCount)
+				: mCorners(corners), mHashes(hashes)
+			{
+				size_t capacity = 1024;
+				while (capacity < expectedCount * 2) {
+					capacity *= 2;
+				}
+				mSlots.assign(capacity, NO_INDEX);
+			}
+
+			// Returns the first inserted corner with the same indices as corner, inserting corner itself if there is none.
+			uint32_t findOrInsert(uint32_t corner)
+			{
+				if ((mCount + 1) * 2 > mSlots.size()) {
+					grow();
+				}
+				const size_t mask = mSlots.size() - 1;
+				for (size_t slot = mHashes[corner] & mask;; slot = (slot + 1) & mask) {
+					const uint32_t entry = mSlots[slot];
+					if (entry == NO_INDEX) {
+						mSlots[slot] = corner;
+						++mCount;
+						return corner;
+					}
+					if (mCorners[entry] == mCorners[corner]) {
+						return entry;
+					}
+				}
+			}
+
+		private:
+
+			void grow()
+			{
+				std::vector<uint32_t> slots(mSlots.size() * 2, NO_INDEX);
+				const size_t mask = slots.size() - 1;
+				for (const uint32_t entry : mSlots) {
+					if (entry == NO_INDEX) {
+						continue;
+					}
+					size_t slot = mHashes[entry] & mask;
+					while (slots[slot] != NO_INDEX) {
+						slot = (slot + 1) & mask;
+					}
+					slots[slot] = entry;
+				}
+				mSlots = std::move(slots);
+			}
+
+			std::span<const ObjCorner>	mCorners;
+			std::span<const uint64_t>	mHashes;
+			std::vector<uint32_t>		mSlots;
+			size_t						mCount{ 0 };
+		};
+	}
+
+	bool loadObj(const std::filesystem::path& path, ThreadPool& pool, ObjScene& scene)
+	{
+		Timer parseTimer;
+		parseTimer.start();
+
+		const auto file = MappedFile::open(path);
+		if (!file) {
+			fmt::println("Failed to open '{}'", path.string());
+			return false;
+		}
+		const std::string_view text(reinterpret_cast<const char*>(file->bytes().data()), file->bytes().size());
+		scene.mFileBytes = text.size();
+
+		// Parse the chunks independently; nothing in a line depends on the lines before it, except relative indices.
+		std::vector<ObjChunk> chunks = splitIntoChunks(text, size_t(pool.size()) * 4);
+		pool.parallelFor(chunks.size(), [&](size_t i) { parseChunk(chunks[i]); });
+
+		size_t positionCount = 0;
+		size_t texcoordCount = 0;
+		size_t normalCount = 0;
+		size_t cornerCount = 0;
+		bool bHasColors = false;
+		struct ChunkBase
+		{
+			size_t mPosition;
+			size_t mTexcoord;
+			size_t mNormal;
+			size_t mCorner;
+		};
+		std::vector<ChunkBase> bases(chunks.size());
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			if (!chunks[i].mError.empty()) {
+				const size_t line = std::count(text.data(), chunks[i].mText.data(), '\n') + chunks[i].mErrorLine;
+				fmt::println("Failed to parse '{}': {} on line {}", path.string(), chunks[i].mError, line);
+				return false;
+			}
+			bases[i] = { positionCount, texcoordCount, normalCount, cornerCount };
+			positionCount += chunks[i].mPositions.size() / 3;
+			texcoordCount += chunks[i].mTexcoords.size() / 2;
+			normalCount += chunks[i].mNormals.size() / 3;
+			cornerCount += chunks[i].mCorners.size();
+			bHasColors = bHasColors || !chunks[i].mColors.empty();
+		}
+		if (cornerCount >= NO_INDEX || positionCount >= NO_INDEX) {
+			fmt::println("Failed to load '{}': too many vertices for 32-bit indices", path.string());
+			return false;
+		}
+
+		// Gather the chunks into file-wide arrays, rebasing relative indices and checking every index as they are copied.
+		std::vector<float> positions(positionCount * 3);
+		std::vector<float> colors(bHasColors ? positionCount * 3 : 0);
+		std::vector<float> texcoords(texcoordCount * 2);
+		std::vector<float> normals(normalCount * 3);
+		UninitializedVector<ObjCorner> corners(cornerCount);
+		std::atomic<bool> bIndexOutOfRange{ false };
+		pool.parallelFor(chunks.size(), [&](size_t i) {
+			ObjChunk& chunk = chunks[i];
+			const ChunkBase& base = bases[i];
+			std::copy(chunk.mPositions.begin(), chunk.mPositions.end(), positions.begin() + base.mPosition * 3);
+			if (bHasColors) {
+				if (chunk.mColors.empty()) {
+					std::fill_n(colors.begin() + base.mPosition * 3, chunk.mPositions.size(), 1.f);
+				}
+				std::copy(chunk.mColors.begin(), chunk.mColors.end(), colors.begin() + base.mPosition * 3);
+			}
+			std::copy(chunk.mTexcoords.begin(), chunk.mTexcoords.end(), texcoords.begin() + base.mTexcoord * 2);
+			std::copy(chunk.mNormals.begin(), chunk.mNormals.end(), normals.begin() + base.mNormal * 3);
+
+			uint32_t* components = reinterpret_cast<uint32_t*>(chunk.mCorners.data());
+			const size_t componentBases[3] = { base.mPosition, base.mTexcoord, base.mNormal };
+			for (const size_t component : chunk.mRelativeIndices) {
+				components[component] = static_cast<uint32_t>(static_cast<int64_t>(componentBases[component % 3]) + static_cast<int32_t>(components[component]));
+			}
+
+			for (size_t c = 0; c < chunk.mCorners.size(); ++c) {
+				const ObjCorner& corner = chunk.mCorners[c];
+				if (corner.mPosition >= positionCount ||
+					(corner.mTexcoord != NO_INDEX && corner.mTexcoord >= texcoordCount) ||
+					(corner.mNormal != NO_INDEX && corner.mNormal >= normalCount)) {
+					bIndexOutOfRange = true;
+				}
+				corners[base.mCorner + c] = corner;
+			}
+
+			// The chunk's arrays are no longer needed; release them while the other chunks are still being gathered.
+			chunk.mPositions = {};
+			chunk.mColors = {};
+			chunk.mTexcoords = {};
+			chunk.mNormals = {};
+			chunk.mCorners = {};
+			});
+		if (bIndexOutOfRange) {
+			fmt::println("Failed to load '{}': face index out of range", path.string());
+			return false;
+		}
+		scene.mParseMs = parseTimer.total<std::milli>();
+
+		Timer weldTimer;
+		weldTimer.start();
+
+		// Weld: every shard owns the corners whose hash falls into it, and finds the first corner with the same indices for each of them.
+		// Passes over all corners are split into blocks, so that they run in parallel too.
+		const size_t shardCount = pool.size();
+		const size_t blockCount = std::max<size_t>(1, std::min(cornerCount, size_t(pool.size()) * 4));
+		const size_t blockSize = (cornerCount + blockCount - 1) / blockCount;
+		UninitializedVector<uint64_t> hashes(cornerCount);
+		UninitializedVector<uint32_t> firstCorner(cornerCount);
+		pool.parallelFor(cornerCount, [&](size_t i) { hashes[i] = hashBytes(&corners[i], sizeof(ObjCorner)); });
+		const auto shardOf = [&](size_t corner) { return static_cast<size_t>((hashes[corner] >> 40) % shardCount); };
+
+		// Bucket the corners by shard with a counting sort, so each shard reads only its own corners. Buckets are
+		// filled block by block, which keeps every shard's corners in file order and the first corner of each vertex first.
+		// shardOffsets[shard * blockCount + block] is where the corners of a block that fall into a shard start.
+		std::vector<size_t> shardOffsets(shardCount * blockCount + 1, 0);
+		pool.parallelFor(blockCount, [&](size_t block) {
+			for (size_t i = block * blockSize; i < std::min(cornerCount, (block + 1) * blockSize); ++i) {
+				++shardOffsets[shardOf(i) * blockCount + block + 1];
+			}
+			});
+		std::partial_sum(shardOffsets.begin(), shardOffsets.end(), shardOffsets.begin());
+		UninitializedVector<uint32_t> shardCorners(cornerCount);
+		pool.parallelFor(blockCount, [&](size_t block) {
+			std::vector<size_t> next(shardCount);
+			for (size_t shard = 0; shard < shardCount; ++shard) {
+				next[shard] = shardOffsets[shard * blockCount + block];
+			}
+			for (size_t i = block * blockSize; i < std::min(cornerCount, (block + 1) * blockSize); ++i) {
+				shardCorners[next[shardOf(i)]++] = static_cast<uint32_t>(i);
+			}
+			});
+		pool.parallelFor(shardCount, [&](size_t shard) {
+			const size_t begin = shardOffsets[shard * blockCount];
+			const size_t end = shardOffsets[(shard + 1) * blockCount];
+			CornerTable table(corners, hashes, (end - begin) / 4);
+			for (size_t i = begin; i < end; ++i) {
+				firstCorner[shardCorners[i]] = table.findOrInsert(shardCorners[i]);
+			}
+			});
+		shardCorners = {};
+		hashes = {};
+
+		// Number the unique corners in the order faces first use them, and write their vertices.
+		std::vector<uint32_t> blockFirstVertex(blockCount + 1, 0);
+		pool.parallelFor(blockCount, [&](size_t block) {
+			uint32_t count = 0;
+			for (size_t i = block * blockSize; i < std::min(cornerCount, (block + 1) * blockSize); ++i) {
+				count += firstCorner[i] == i;
+			}
+			blockFirstVertex[block + 1] = count;
+			});
+		std::partial_sum(blockFirstVertex.begin(), blockFirstVertex.end(), blockFirstVertex.begin());
+
+		LoadedMesh& mesh = scene.mMesh;
+		mesh.mVertices.resize(blockFirstVertex.back());
+		UninitializedVector<uint32_t> cornerVertex(cornerCount);
+		pool.parallelFor(blockCount, [&](size_t block) {
+			uint32_t vertexIndex = blockFirstVertex[block];
+			for (size_t i = block * blockSize; i < std::min(cornerCount, (block + 1) * blockSize); ++i) {
+				if (firstCorner[i] != i) {
+					continue;
+				}
+				const ObjCorner& corner = corners[i];
+				Vertex& vertex = mesh.mVertices[vertexIndex];
+				const float* position = &positions[size_t(corner.mPosition) * 3];
+				vertex.position = { position[0], position[1], position[2] };
+				if (corner.mNormal != NO_INDEX) {
+					const float* normal = &normals[size_t(corner.mNormal) * 3];
+					vertex.normal = { normal[0], normal[1], normal[2] };
+				}
+				else {
+					vertex.normal = { 0.f, 1.f, 0.f };
+				}
+				// OBJ texture coordinates start at the bottom of the image, Vulkan's at the top.
+				vertex.uv_x = corner.mTexcoord != NO_INDEX ? texcoords[size_t(corner.mTexcoord) * 2] : 0.f;
+				vertex.uv_y = corner.mTexcoord != NO_INDEX ? 1.f - texcoords[size_t(corner.mTexcoord) * 2 + 1] : 0.f;
+				if (bHasColors) {
+					const float* color = &colors[size_t(corner.mPosition) * 3];
+					vertex.color = { color[0], color[1], color[2], 1.f };
+				}
+				else {
+					vertex.color = glm::vec4(1.f);
+				}
+				cornerVertex[i] = vertexIndex++;
+			}
+			});
+		pool.parallelFor(blockCount, [&](size_t block) {
+			for (size_t i = block * blockSize; i < std::min(cornerCount, (block + 1) * blockSize); ++i) {
+				cornerVertex[i] = cornerVertex[firstCorner[i]];
+			}
+			});
+
+		// Resolve the material of every triangle, numbering the materials in the order they are first used.
+		std::unordered_map<std::string, std::filesystem::path> diffuseTextures;
+		for (const ObjChunk& chunk : chunks) {
+			for (const std::string& library : chunk.mMaterialLibraries) {
+				parseMaterialLibrary(path.parent_path() / library, diffuseTextures);
+			}
+		}
+
+		const size_t triangleCount = cornerCount / 3;
+		std::vector<std::string> materialNames;
+		std::unordered_map<std::string, uint32_t> materialSlots;
+		std::vector<uint32_t> triangleMaterial(triangleCount);
+		std::string currentMaterial;	// Triangles before the first usemtl use a default material without texture.
+		size_t nextTriangle = 0;
+		const auto assignMaterial = [&](size_t endTriangle) {
+			if (endTriangle <= nextTriangle) {
+				return;
+			}
+			const auto [slot, bInserted] = materialSlots.try_emplace(currentMaterial, static_cast<uint32_t>(materialNames.size()));
+			if (bInserted) {
+				materialNames.push_back(currentMaterial);
+			}
+			std::fill(triangleMaterial.begin() + nextTriangle, triangleMaterial.begin() + endTriangle, slot->second);
+			nextTriangle = endTriangle;
+		};
+		for (size_t i = 0; i < chunks.size(); ++i) {
+			for (const MaterialRun& run : chunks[i].mMaterialRuns) {
+				assignMaterial(bases[i].mCorner / 3 + run.mFirstTriangle);
+				currentMaterial = run.mName;
+			}
+		}
+		assignMaterial(triangleCount);
+
+		// One primitive per material: a counting sort groups their indices, keeping the file order within each.
+		std::vector<size_t> materialFirstTriangle(materialNames.size() + 1, 0);
+		for (const uint32_t slot : triangleMaterial) {
+			++materialFirstTriangle[slot + 1];
+		}
+		std::partial_sum(materialFirstTriangle.begin(), materialFirstTriangle.end(), materialFirstTriangle.begin());
+
+		if (materialNames.size() <= 1) {
+			mesh.mIndices = std::move(cornerVertex);
+		}
+		else {
+			mesh.mIndices.resize(cornerCount);
+			std::vector<size_t> cursor(materialFirstTriangle.begin(), materialFirstTriangle.end() - 1);
+			for (size_t t = 0; t < triangleCount; ++t) {
+				memcpy(&mesh.mIndices[cursor[triangleMaterial[t]]++ * 3], &cornerVertex[t * 3], 3 * sizeof(uint32_t));
+			}
+		}
+
+		for (uint32_t slot = 0; slot < materialNames.size(); ++slot) {
+			const size_t first = materialFirstTriangle[slot];
+			const size_t count = materialFirstTriangle[slot + 1] - first;
+			const auto texture = diffuseTextures.find(materialNames[slot]);
+			mesh.mPrimitives.push_back({
+				.indexCount = static_cast<uint32_t>(count * 3),
+				.firstIndex = static_cast<uint32_t>(first * 3),
+				.textureID = static_cast<uint32_t>(scene.mTexturePaths.size()),
+				.alphaCutoff = 0.f,
+				.doubleSided = 1 });	// OBJ materials cannot say whether their back faces are visible.
+			scene.mTexturePaths.push_back(texture != diffuseTextures.end() ? texture->second : std::filesystem::path());
+		}
+
+		mesh.mMeshes.push_back({ .firstPrimitive = 0, .primitiveCount = static_cast<uint32_t>(mesh.mPrimitives.size()) });
+		mesh.mInstances.push_back({ .worldMatrix = glm::mat4(1.f), .meshIndex = 0 });
+
+		scene.mWeldMs = weldTimer.total<std::milli>();
+		return true;
+	}
+}
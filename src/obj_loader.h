@@ -0,0 +1,26 @@
+#pragma once
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace scvk
+{
+	// The geometry of a Wavefront OBJ file and the diffuse texture of each material it uses.
+	struct ObjScene
+	{
+		LoadedMesh							mMesh;			// Primitive::textureID indexes mTexturePaths.
+		std::vector<std::filesystem::path>	mTexturePaths;	// Empty for materials without a (readable) diffuse texture.
+
+		size_t	mFileBytes{ 0 };
+		float	mParseMs{ 0.f };
+		float	mWeldMs{ 0.f };
+	};
+
+	// Loads an OBJ file, and the materials of the MTL libraries it references, into the same layout the glTF path produces:
+	// one primitive per material, a single mesh drawn by a single identity instance, and indexed vertices.
+	// The file is memory mapped and split at line boundaries into chunks that are parsed on the pool's workers.
+	// Corners with the same position/texcoord/normal indices are then merged into one vertex through hash maps
+	// that each own a shard of the key space, so welding runs in parallel as well. Vertices keep the order in which
+	// faces first reference them. Returns false, after printing why, if the file cannot be read or is malformed.
+	bool loadObj(const std::filesystem::path& path, ThreadPool& pool, ObjScene& scene);
+}
@@ -0,0 +1,69 @@
+#include "sampler_cache.h"
+
+#include <cassert>
+#include <cstring>
+
+#include <hash.h>
+
+namespace scvk
+{
+	// Every member is 4 bytes wide, so keys have no padding and can be hashed and compared as raw memory.
+	static_assert(sizeof(VkSamplerCreateFlags) == 4 && sizeof(VkFilter) == 4 && sizeof(VkBorderColor) == 4);
+
+	bool SamplerCache::SamplerKey::operator==(const SamplerKey& other) const
+	{
+		return memcmp(this, &other, sizeof(SamplerKey)) == 0;
+	}
+
+	size_t SamplerCache::SamplerKeyHash::operator()(const SamplerKey& key) const
+	{
+		return static_cast<size_t>(hashBytes(&key, sizeof(key)));
+	}
+
+	void SamplerCache::init(VkDevice device)
+	{
+		mDevice = device;
+	}
+
+	void SamplerCache::destroy()
+	{
+		for (const auto& [key, sampler] : mSamplers) {
+			vkDestroySampler(mDevice, sampler, nullptr);
+		}
+		mSamplers.clear();
+	}
+
+	VkSampler SamplerCache::getSampler(const VkSamplerCreateInfo& info)
+	{
+		assert(info.pNext == nullptr);
+		++mRequestCount;
+
+		const SamplerKey key = {
+			.mFlags						= info.flags,
+			.mMagFilter					= info.magFilter,
+			.mMinFilter					= info.minFilter,
+			.mMipmapMode				= info.mipmapMode,
+			.mAddressModeU				= info.addressModeU,
+			.mAddressModeV				= info.addressModeV,
+			.mAddressModeW				= info.addressModeW,
+			.mMipLodBias				= info.mipLodBias,
+			.mAnisotropyEnable			= info.anisotropyEnable,
+			.mMaxAnisotropy				= info.maxAnisotropy,
+			.mCompareEnable				= info.compareEnable,
+			.mCompareOp					= info.compareOp,
+			.mMinLod					= info.minLod,
+			.mMaxLod					= info.maxLod,
+			.mBorderColor				= info.borderColor,
+			.mUnnormalizedCoordinates	= info.unnormalizedCoordinates
+		};
+
+		if (auto it = mSamplers.find(key); it != mSamplers.end()) {
+			return it->second;
+		}
+
+		VkSampler sampler;
+		VK_CHECK(vkCreateSampler(mDevice, &info, nullptr, &sampler));
+		mSamplers.emplace(key, sampler);
+		return sampler;
+	}
+}
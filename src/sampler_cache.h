@@ -0,0 +1,57 @@
+#pragma once
+
+#include <unordered_map>
+
+#include <vk_types.h>
+
+namespace scvk
+{
+	// Hands out one VkSampler per distinct sampler state, so textures sampled the same way share a sampler.
+	class SamplerCache
+	{
+	public:
+
+		void init(VkDevice device);
+		void destroy();
+
+		// Returns the sampler matching info, creating it on first use. info must not have a pNext chain.
+		VkSampler getSampler(const VkSamplerCreateInfo& info);
+
+		size_t size() const { return mSamplers.size(); }
+		uint32_t requestCount() const { return mRequestCount; }
+
+	private:
+
+		// The state of a VkSamplerCreateInfo, without sType/pNext so it can be hashed and compared bytewise.
+		struct SamplerKey
+		{
+			VkSamplerCreateFlags	mFlags;
+			VkFilter				mMagFilter;
+			VkFilter				mMinFilter;
+			VkSamplerMipmapMode		mMipmapMode;
+			VkSamplerAddressMode	mAddressModeU;
+			VkSamplerAddressMode	mAddressModeV;
+			VkSamplerAddressMode	mAddressModeW;
+			float					mMipLodBias;
+			VkBool32				mAnisotropyEnable;
+			float					mMaxAnisotropy;
+			VkBool32				mCompareEnable;
+			VkCompareOp				mCompareOp;
+			float					mMinLod;
+			float					mMaxLod;
+			VkBorderColor			mBorderColor;
+			VkBool32				mUnnormalizedCoordinates;
+
+			bool operator==(const SamplerKey& other) const;
+		};
+
+		struct SamplerKeyHash
+		{
+			size_t operator()(const SamplerKey& key) const;
+		};
+
+		VkDevice mDevice{ VK_NULL_HANDLE };
+		std::unordered_map<SamplerKey, VkSampler, SamplerKeyHash> mSamplers;
+		uint32_t mRequestCount{ 0 };
+	};
+}
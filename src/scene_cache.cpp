@@ -0,0 +1,191 @@
+#include "scene_cache.h"
+
+#include <cstring>
+
+#include "mapped_file.h"
+
+namespace scvk
+{
+	namespace
+	{
+		constexpr uint32_t SCENE_CACHE_MAGIC = 0x43534353; // "SCSC"
+
+		// Sections are aligned so the mapped arrays can be used in place.
+		constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+		enum class SectionType : uint32_t
+		{
+			Primitives,
+			Vertices,
+			Indices,
+			Meshes,
+			Instances,
+			PrimitiveLods,
+			Lods,
+		};
+
+		struct SceneCacheHeader
+		{
+			uint32_t mMagic;
+			uint32_t mVersion;
+			uint64_t mSourceHash;
+			// Sizes of the cached records. They catch layout changes between builds that forgot to bump SCENE_CACHE_VERSION.
+			uint32_t mVertexSize;
+			uint32_t mPrimitiveSize;
+			uint32_t mMeshRangeSize;
+			uint32_t mInstanceSize;
+			uint32_t mPrimitiveLodsSize;
+			uint32_t mLodSize;
+			uint32_t mSectionCount;
+			uint32_t mPadding;
+		};
+
+		struct SceneCacheSection
+		{
+			SectionType	mType;
+			uint32_t	mPadding;
+			uint64_t	mOffset;	// From the start of the file.
+			uint64_t	mSize;
+		};
+
+		uint64_t alignUp(uint64_t value, uint64_t alignment)
+		{
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+
+		template<typename T>
+		std::span<const T> sectionArray(std::span<const std::byte> file, const SceneCacheSection& section)
+		{
+			return { reinterpret_cast<const T*>(file.data() + section.mOffset), static_cast<size_t>(section.mSize / sizeof(T)) };
+		}
+	}
+
+	std::filesystem::path sceneCachePath(const std::filesystem::path& path)
+	{
+		return path.parent_path() / ".scene_cache" / std::filesystem::path(path.filename()).concat(".scene");
+	}
+
+	bool readSceneCache(const std::filesystem::path& path, uint64_t sourceHash, LoadedMesh& mesh)
+	{
+		auto file = MappedFile::open(path);
+		if (!file) {
+			return false;
+		}
+		const std::span<const std::byte> bytes = file->bytes();
+
+		SceneCacheHeader header;
+		if (bytes.size() < sizeof(header)) {
+			return false;
+		}
+		memcpy(&header, bytes.data(), sizeof(header));
+		if (header.mMagic != SCENE_CACHE_MAGIC || header.mVersion != SCENE_CACHE_VERSION || header.mSourceHash != sourceHash
+			|| header.mVertexSize != sizeof(Vertex) || header.mPrimitiveSize != sizeof(Primitive) || header.mMeshRangeSize != sizeof(MeshRange)
+			|| header.mInstanceSize != sizeof(MeshInstance) || header.mPrimitiveLodsSize != sizeof(PrimitiveLods) || header.mLodSize != sizeof(PrimitiveLod)) {
+			return false;
+		}
+
+		std::vector<SceneCacheSection> sections(header.mSectionCount);
+		if (bytes.size() < sizeof(header) + sections.size() * sizeof(SceneCacheSection)) {
+			return false;
+		}
+		memcpy(sections.data(), bytes.data() + sizeof(header), sections.size() * sizeof(SceneCacheSection));
+
+		std::optional<SceneCacheSection> primitives, vertices, indices, meshes, instances, primitiveLods, lods;
+		for (const auto& section : sections) {
+			if (section.mOffset % SECTION_ALIGNMENT != 0 || section.mOffset > bytes.size() || section.mSize > bytes.size() - section.mOffset) {
+				return false;
+			}
+			switch (section.mType) {
+			case SectionType::Primitives:	primitives = section; break;
+			case SectionType::Vertices:		vertices = section; break;
+			case SectionType::Indices:		indices = section; break;
+			case SectionType::Meshes:		meshes = section; break;
+			case SectionType::Instances:	instances = section; break;
+			case SectionType::PrimitiveLods:	primitiveLods = section; break;
+			case SectionType::Lods:			lods = section; break;
+			}
+		}
+		if (!primitives || !vertices || !indices || !meshes || !instances || !primitiveLods || !lods) {
+			return false;
+		}
+
+		const auto cachedPrimitives = sectionArray<Primitive>(bytes, *primitives);
+		mesh.mPrimitives.assign(cachedPrimitives.begin(), cachedPrimitives.end());
+		const auto cachedMeshes = sectionArray<MeshRange>(bytes, *meshes);
+		mesh.mMeshes.assign(cachedMeshes.begin(), cachedMeshes.end());
+		const auto cachedInstances = sectionArray<MeshInstance>(bytes, *instances);
+		mesh.mInstances.assign(cachedInstances.begin(), cachedInstances.end());
+		const auto cachedPrimitiveLods = sectionArray<PrimitiveLods>(bytes, *primitiveLods);
+		mesh.mPrimitiveLods.assign(cachedPrimitiveLods.begin(), cachedPrimitiveLods.end());
+		const auto cachedLods = sectionArray<PrimitiveLod>(bytes, *lods);
+		mesh.mLods.assign(cachedLods.begin(), cachedLods.end());
+		mesh.mVertices.clear();
+		mesh.mIndices.clear();
+		mesh.mMappedVertices = sectionArray<Vertex>(bytes, *vertices);
+		mesh.mMappedIndices = sectionArray<uint32_t>(bytes, *indices);
+		mesh.mMappedGeometry = std::move(file);
+		return true;
+	}
+
+	void writeSceneCache(const std::filesystem::path& path, uint64_t sourceHash, const LoadedMesh& mesh)
+	{
+		const std::span<const std::byte> payloads[] = {
+			std::as_bytes(std::span(mesh.mPrimitives)),
+			std::as_bytes(mesh.vertexData()),
+			std::as_bytes(mesh.indexData()),
+			std::as_bytes(std::span(mesh.mMeshes)),
+			std::as_bytes(std::span(mesh.mInstances)),
+			std::as_bytes(std::span(mesh.mPrimitiveLods)),
+			std::as_bytes(std::span(mesh.mLods)),
+		};
+		const SectionType types[] = { SectionType::Primitives, SectionType::Vertices, SectionType::Indices, SectionType::Meshes, SectionType::Instances,
+			SectionType::PrimitiveLods, SectionType::Lods };
+
+		const SceneCacheHeader header = {
+			.mMagic			= SCENE_CACHE_MAGIC,
+			.mVersion		= SCENE_CACHE_VERSION,
+			.mSourceHash	= sourceHash,
+			.mVertexSize	= sizeof(Vertex),
+			.mPrimitiveSize	= sizeof(Primitive),
+			.mMeshRangeSize	= sizeof(MeshRange),
+			.mInstanceSize	= sizeof(MeshInstance),
+			.mPrimitiveLodsSize	= sizeof(PrimitiveLods),
+			.mLodSize		= sizeof(PrimitiveLod),
+			.mSectionCount	= static_cast<uint32_t>(std::size(payloads)),
+			.mPadding		= 0
+		};
+
+		std::vector<SceneCacheSection> sections;
+		uint64_t offset = sizeof(header) + std::size(payloads) * sizeof(SceneCacheSection);
+		for (size_t i = 0; i < std::size(payloads); ++i) {
+			offset = alignUp(offset, SECTION_ALIGNMENT);
+			sections.push_back({ .mType = types[i], .mPadding = 0, .mOffset = offset, .mSize = payloads[i].size() });
+			offset += payloads[i].size();
+		}
+
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+
+		// Written to a temporary file first and renamed, so a crash never leaves a truncated cache behind.
+		const auto tempPath = std::filesystem::path(path).concat(".tmp");
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open()) {
+				fmt::println("Could not write scene cache '{}'", path.string());
+				return;
+			}
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(sections.data()), sections.size() * sizeof(SceneCacheSection));
+			for (size_t i = 0; i < sections.size(); ++i) {
+				const std::vector<char> padding(sections[i].mOffset - static_cast<uint64_t>(file.tellp()), 0);
+				file.write(padding.data(), padding.size());
+				file.write(reinterpret_cast<const char*>(payloads[i].data()), payloads[i].size());
+			}
+		}
+		std::filesystem::rename(tempPath, path, error);
+		if (error) {
+			std::filesystem::remove(tempPath, error);
+			fmt::println("Could not write scene cache '{}': {}", path.string(), error.message());
+		}
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "mesh.h"
+
+// Binary cache of processed glTF geometry. Everything is stored in the layout it is uploaded in,
+// so a warm start maps the file and copies the vertex and index data straight into staging memory.
+namespace scvk
+{
+	// Where the cache of the glTF file at path lives.
+	std::filesystem::path sceneCachePath(const std::filesystem::path& path);
+
+	// Loads the primitives, meshes, instances and levels of detail and maps the vertices and indices of mesh from the cache at path.
+	// Returns false, leaving mesh untouched, if the cache is missing, from an older format, or was built from a different source.
+	bool readSceneCache(const std::filesystem::path& path, uint64_t sourceHash, LoadedMesh& mesh);
+
+	// Stores the geometry of mesh in the cache at path. Failing to write the cache is not an error.
+	void writeSceneCache(const std::filesystem::path& path, uint64_t sourceHash, const LoadedMesh& mesh);
+
+	// Bumped whenever the file layout or the processing producing the cached data changes.
+	constexpr uint32_t SCENE_CACHE_VERSION = 6;
+}
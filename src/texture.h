@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vk_types.h>
+#include <hash.h>
 #include "image.h"
 #include "image.h"
 
@@ -15,4 +16,42 @@ namespace scvk
 
 	void destroyTexture(VkDevice device, VmaAllocator allocator, const Texture& texture);
 
-}
\ No newline at end of file
+	// What a texture is sampled as. Decides its format and how its mip levels are filtered.
+	enum class TextureRole : uint8_t
+	{
+		BaseColor,	// sRGB color with alpha.
+		Normal,		// Tangent space normal, of which only xy are kept when compressed.
+		Data,		// Any other linear data, e.g. metallic/roughness or occlusion.
+	};
+
+	// One mip level inside TextureData::mBytes.
+	struct TextureLevel
+	{
+		uint32_t	mWidth;
+		uint32_t	mHeight;
+		size_t		mOffset;
+		size_t		mSize;
+	};
+
+	// CPU-side texels of a texture, ready to be copied into an image of mFormat.
+	// A single uncompressed level may still get a mip chain generated on the GPU at upload.
+	struct TextureData
+	{
+		VkFormat					mFormat{ VK_FORMAT_UNDEFINED };
+		uint32_t					mWidth{ 0 };
+		uint32_t					mHeight{ 0 };
+		std::vector<TextureLevel>	mLevels;
+
+		std::span<const uint8_t>	mBytes;
+		std::shared_ptr<const void>	mOwner;		// Keeps the memory behind mBytes alive, if owned.
+
+		Hash128						mContentHash;	// Hash of the texels and their layout, zero if not computed yet.
+	};
+
+	// Returns true for the block-compressed formats produced by the BC encoder.
+	inline bool isBlockCompressed(VkFormat format)
+	{
+		return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+	}
+
+}
@@ -0,0 +1,223 @@
+#include "texture_loader.h"
+
+#include <cstring>
+#include <thread>
+
+#include <hash.h>
+#include <stb_image.h>
+
+#include "bc_encoder.h"
+#include "ktx2.h"
+#include "mapped_file.h"
+
+namespace scvk
+{
+	namespace
+	{
+		constexpr uint32_t TEXTURE_CACHE_MAGIC = 0x43545343; // "SCTC"
+		constexpr uint32_t TEXTURE_CACHE_VERSION = 1;
+
+		struct TextureCacheHeader
+		{
+			uint32_t mMagic;
+			uint32_t mVersion;
+			uint32_t mFormat;
+			uint32_t mWidth;
+			uint32_t mHeight;
+			uint32_t mLevelCount;
+		};
+
+		struct TextureCacheLevel
+		{
+			uint32_t mWidth;
+			uint32_t mHeight;
+			uint64_t mOffset;	// Relative to the end of the level table.
+			uint64_t mSize;
+		};
+
+		std::shared_ptr<const MappedFile> mapFile(const std::filesystem::path& path)
+		{
+			auto file = MappedFile::open(path);
+			if (!file) {
+				throw std::runtime_error(fmt::format("Failed to open '{}'", path.string()));
+			}
+			return file;
+		}
+
+		// Returns the cached texture at path, or nothing if it is missing, from an older encoder, or truncated.
+		// The texels are mapped rather than read, so they are paged in straight from the file system cache when uploaded.
+		std::optional<TextureData> readTextureCache(const std::filesystem::path& path)
+		{
+			auto file = MappedFile::open(path);
+			if (!file) {
+				return std::nullopt;
+			}
+			const std::span<const std::byte> bytes = file->bytes();
+
+			TextureCacheHeader header;
+			if (bytes.size() < sizeof(header)) {
+				return std::nullopt;
+			}
+			memcpy(&header, bytes.data(), sizeof(header));
+			if (header.mMagic != TEXTURE_CACHE_MAGIC || header.mVersion != (TEXTURE_CACHE_VERSION << 16 | bc::ENCODER_VERSION) || header.mLevelCount == 0) {
+				return std::nullopt;
+			}
+
+			std::vector<TextureCacheLevel> levels(header.mLevelCount);
+			const size_t dataStart = sizeof(header) + levels.size() * sizeof(TextureCacheLevel);
+			if (bytes.size() < dataStart) {
+				return std::nullopt;
+			}
+			memcpy(levels.data(), bytes.data() + sizeof(header), levels.size() * sizeof(TextureCacheLevel));
+
+			TextureData data;
+			data.mFormat = static_cast<VkFormat>(header.mFormat);
+			data.mWidth = header.mWidth;
+			data.mHeight = header.mHeight;
+			for (const auto& level : levels) {
+				if (level.mOffset + level.mSize > bytes.size() - dataStart) {
+					return std::nullopt;
+				}
+				data.mLevels.push_back({ .mWidth = level.mWidth, .mHeight = level.mHeight, .mOffset = level.mOffset, .mSize = level.mSize });
+			}
+
+			data.mBytes = std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(bytes.data()) + dataStart, bytes.size() - dataStart);
+			data.mOwner = std::move(file);
+			return data;
+		}
+
+		// Writes the texture to a temporary file first and renames it, so readers never observe a partial entry.
+		void writeTextureCache(const std::filesystem::path& path, const TextureData& data)
+		{
+			std::error_code error;
+			std::filesystem::create_directories(path.parent_path(), error);
+
+			const auto tempPath = std::filesystem::path(path).concat(fmt::format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id())));
+			{
+				std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+				if (!file.is_open()) {
+					fmt::println("Could not write texture cache entry '{}'", path.string());
+					return;
+				}
+
+				const TextureCacheHeader header = {
+					.mMagic			= TEXTURE_CACHE_MAGIC,
+					.mVersion		= TEXTURE_CACHE_VERSION << 16 | bc::ENCODER_VERSION,
+					.mFormat		= static_cast<uint32_t>(data.mFormat),
+					.mWidth			= data.mWidth,
+					.mHeight		= data.mHeight,
+					.mLevelCount	= static_cast<uint32_t>(data.mLevels.size())
+				};
+				file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				for (const auto& level : data.mLevels) {
+					const TextureCacheLevel entry = { .mWidth = level.mWidth, .mHeight = level.mHeight, .mOffset = level.mOffset, .mSize = level.mSize };
+					file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+				}
+				file.write(reinterpret_cast<const char*>(data.mBytes.data()), data.mBytes.size());
+			}
+			std::filesystem::rename(tempPath, path, error);
+			if (error) {
+				std::filesystem::remove(tempPath, error);
+			}
+		}
+
+		// Produces the texels of a source: in place for KTX2, otherwise from the BC cache or by decoding (and compressing) it.
+		TextureData loadTextureTexels(const TextureSource& source, TextureRole role, const TextureLoadOptions& options)
+		{
+			std::shared_ptr<const MappedFile> file;
+			std::span<const std::byte> encoded = source.mBytes;
+			if (!source.mPath.empty()) {
+				file = mapFile(source.mPath);
+				encoded = file->bytes();
+			}
+
+			// KTX2 files already hold the final format and mips, so their levels are used in place.
+			if (ktx2::isKtx2(encoded)) {
+				TextureData data = ktx2::load(encoded, std::move(file), source.mName);
+				if (isBlockCompressed(data.mFormat) && !options.bBlockCompressedFormats) {
+					throw std::runtime_error(fmt::format("KTX2 file '{}' is BC compressed, which the device does not support", source.mName));
+				}
+				return data;
+			}
+
+			// Compressed results are keyed by the encoded source bytes, so edited images are re-encoded automatically.
+			std::filesystem::path cachePath;
+			if (options.bCompress) {
+				uint64_t key = hashBytes(encoded.data(), encoded.size());
+				key = hashCombine(key, static_cast<uint64_t>(role));
+				key = hashCombine(key, bc::ENCODER_VERSION);
+				cachePath = options.mCacheDirectory / fmt::format("{:016x}.sctex", key);
+
+				if (auto cached = readTextureCache(cachePath)) {
+					return std::move(*cached);
+				}
+			}
+
+			int width, height;
+			stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(encoded.data()), static_cast<int>(encoded.size()), &width, &height, nullptr, 4);
+			if (!pixels) {
+				throw std::runtime_error(fmt::format("Failed to decode image '{}': {}", source.mName, stbi_failure_reason()));
+			}
+			std::shared_ptr<const void> owner(pixels, stbi_image_free);
+
+			if (options.bCompress) {
+				TextureData compressed = bc::compressTexture(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), role);
+				writeTextureCache(cachePath, compressed);
+				return compressed;
+			}
+
+			TextureData data;
+			data.mFormat = uncompressedFormat(role);
+			data.mWidth = static_cast<uint32_t>(width);
+			data.mHeight = static_cast<uint32_t>(height);
+			data.mLevels.push_back({ .mWidth = data.mWidth, .mHeight = data.mHeight, .mOffset = 0, .mSize = size_t(width) * height * 4 });
+			data.mBytes = std::span<const uint8_t>(pixels, data.mLevels[0].mSize);
+			data.mOwner = std::move(owner);
+			return data;
+		}
+	}
+
+	Hash128 hashTextureData(const TextureData& data)
+	{
+		Hash128 hash = hashBytes128(data.mBytes.data(), data.mBytes.size());
+		hash = hashCombine(hash, static_cast<uint64_t>(data.mFormat));
+		for (const auto& level : data.mLevels) {
+			hash = hashCombine(hash, uint64_t(level.mWidth) << 32 | level.mHeight);
+			hash = hashCombine(hash, level.mOffset);
+		}
+		// Zero means "not computed".
+		if (hash == Hash128{}) {
+			hash.mLow = 1;
+		}
+		return hash;
+	}
+
+	VkFormat uncompressedFormat(TextureRole role)
+	{
+		return role == TextureRole::BaseColor ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+	}
+
+	TextureData placeholderTextureData(TextureRole role)
+	{
+		static constexpr uint8_t BASE_COLOR[4] = { 128, 128, 128, 255 };
+		static constexpr uint8_t NORMAL[4] = { 128, 128, 255, 255 };
+		static constexpr uint8_t DATA[4] = { 255, 255, 255, 255 };
+
+		TextureData data;
+		data.mFormat = uncompressedFormat(role);
+		data.mWidth = 1;
+		data.mHeight = 1;
+		data.mLevels.push_back({ .mWidth = 1, .mHeight = 1, .mOffset = 0, .mSize = 4 });
+		data.mBytes = role == TextureRole::BaseColor ? BASE_COLOR : role == TextureRole::Normal ? NORMAL : DATA;
+		data.mContentHash = hashTextureData(data);
+		return data;
+	}
+
+	TextureData loadTextureData(const TextureSource& source, TextureRole role, const TextureLoadOptions& options)
+	{
+		// Hashed here, on the loading thread, so uploads can be deduplicated without touching the texels again.
+		TextureData data = loadTextureTexels(source, role, options);
+		data.mContentHash = hashTextureData(data);
+		return data;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "texture.h"
+
+namespace scvk
+{
+	// Where the encoded bytes (JPG, PNG, KTX2, ...) of an image come from: a file on disk, or memory owned by the caller.
+	struct TextureSource
+	{
+		std::filesystem::path		mPath;		// Read when not empty.
+		std::span<const std::byte>	mBytes;		// Used when mPath is empty.
+		std::string					mName;		// Only used for error messages.
+	};
+
+	struct TextureLoadOptions
+	{
+		bool					bCompress{ false };		// Compress to a BC format, reusing earlier results from mCacheDirectory.
+		bool					bBlockCompressedFormats{ true };	// Whether BC formats can be sampled. KTX2 files in one are rejected otherwise.
+		std::filesystem::path	mCacheDirectory;
+	};
+
+	// Hashes the texels of data together with its format and level layout. 128 bits, so that textures can be
+	// deduplicated on equal hashes without keeping their texels around to compare. Never zero.
+	Hash128 hashTextureData(const TextureData& data);
+
+	// The format of an uncompressed texture of the given role.
+	VkFormat uncompressedFormat(TextureRole role);
+
+	// A 1x1 texture that renders sensibly until the real texture of the given role is available:
+	// mid grey for base color, a flat normal, and white (no occlusion, full roughness and metalness) for data.
+	TextureData placeholderTextureData(TextureRole role);
+
+	// Produces the texels of a texture. KTX2 sources are used in place, in their own format and ignoring role and options.
+	// Other images come from the on-disk cache when possible, otherwise they are decoded and, if requested, compressed
+	// and stored in the cache. Files are memory mapped rather than read. The result's mContentHash is filled in.
+	// Safe to call from worker threads.
+	TextureData loadTextureData(const TextureSource& source, TextureRole role, const TextureLoadOptions& options);
+}
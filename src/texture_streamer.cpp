@@ -0,0 +1,74 @@
+#include "texture_streamer.h"
+
+#include "app.h"
+
+void TextureStreamer::request(uint32_t textureIndex, std::string name, std::future<scvk::TextureData>&& data, const VkSamplerCreateInfo& samplerInfo)
+{
+	if (!isStreaming()) {
+		mTimer.start();
+		mStreamedCount = 0;
+		mStreamedBytes = 0;
+	}
+	mLoading.push_back({ .mTextureIndex = textureIndex, .mName = std::move(name), .mData = std::move(data), .mSamplerInfo = samplerInfo });
+}
+
+std::vector<uint32_t> TextureStreamer::update(VulkanApp* app, std::vector<scvk::Texture>& textures, VkDeviceSize budgetBytes)
+{
+	std::vector<uint32_t> resident;
+	if (!isStreaming()) {
+		return resident;
+	}
+
+	// Collect every load that has finished, in whatever order the workers completed them. A failed load, e.g. a missing
+	// or corrupt image, is dropped and its texture keeps the placeholder.
+	for (auto it = mLoading.begin(); it != mLoading.end();) {
+		if (it->mData.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			try {
+				scvk::TextureData data = it->mData.get();
+				mLoaded.push_back({ .mTextureIndex = it->mTextureIndex, .mName = std::move(it->mName), .mData = std::move(data), .mSamplerInfo = it->mSamplerInfo });
+			}
+			catch (const std::exception& e) {
+				fmt::println("Failed to load texture '{}', keeping its placeholder: {}", it->mName, e.what());
+			}
+			it = mLoading.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	// Record uploads within the budget and submit them as one batch.
+	VkDeviceSize recordedBytes = 0;
+	std::vector<std::pair<uint32_t, scvk::Texture>> recorded;
+	while (!mLoaded.empty() && (recorded.empty() || (recordedBytes < budgetBytes && mLoaded.front().mData.mBytes.size() <= budgetBytes - recordedBytes))) {
+		LoadedTexture& loaded = mLoaded.front();
+		try {
+			recorded.emplace_back(loaded.mTextureIndex, app->createTexture(loaded.mData, loaded.mSamplerInfo));
+			recordedBytes += loaded.mData.mBytes.size();
+		}
+		catch (const std::exception& e) {
+			fmt::println("Failed to create texture '{}', keeping its placeholder: {}", loaded.mName, e.what());
+		}
+		mLoaded.pop_front();
+	}
+	if (!recorded.empty()) {
+		const scvk::UploadToken token = app->mUploader.submit();
+		for (auto& [textureIndex, texture] : recorded) {
+			mUploading.push_back({ .mTextureIndex = textureIndex, .mTexture = texture, .mToken = token });
+		}
+		mStreamedBytes += recordedBytes;
+	}
+
+	// Batches complete in submission order, so the finished uploads are at the front.
+	while (!mUploading.empty() && app->mUploader.isComplete(mUploading.front().mToken)) {
+		textures[mUploading.front().mTextureIndex] = mUploading.front().mTexture;
+		resident.push_back(mUploading.front().mTextureIndex);
+		mUploading.pop_front();
+		++mStreamedCount;
+	}
+
+	if (!isStreaming()) {
+		fmt::println("Streamed {} textures ({:.2f} MB) in {:.2f} ms", mStreamedCount, mStreamedBytes / (1024.0 * 1024.0), mTimer.total<std::milli>());
+	}
+	return resident;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <future>
+
+#include "texture.h"
+#include "timer.h"
+#include "upload.h"
+
+class VulkanApp;
+
+// Replaces placeholder textures with their real data once it has been loaded on worker threads.
+// Uploads are limited to a byte budget per update(), so streaming never stalls a frame for long.
+class TextureStreamer
+{
+public:
+
+	// Queues a texture whose data is being loaded. Once uploaded, it replaces textures[textureIndex] in update().
+	// If loading fails, the error is logged with name and the texture keeps its placeholder.
+	void request(uint32_t textureIndex, std::string name, std::future<scvk::TextureData>&& data, const VkSamplerCreateInfo& samplerInfo);
+
+	// Records the uploads of loaded textures until budgetBytes of texel data have been staged and submits them.
+	// At least one upload is recorded per call, so textures larger than the budget still make progress.
+	// Then writes every texture whose upload has completed into textures and returns their indices.
+	std::vector<uint32_t> update(VulkanApp* app, std::vector<scvk::Texture>& textures, VkDeviceSize budgetBytes);
+
+	bool isStreaming() const { return !mLoading.empty() || !mLoaded.empty() || !mUploading.empty(); }
+
+private:
+
+	struct Request
+	{
+		uint32_t							mTextureIndex;
+		std::string							mName;
+		std::future<scvk::TextureData>		mData;
+		VkSamplerCreateInfo					mSamplerInfo;
+	};
+
+	struct LoadedTexture
+	{
+		uint32_t				mTextureIndex;
+		std::string				mName;
+		scvk::TextureData		mData;
+		VkSamplerCreateInfo		mSamplerInfo;
+	};
+
+	struct PendingUpload
+	{
+		uint32_t				mTextureIndex;
+		scvk::Texture			mTexture;
+		scvk::UploadToken		mToken;
+	};
+
+	std::vector<Request>		mLoading;		// Still being loaded by the thread pool.
+	std::deque<LoadedTexture>	mLoaded;		// Loaded, waiting for upload budget.
+	std::deque<PendingUpload>	mUploading;		// Recorded and submitted, waiting for the GPU.
+
+	scvk::Timer		mTimer;
+	uint32_t		mStreamedCount{ 0 };
+	VkDeviceSize	mStreamedBytes{ 0 };
+};
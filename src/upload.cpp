@@ -0,0 +1,503 @@
+#include "upload.h"
+
+#include <cstring>
+
+#include <vk_initializers.h>
+
+namespace scvk
+{
+	void UploadContext::init(VkDevice device, VmaAllocator allocator, VkQueue transferQueue, uint32_t transferQueueFamily, VkQueue graphicsQueue, uint32_t graphicsQueueFamily)
+	{
+		mDevice					= device;
+		mAllocator				= allocator;
+		mTransferQueue			= transferQueue;
+		mTransferQueueFamily	= transferQueueFamily;
+		mGraphicsQueue			= graphicsQueue;
+		mGraphicsQueueFamily	= graphicsQueueFamily;
+	}
+
+	void UploadContext::destroy()
+	{
+		wait(submit());
+
+		for (auto& batch : mFreeBatches) {
+			for (auto& chunk : batch.mStaging) {
+				vmaDestroyBuffer(mAllocator, chunk.mBuffer.mBuffer, chunk.mBuffer.mAllocation);
+			}
+			vkDestroyFence(mDevice, batch.mFence, nullptr);
+			vkDestroyCommandPool(mDevice, batch.mCommandPool, nullptr);
+			if (hasOwnershipTransfer()) {
+				vkDestroySemaphore(mDevice, batch.mTransferDone, nullptr);
+				vkDestroyCommandPool(mDevice, batch.mGraphicsCommandPool, nullptr);
+			}
+		}
+		mFreeBatches.clear();
+	}
+
+	void UploadContext::uploadBuffer(const Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize dstOffset)
+	{
+		const StagingAllocation staging = allocateStaging(size);
+		memcpy(staging.mMapped, data, size);
+
+		const VkBufferCopy copy = {
+			.srcOffset	= staging.mOffset,
+			.dstOffset	= dstOffset,
+			.size		= size
+		};
+		Batch& batch = recordingBatch();
+		vkCmdCopyBuffer(batch.mCommandBuffer, staging.mBuffer, dst.mBuffer, 1, &copy);
+
+		if (hasOwnershipTransfer()) {
+			VkBufferMemoryBarrier2 handOver = { .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 };
+			handOver.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+			handOver.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+			handOver.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			handOver.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+			handOver.buffer = dst.mBuffer;
+			handOver.offset = dstOffset;
+			handOver.size = size;
+			transferToGraphics(batch, handOver);
+		}
+	}
+
+	void UploadContext::uploadImage(const Image& dst, const void* data, VkDeviceSize size, uint32_t mipLevels)
+	{
+		const StagingAllocation staging = allocateStaging(size);
+		memcpy(staging.mMapped, data, size);
+
+		// The copy runs on the transfer queue, but blits need a graphics queue, so the mip chain is built by the graphics commands.
+		Batch& batch = recordingBatch();
+		VkCommandBuffer cmd = batch.mCommandBuffer;
+		VkCommandBuffer mipCmd = graphicsCommandBuffer(batch);
+
+		// Move every level into TRANSFER_DST, since levels past the first are written by the blits below.
+		VkImageMemoryBarrier2 preCopyMemoryBarrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+		preCopyMemoryBarrier.image = dst.mImage;
+		preCopyMemoryBarrier.srcAccessMask = 0;
+		preCopyMemoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
+		preCopyMemoryBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
+		preCopyMemoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+		preCopyMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		preCopyMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		preCopyMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+
+		VkDependencyInfo dep = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		dep.imageMemoryBarrierCount = 1;
+		dep.pImageMemoryBarriers = &preCopyMemoryBarrier;
+		vkCmdPipelineBarrier2(cmd, &dep);
+
+		// Copy data from staging buffer to image.
+		VkBufferImageCopy region{};
+		region.bufferOffset = staging.mOffset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { dst.mExtents.width, dst.mExtents.height, 1 };
+		vkCmdCopyBufferToImage(cmd, staging.mBuffer, dst.mImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		if (hasOwnershipTransfer()) {
+			VkImageMemoryBarrier2 handOver = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+			handOver.image = dst.mImage;
+			handOver.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+			handOver.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+			handOver.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			handOver.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+			if (mipLevels == 1) {
+				handOver.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+				handOver.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
+				handOver.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				transferToGraphics(batch, handOver);
+				return;
+			}
+			handOver.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+			handOver.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+			handOver.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			transferToGraphics(batch, handOver);
+		}
+
+		// Build the rest of the chain by repeatedly downsampling the previous level with a linear blit.
+		// Each source level is moved to SHADER_READ_ONLY_OPTIMAL as soon as its blit has been recorded.
+		int32_t width = static_cast<int32_t>(dst.mExtents.width);
+		int32_t height = static_cast<int32_t>(dst.mExtents.height);
+		for (uint32_t level = 1; level < mipLevels; ++level) {
+			VkImageMemoryBarrier2 toBlitSource = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+			toBlitSource.image = dst.mImage;
+			toBlitSource.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+			toBlitSource.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+			toBlitSource.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+			toBlitSource.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+			toBlitSource.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			toBlitSource.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			toBlitSource.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1, 0, 1 };
+
+			VkDependencyInfo blitDep = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+			blitDep.imageMemoryBarrierCount = 1;
+			blitDep.pImageMemoryBarriers = &toBlitSource;
+			vkCmdPipelineBarrier2(mipCmd, &blitDep);
+
+			const int32_t nextWidth = std::max(width / 2, 1);
+			const int32_t nextHeight = std::max(height / 2, 1);
+
+			VkImageBlit2 blit = { .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2 };
+			blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
+			blit.srcOffsets[1] = { width, height, 1 };
+			blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+			blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+
+			VkBlitImageInfo2 blitInfo = { .sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2 };
+			blitInfo.srcImage = dst.mImage;
+			blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			blitInfo.dstImage = dst.mImage;
+			blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			blitInfo.regionCount = 1;
+			blitInfo.pRegions = &blit;
+			blitInfo.filter = VK_FILTER_LINEAR;
+			vkCmdBlitImage2(mipCmd, &blitInfo);
+
+			VkImageMemoryBarrier2 sourceDone = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+			sourceDone.image = dst.mImage;
+			sourceDone.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+			sourceDone.srcAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+			sourceDone.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR;
+			sourceDone.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR;
+			sourceDone.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			sourceDone.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			sourceDone.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1, 0, 1 };
+
+			VkDependencyInfo sourceDoneDep = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+			sourceDoneDep.imageMemoryBarrierCount = 1;
+			sourceDoneDep.pImageMemoryBarriers = &sourceDone;
+			vkCmdPipelineBarrier2(mipCmd, &sourceDoneDep);
+
+			width = nextWidth;
+			height = nextHeight;
+		}
+
+		// The last level was only ever written to.
+		VkImageMemoryBarrier2 postCopyMemoryBarrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+		postCopyMemoryBarrier.image = dst.mImage;
+		postCopyMemoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+		postCopyMemoryBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		postCopyMemoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR;
+		postCopyMemoryBarrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR;
+		postCopyMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		postCopyMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		postCopyMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, mipLevels - 1, 1, 0, 1 };
+
+		VkDependencyInfo depPost = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		depPost.imageMemoryBarrierCount = 1;
+		depPost.pImageMemoryBarriers = &postCopyMemoryBarrier;
+		vkCmdPipelineBarrier2(mipCmd, &depPost);
+	}
+
+	void UploadContext::uploadImageLevels(const Image& dst, const TextureData& data)
+	{
+		const uint32_t levelCount = static_cast<uint32_t>(data.mLevels.size());
+
+		// Stage every level in one allocation, keeping each level at its offset within data.mBytes.
+		const StagingAllocation staging = allocateStaging(data.mBytes.size());
+		memcpy(staging.mMapped, data.mBytes.data(), data.mBytes.size());
+
+		Batch& batch = recordingBatch();
+		VkCommandBuffer cmd = batch.mCommandBuffer;
+
+		VkImageMemoryBarrier2 preCopyMemoryBarrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+		preCopyMemoryBarrier.image = dst.mImage;
+		preCopyMemoryBarrier.srcAccessMask = 0;
+		preCopyMemoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
+		preCopyMemoryBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
+		preCopyMemoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR;
+		preCopyMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		preCopyMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		preCopyMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+
+		VkDependencyInfo dep = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		dep.imageMemoryBarrierCount = 1;
+		dep.pImageMemoryBarriers = &preCopyMemoryBarrier;
+		vkCmdPipelineBarrier2(cmd, &dep);
+
+		std::vector<VkBufferImageCopy> regions(levelCount);
+		for (uint32_t level = 0; level < levelCount; ++level) {
+			const TextureLevel& source = data.mLevels[level];
+			VkBufferImageCopy& region = regions[level];
+			region = {};
+			region.bufferOffset = staging.mOffset + source.mOffset;
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+			region.imageOffset = { 0, 0, 0 };
+			region.imageExtent = { source.mWidth, source.mHeight, 1 };
+		}
+		vkCmdCopyBufferToImage(cmd, staging.mBuffer, dst.mImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levelCount, regions.data());
+
+		VkImageMemoryBarrier2 postCopyMemoryBarrier = { .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+		postCopyMemoryBarrier.image = dst.mImage;
+		postCopyMemoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+		postCopyMemoryBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		postCopyMemoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR;
+		postCopyMemoryBarrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR;
+		postCopyMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		postCopyMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		postCopyMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+
+		if (hasOwnershipTransfer()) {
+			transferToGraphics(batch, postCopyMemoryBarrier);
+			return;
+		}
+
+		VkDependencyInfo depPost = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		depPost.imageMemoryBarrierCount = 1;
+		depPost.pImageMemoryBarriers = &postCopyMemoryBarrier;
+		vkCmdPipelineBarrier2(cmd, &depPost);
+	}
+
+	void UploadContext::record(std::function<void(VkCommandBuffer cmd)>&& function)
+	{
+		function(graphicsCommandBuffer(recordingBatch()));
+	}
+
+	UploadToken UploadContext::submit()
+	{
+		if (!mRecording) {
+			return mLastSubmitted;
+		}
+
+		Batch batch = std::move(*mRecording);
+		mRecording.reset();
+
+		VK_CHECK(vkEndCommandBuffer(batch.mCommandBuffer));
+
+		const VkCommandBufferSubmitInfo cmdinfo = {
+			.sType			= VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+			.commandBuffer	= batch.mCommandBuffer,
+			.deviceMask		= 0
+		};
+
+		if (!hasOwnershipTransfer()) {
+			const VkSubmitInfo2 submitInfo = {
+				.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+				.commandBufferInfoCount	= 1,
+				.pCommandBufferInfos	= &cmdinfo
+			};
+			VK_CHECK(vkQueueSubmit2(mTransferQueue, 1, &submitInfo, batch.mFence));
+		}
+		else {
+			// The copies and release barriers run on the transfer queue. The graphics queue waits for them,
+			// acquires the resources and runs the rest of the batch. Its fence marks the batch as complete.
+			VK_CHECK(vkEndCommandBuffer(batch.mGraphicsCommandBuffer));
+
+			const VkSemaphoreSubmitInfo transferDone = {
+				.sType		= VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+				.semaphore	= batch.mTransferDone,
+				.stageMask	= VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT
+			};
+			const VkSubmitInfo2 transferSubmitInfo = {
+				.sType						= VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+				.commandBufferInfoCount		= 1,
+				.pCommandBufferInfos		= &cmdinfo,
+				.signalSemaphoreInfoCount	= 1,
+				.pSignalSemaphoreInfos		= &transferDone
+			};
+			VK_CHECK(vkQueueSubmit2(mTransferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE));
+
+			const VkCommandBufferSubmitInfo graphicsCmdInfo = {
+				.sType			= VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+				.commandBuffer	= batch.mGraphicsCommandBuffer,
+				.deviceMask		= 0
+			};
+			const VkSubmitInfo2 graphicsSubmitInfo = {
+				.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+				.waitSemaphoreInfoCount	= 1,
+				.pWaitSemaphoreInfos	= &transferDone,
+				.commandBufferInfoCount	= 1,
+				.pCommandBufferInfos	= &graphicsCmdInfo
+			};
+			VK_CHECK(vkQueueSubmit2(mGraphicsQueue, 1, &graphicsSubmitInfo, batch.mFence));
+		}
+
+		batch.mToken = ++mLastSubmitted;
+		mInFlight.push_back(std::move(batch));
+		return mLastSubmitted;
+	}
+
+	bool UploadContext::isComplete(UploadToken token)
+	{
+		retireCompleted();
+		return token <= mLastCompleted;
+	}
+
+	void UploadContext::wait(UploadToken token)
+	{
+		while (token > mLastCompleted && !mInFlight.empty()) {
+			Batch& oldest = mInFlight.front();
+			VK_CHECK(vkWaitForFences(mDevice, 1, &oldest.mFence, VK_TRUE, UINT64_MAX));
+			mLastCompleted = oldest.mToken;
+			recycle(std::move(oldest));
+			mInFlight.pop_front();
+		}
+	}
+
+	UploadContext::Batch& UploadContext::recordingBatch()
+	{
+		if (mRecording) {
+			return *mRecording;
+		}
+
+		retireCompleted();
+		if (!mFreeBatches.empty()) {
+			mRecording = std::move(mFreeBatches.back());
+			mFreeBatches.pop_back();
+			VK_CHECK(vkResetCommandPool(mDevice, mRecording->mCommandPool, 0));
+			if (hasOwnershipTransfer()) {
+				VK_CHECK(vkResetCommandPool(mDevice, mRecording->mGraphicsCommandPool, 0));
+			}
+			VK_CHECK(vkResetFences(mDevice, 1, &mRecording->mFence));
+		}
+		else {
+			Batch batch;
+			const VkCommandPoolCreateInfo commandPoolInfo = vkinit::commandPoolCreateInfo(mTransferQueueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+			VK_CHECK(vkCreateCommandPool(mDevice, &commandPoolInfo, nullptr, &batch.mCommandPool));
+			const VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::commandBufferAllocateInfo(batch.mCommandPool, 1);
+			VK_CHECK(vkAllocateCommandBuffers(mDevice, &cmdAllocInfo, &batch.mCommandBuffer));
+			const VkFenceCreateInfo fncCreateInfo = vkinit::fenceCreateInfo();
+			VK_CHECK(vkCreateFence(mDevice, &fncCreateInfo, nullptr, &batch.mFence));
+
+			if (hasOwnershipTransfer()) {
+				const VkCommandPoolCreateInfo graphicsPoolInfo = vkinit::commandPoolCreateInfo(mGraphicsQueueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+				VK_CHECK(vkCreateCommandPool(mDevice, &graphicsPoolInfo, nullptr, &batch.mGraphicsCommandPool));
+				const VkCommandBufferAllocateInfo graphicsCmdAllocInfo = vkinit::commandBufferAllocateInfo(batch.mGraphicsCommandPool, 1);
+				VK_CHECK(vkAllocateCommandBuffers(mDevice, &graphicsCmdAllocInfo, &batch.mGraphicsCommandBuffer));
+				const VkSemaphoreCreateInfo semaphoreInfo = vkinit::semaphoreCreateInfo();
+				VK_CHECK(vkCreateSemaphore(mDevice, &semaphoreInfo, nullptr, &batch.mTransferDone));
+			}
+			mRecording = std::move(batch);
+		}
+
+		const VkCommandBufferBeginInfo cmdBeginInfo = vkinit::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+		VK_CHECK(vkBeginCommandBuffer(mRecording->mCommandBuffer, &cmdBeginInfo));
+		if (hasOwnershipTransfer()) {
+			VK_CHECK(vkBeginCommandBuffer(mRecording->mGraphicsCommandBuffer, &cmdBeginInfo));
+		}
+		return *mRecording;
+	}
+
+	VkCommandBuffer UploadContext::graphicsCommandBuffer(const Batch& batch) const
+	{
+		return hasOwnershipTransfer() ? batch.mGraphicsCommandBuffer : batch.mCommandBuffer;
+	}
+
+	void UploadContext::transferToGraphics(Batch& batch, const VkBufferMemoryBarrier2& barrier)
+	{
+		VkBufferMemoryBarrier2 release = barrier;
+		release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+		release.dstAccessMask = VK_ACCESS_2_NONE;
+		release.srcQueueFamilyIndex = mTransferQueueFamily;
+		release.dstQueueFamilyIndex = mGraphicsQueueFamily;
+
+		VkBufferMemoryBarrier2 acquire = barrier;
+		acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		acquire.srcAccessMask = VK_ACCESS_2_NONE;
+		acquire.srcQueueFamilyIndex = mTransferQueueFamily;
+		acquire.dstQueueFamilyIndex = mGraphicsQueueFamily;
+
+		VkDependencyInfo releaseDep = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		releaseDep.bufferMemoryBarrierCount = 1;
+		releaseDep.pBufferMemoryBarriers = &release;
+		vkCmdPipelineBarrier2(batch.mCommandBuffer, &releaseDep);
+
+		VkDependencyInfo acquireDep = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		acquireDep.bufferMemoryBarrierCount = 1;
+		acquireDep.pBufferMemoryBarriers = &acquire;
+		vkCmdPipelineBarrier2(batch.mGraphicsCommandBuffer, &acquireDep);
+	}
+
+	void UploadContext::transferToGraphics(Batch& batch, const VkImageMemoryBarrier2& barrier)
+	{
+		// The layout transition is part of both barriers but is only executed once.
+		VkImageMemoryBarrier2 release = barrier;
+		release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+		release.dstAccessMask = VK_ACCESS_2_NONE;
+		release.srcQueueFamilyIndex = mTransferQueueFamily;
+		release.dstQueueFamilyIndex = mGraphicsQueueFamily;
+
+		VkImageMemoryBarrier2 acquire = barrier;
+		acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		acquire.srcAccessMask = VK_ACCESS_2_NONE;
+		acquire.srcQueueFamilyIndex = mTransferQueueFamily;
+		acquire.dstQueueFamilyIndex = mGraphicsQueueFamily;
+
+		VkDependencyInfo releaseDep = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		releaseDep.imageMemoryBarrierCount = 1;
+		releaseDep.pImageMemoryBarriers = &release;
+		vkCmdPipelineBarrier2(batch.mCommandBuffer, &releaseDep);
+
+		VkDependencyInfo acquireDep = { .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+		acquireDep.imageMemoryBarrierCount = 1;
+		acquireDep.pImageMemoryBarriers = &acquire;
+		vkCmdPipelineBarrier2(batch.mGraphicsCommandBuffer, &acquireDep);
+	}
+
+	UploadContext::StagingAllocation UploadContext::allocateStaging(VkDeviceSize size)
+	{
+		// Start a new batch rather than letting a single one hold on to unbounded staging memory.
+		if (mRecording && mRecording->mStagingBytes + size > mMaxBatchBytes && mRecording->mStagingBytes > 0) {
+			submit();
+		}
+		Batch& batch = recordingBatch();
+
+		// Offsets are kept 16-byte aligned, which satisfies buffer-to-image copies of every format we upload.
+		const VkDeviceSize alignedSize = (size + 15) & ~VkDeviceSize(15);
+
+		// Capacity is the size the buffer was created with. VMA may round the allocation up, but copies must stay inside the buffer.
+		StagingChunk* chunk = nullptr;
+		for (auto& candidate : batch.mStaging) {
+			if (candidate.mBuffer.mSizeBytes - candidate.mUsed >= alignedSize) {
+				chunk = &candidate;
+				break;
+			}
+		}
+		if (!chunk) {
+			const VkDeviceSize chunkSize = std::max(alignedSize, STAGING_CHUNK_SIZE);
+			batch.mStaging.push_back({ .mBuffer = createHostVisibleStagingBuffer(mAllocator, chunkSize) });
+			chunk = &batch.mStaging.back();
+		}
+
+		const StagingAllocation allocation = {
+			.mBuffer	= chunk->mBuffer.mBuffer,
+			.mOffset	= chunk->mUsed,
+			.mMapped	= static_cast<char*>(chunk->mBuffer.mAllocInfo.pMappedData) + chunk->mUsed
+		};
+		chunk->mUsed += alignedSize;
+		batch.mStagingBytes += alignedSize;
+		return allocation;
+	}
+
+	void UploadContext::retireCompleted()
+	{
+		while (!mInFlight.empty() && vkGetFenceStatus(mDevice, mInFlight.front().mFence) == VK_SUCCESS) {
+			mLastCompleted = mInFlight.front().mToken;
+			recycle(std::move(mInFlight.front()));
+			mInFlight.pop_front();
+		}
+	}
+
+	void UploadContext::recycle(Batch&& batch)
+	{
+		// Keep regular sized staging chunks around for the next batch, but release oversized ones.
+		std::erase_if(batch.mStaging, [&](StagingChunk& chunk) {
+			if (chunk.mBuffer.mSizeBytes > STAGING_CHUNK_SIZE) {
+				vmaDestroyBuffer(mAllocator, chunk.mBuffer.mBuffer, chunk.mBuffer.mAllocation);
+				return true;
+			}
+			chunk.mUsed = 0;
+			return false;
+			});
+		batch.mStagingBytes = 0;
+		batch.mToken = 0;
+		mFreeBatches.push_back(std::move(batch));
+	}
+}
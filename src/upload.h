@@ -0,0 +1,114 @@
+#pragma once
+
+#include <deque>
+
+#include "vk_types.h"
+#include "buffer.h"
+#include "image.h"
+#include "texture.h"
+
+namespace scvk
+{
+	// Identifies a submitted upload batch. Tokens increase with every submit, and batches complete in submission order.
+	using UploadToken = uint64_t;
+
+	// Records buffer and image uploads into a shared command buffer and submits them together,
+	// so uploading many resources costs one CPU/GPU round trip instead of one per resource.
+	// Copies run on the transfer queue, which may be a dedicated one. If its family differs from the graphics
+	// family, every uploaded resource is released to the graphics family and acquired there in the same batch.
+	class UploadContext
+	{
+	public:
+
+		// Pass the graphics queue as the transfer queue when there is no separate transfer queue.
+		void init(VkDevice device, VmaAllocator allocator, VkQueue transferQueue, uint32_t transferQueueFamily, VkQueue graphicsQueue, uint32_t graphicsQueueFamily);
+		void destroy();
+
+		// Copies size bytes of data into dst at dstOffset.
+		void uploadBuffer(const Buffer& dst, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+
+		// Copies tightly packed texel data into mip 0 of dst, generates levels 1 to mipLevels - 1 with a chain of linear blits
+		// and transitions all levels to SHADER_READ_ONLY_OPTIMAL. The image needs TRANSFER_SRC usage when mipLevels > 1.
+		void uploadImage(const Image& dst, const void* data, VkDeviceSize size, uint32_t mipLevels = 1);
+
+		// Copies every level of data, e.g. a block-compressed mip chain, into the matching level of dst as is
+		// and transitions all levels to SHADER_READ_ONLY_OPTIMAL. dst must have data.mFormat and data.mLevels.size() levels.
+		void uploadImageLevels(const Image& dst, const TextureData& data);
+
+		// Records arbitrary commands into the current batch. They run on the graphics queue, after the batch's transfers.
+		void record(std::function<void(VkCommandBuffer cmd)>&& function);
+
+		// Submits everything recorded since the last submit and returns a token that completes with it.
+		UploadToken submit();
+
+		// Returns true once the batch identified by token has finished executing. Never blocks.
+		bool isComplete(UploadToken token);
+
+		// Blocks until the batch identified by token has finished executing.
+		void wait(UploadToken token);
+
+		// True when uploads run on a separate queue family and hand their resources over to the graphics family.
+		bool hasOwnershipTransfer() const { return mTransferQueueFamily != mGraphicsQueueFamily; }
+
+		// Bytes of staging memory recorded into the current, unsubmitted batch.
+		VkDeviceSize pendingBytes() const { return mRecording ? mRecording->mStagingBytes : 0; }
+
+		// A batch is submitted automatically once its staging memory exceeds this size, bounding peak staging memory.
+		VkDeviceSize mMaxBatchBytes{ 256ull * 1024 * 1024 };
+
+	private:
+
+		struct StagingChunk
+		{
+			Buffer			mBuffer;
+			VkDeviceSize	mUsed{ 0 };
+		};
+
+		struct Batch
+		{
+			VkCommandPool				mCommandPool{ VK_NULL_HANDLE };
+			VkCommandBuffer				mCommandBuffer{ VK_NULL_HANDLE };		// Transfer queue.
+			VkFence						mFence{ VK_NULL_HANDLE };
+
+			// Only used with ownership transfers: acquires the uploaded resources on the graphics queue once mTransferDone is signalled.
+			VkCommandPool				mGraphicsCommandPool{ VK_NULL_HANDLE };
+			VkCommandBuffer				mGraphicsCommandBuffer{ VK_NULL_HANDLE };
+			VkSemaphore					mTransferDone{ VK_NULL_HANDLE };
+
+			std::vector<StagingChunk>	mStaging;
+			VkDeviceSize				mStagingBytes{ 0 };
+			UploadToken					mToken{ 0 };
+		};
+
+		struct StagingAllocation
+		{
+			VkBuffer		mBuffer;
+			VkDeviceSize	mOffset;
+			void*			mMapped;
+		};
+
+		Batch& recordingBatch();
+		VkCommandBuffer graphicsCommandBuffer(const Batch& batch) const;
+		void transferToGraphics(Batch& batch, const VkBufferMemoryBarrier2& barrier);
+		void transferToGraphics(Batch& batch, const VkImageMemoryBarrier2& barrier);
+		StagingAllocation allocateStaging(VkDeviceSize size);
+		void retireCompleted();
+		void recycle(Batch&& batch);
+
+		VkDevice		mDevice{ VK_NULL_HANDLE };
+		VmaAllocator	mAllocator{ VK_NULL_HANDLE };
+		VkQueue			mTransferQueue{ VK_NULL_HANDLE };
+		uint32_t		mTransferQueueFamily{ 0 };
+		VkQueue			mGraphicsQueue{ VK_NULL_HANDLE };
+		uint32_t		mGraphicsQueueFamily{ 0 };
+
+		std::optional<Batch>	mRecording;
+		std::deque<Batch>		mInFlight;
+		std::vector<Batch>		mFreeBatches;
+
+		UploadToken		mLastSubmitted{ 0 };
+		UploadToken		mLastCompleted{ 0 };
+
+		static constexpr VkDeviceSize STAGING_CHUNK_SIZE = 64ull * 1024 * 1024;
+	};
+}
@@ -0,0 +1,136 @@
+#include "vertex_packing.h"
+
+namespace scvk
+{
+	namespace
+	{
+		// Vertices per parallelFor job.
+		constexpr size_t PACKING_BLOCK_SIZE = 64 * 1024;
+
+		uint32_t packNormal16(glm::vec3 normal)
+		{
+			return glm::packSnorm2x16(octEncode(normal));
+		}
+
+		uint16_t packNormal8(glm::vec3 normal)
+		{
+			const glm::vec2 encoded = glm::round(glm::clamp(octEncode(normal), -1.f, 1.f) * 127.f);
+			return static_cast<uint16_t>(static_cast<uint8_t>(static_cast<int8_t>(encoded.x)) | (static_cast<uint8_t>(static_cast<int8_t>(encoded.y)) << 8));
+		}
+
+		uint32_t packUV(const Vertex& vertex)
+		{
+			return glm::packHalf2x16(glm::vec2(vertex.uv_x, vertex.uv_y));
+		}
+
+		uint32_t packColor(const Vertex& vertex)
+		{
+			return glm::packUnorm4x8(vertex.color);
+		}
+	}
+
+	size_t vertexStride(VertexFormat format)
+	{
+		switch (format) {
+		case VertexFormat::Packed:		return sizeof(PackedVertex);
+		case VertexFormat::Quantized:	return sizeof(QuantizedVertex);
+		default:						return sizeof(Vertex);
+		}
+	}
+
+	const char* vertexFormatName(VertexFormat format)
+	{
+		switch (format) {
+		case VertexFormat::Packed:		return "packed";
+		case VertexFormat::Quantized:	return "quantized";
+		default:						return "float";
+		}
+	}
+
+	glm::vec2 octEncode(glm::vec3 normal)
+	{
+		const float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		if (l1 == 0.f) {
+			return glm::vec2(0.f);
+		}
+		normal /= l1;
+		glm::vec2 encoded(normal.x, normal.y);
+		if (normal.z < 0.f) {
+			// Fold the lower hemisphere over the diagonals.
+			encoded.x = (1.f - std::abs(normal.y)) * (normal.x >= 0.f ? 1.f : -1.f);
+			encoded.y = (1.f - std::abs(normal.x)) * (normal.y >= 0.f ? 1.f : -1.f);
+		}
+		return encoded;
+	}
+
+	glm::vec3 octDecode(glm::vec2 encoded)
+	{
+		glm::vec3 normal(encoded.x, encoded.y, 1.f - std::abs(encoded.x) - std::abs(encoded.y));
+		const float t = std::max(-normal.z, 0.f);
+		normal.x += normal.x >= 0.f ? -t : t;
+		normal.y += normal.y >= 0.f ? -t : t;
+		return glm::normalize(normal);
+	}
+
+	void packVertices(LoadedMesh& mesh, VertexFormat format, ThreadPool& pool)
+	{
+		if (format == VertexFormat::Float) {
+			return;
+		}
+		const std::span<const Vertex> vertices = mesh.vertexData();
+		const size_t blockCount = (vertices.size() + PACKING_BLOCK_SIZE - 1) / PACKING_BLOCK_SIZE;
+		mesh.mVertexFormat = format;
+		mesh.mPackedVertices.resize(vertices.size() * vertexStride(format));
+		mesh.mPositionDequantization = glm::mat4(1.f);
+
+		if (format == VertexFormat::Packed) {
+			auto* packed = reinterpret_cast<PackedVertex*>(mesh.mPackedVertices.data());
+			pool.parallelFor(blockCount, [&](size_t block) {
+				for (size_t i = block * PACKING_BLOCK_SIZE; i < std::min(vertices.size(), (block + 1) * PACKING_BLOCK_SIZE); ++i) {
+					packed[i] = {
+						.position = vertices[i].position,
+						.normal = packNormal16(vertices[i].normal),
+						.uv = packUV(vertices[i]),
+						.color = packColor(vertices[i]) };
+				}
+				});
+			return;
+		}
+
+		// Quantized: find the bounds first, block by block.
+		std::vector<glm::vec3> blockMin(blockCount, glm::vec3(std::numeric_limits<float>::max()));
+		std::vector<glm::vec3> blockMax(blockCount, glm::vec3(std::numeric_limits<float>::lowest()));
+		pool.parallelFor(blockCount, [&](size_t block) {
+			for (size_t i = block * PACKING_BLOCK_SIZE; i < std::min(vertices.size(), (block + 1) * PACKING_BLOCK_SIZE); ++i) {
+				blockMin[block] = glm::min(blockMin[block], vertices[i].position);
+				blockMax[block] = glm::max(blockMax[block], vertices[i].position);
+			}
+			});
+		glm::vec3 boundsMin(0.f);
+		glm::vec3 boundsMax(0.f);
+		if (blockCount > 0) {
+			boundsMin = blockMin[0];
+			boundsMax = blockMax[0];
+			for (size_t block = 1; block < blockCount; ++block) {
+				boundsMin = glm::min(boundsMin, blockMin[block]);
+				boundsMax = glm::max(boundsMax, blockMax[block]);
+			}
+		}
+		const glm::vec3 extent = boundsMax - boundsMin;
+		const glm::vec3 toUnorm = glm::vec3(65535.f) / glm::max(extent, glm::vec3(std::numeric_limits<float>::min()));
+		// The shader unpacks positions to [0, 1].
+		mesh.mPositionDequantization = glm::translate(glm::mat4(1.f), boundsMin) * glm::scale(glm::mat4(1.f), extent);
+
+		auto* quantized = reinterpret_cast<QuantizedVertex*>(mesh.mPackedVertices.data());
+		pool.parallelFor(blockCount, [&](size_t block) {
+			for (size_t i = block * PACKING_BLOCK_SIZE; i < std::min(vertices.size(), (block + 1) * PACKING_BLOCK_SIZE); ++i) {
+				const glm::vec3 q = glm::round(glm::clamp((vertices[i].position - boundsMin) * toUnorm, 0.f, 65535.f));
+				quantized[i] = {
+					.position = { static_cast<uint16_t>(q.x), static_cast<uint16_t>(q.y), static_cast<uint16_t>(q.z) },
+					.normal = packNormal8(vertices[i].normal),
+					.uv = packUV(vertices[i]),
+					.color = packColor(vertices[i]) };
+			}
+			});
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+namespace scvk
+{
+	size_t vertexStride(VertexFormat format);
+	const char* vertexFormatName(VertexFormat format);
+
+	// Octahedral mapping of a unit vector onto [-1, 1]^2, and back. Matches octDecode() in the vertex shader.
+	glm::vec2 octEncode(glm::vec3 normal);
+	glm::vec3 octDecode(glm::vec2 encoded);
+
+	// Converts mesh.vertexData() to format, on the pool's workers, into mesh.mPackedVertices and sets mesh.mVertexFormat.
+	// Quantized positions are relative to the bounds of all vertices, which mesh.mPositionDequantization maps them back to.
+	// The float vertices are kept. Packing to VertexFormat::Float does nothing.
+	void packVertices(LoadedMesh& mesh, VertexFormat format, ThreadPool& pool);
+}